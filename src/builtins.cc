@@ -1,6 +1,8 @@
 #include "code.h"
 #include "builtins.h"
 #include "parser.h"
+#include "numbers.h"
+#include "persistent.h"
 
 namespace lilis
 {
@@ -18,59 +20,158 @@ struct t_static : t_object
 	{
 		return this;
 	}
+	virtual void f_dump(const t_dump& a_dump) const;
 };
 
 struct : t_static
 {
-	struct t_instantiate : t_with_value<t_object_of<t_instantiate>, t_holder<t_code>>
+	struct t_instance : t_with_value<t_object_of<t_instance>, t_pair>
 	{
 		using t_base::t_base;
 		virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 		{
-			a_emit((*v_value)->v_rest ? e_instruction__LAMBDA_WITH_REST : e_instruction__LAMBDA, a_stack + 1)(v_value);
+			auto body = v_value;
+			for (; body->v_tail; body = static_cast<t_pair*>(body->v_tail)) {
+				body->v_head->f_emit(a_emit, a_stack, false);
+				a_emit(e_instruction__POP, a_stack);
+			}
+			body->v_head->f_emit(a_emit, a_stack, a_tail);
+		}
+		virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass)
+		{
+			auto& engine = a_code.v_engine;
+			auto thiz = engine.f_pointer(this);
+			for (auto p = engine.f_pointer(v_value); p; p = static_cast<t_pair*>(p->v_tail)) {
+				auto x = p->v_head->f_optimize(a_code, a_pass);
+				p->v_head = x;
+			}
+			return a_pass.v_rewrite(a_code, thiz);
+		}
+		virtual void f_dump(const t_dump& a_dump) const
+		{
+			a_dump << L"(begin"sv;
+			for (auto p = v_value; p; p = static_cast<t_pair*>(p->v_tail)) a_dump << L" "sv << p->v_head;
+			a_dump << L")"sv;
 		}
 	};
 
 	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
 	{
 		auto& engine = a_code.v_engine;
-		auto pair = engine.f_pointer(a_pair);
-		auto code = engine.f_pointer(a_code.f_new());
-		(*code)->f_compile(a_location, pair);
-		return engine.f_new<t_instantiate>(code);
+		if (!a_pair->v_tail) return engine.f_node<t_quote>(nullptr);
+		auto arguments = engine.f_pointer(a_location->f_cast_tail<t_pair>(a_pair));
+		auto last = engine.f_pointer(engine.f_node<t_pair>(engine.f_pointer(a_code.f_render(arguments->v_head, a_location->f_at_head(arguments))), nullptr));
+		auto block = engine.f_pointer(engine.f_node<t_instance>(last));
+		while (arguments->v_tail) {
+			arguments = a_location->f_cast_tail<t_pair>(arguments);
+			engine.f_push_node(last, a_code.f_render(arguments->v_head, a_location->f_at_head(arguments)));
+		}
+		return block;
 	}
-} v_lambda;
+} v_begin;
 
 struct : t_static
 {
-	struct t_instance : t_with_value<t_object_of<t_instance>, t_pair>
+	struct t_instantiate : t_with_value<t_object_of<t_instantiate>, t_holder<t_code>>
 	{
 		using t_base::t_base;
 		virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 		{
-			auto body = v_value;
-			for (; body->v_tail; body = static_cast<t_pair*>(body->v_tail)) {
-				body->v_head->f_emit(a_emit, a_stack, false);
-				a_emit(e_instruction__POP, a_stack);
-			}
-			body->v_head->f_emit(a_emit, a_stack, a_tail);
+			a_emit((*v_value)->v_rest ? e_instruction__LAMBDA_WITH_REST : e_instruction__LAMBDA, a_stack + 1)(v_value);
+		}
+		virtual void f_dump(const t_dump& a_dump) const
+		{
+			a_dump << L"#lambda"sv;
 		}
 	};
 
 	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
 	{
 		auto& engine = a_code.v_engine;
-		if (!a_pair->v_tail) return engine.f_new<t_quote>(nullptr);
-		auto arguments = engine.f_pointer(a_location->f_cast_tail<t_pair>(a_pair));
-		auto last = engine.f_pointer(engine.f_new<t_pair>(engine.f_pointer(a_code.f_render(arguments->v_head, a_location->f_at_head(arguments))), nullptr));
-		auto block = engine.f_pointer(engine.f_new<t_instance>(last));
-		while (arguments->v_tail) {
-			arguments = a_location->f_cast_tail<t_pair>(arguments);
-			f_push(engine, last, a_code.f_render(arguments->v_head, a_location->f_at_head(arguments)));
+		auto self = a_pair == a_code.v_definition;
+		auto pair = engine.f_pointer(a_pair);
+		auto code = engine.f_pointer(a_code.f_new());
+		if (self) (*code)->v_self = a_code.v_defining;
+		(*code)->f_compile(a_location, pair);
+		if (!(*code)->v_loops.empty()) a_code.v_recursions.push_back(code);
+		return engine.f_node<t_instantiate>(code);
+	}
+	// Whether a_value may make a closure, which would share the inlined locals across re-entries of multi-shot continuations.
+	bool f_closes(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_object* a_value)
+	{
+		if (f_as<t_quote>(a_value)) return false;
+		if (auto p = f_as<t_unquote>(a_value)) return f_closes(a_code, a_location, p->v_value);
+		if (auto p = f_as<t_quasiquote>(a_value)) return f_closes(a_code, a_location, p->v_value);
+		for (auto pair = f_as<t_pair>(a_value); pair; pair = f_as<t_pair>(pair->v_tail)) {
+			if (auto symbol = f_as<t_symbol>(pair->v_head)) {
+				try {
+					auto value = a_code.f_resolve(symbol, a_location);
+					if (value == this || f_as<t_macro>(value)) return true;
+				} catch (t_error&) {
+				}
+			} else if (f_closes(a_code, a_location, pair->v_head)) {
+				return true;
+			}
 		}
-		return block;
+		return false;
 	}
-} v_begin;
+	virtual t_object* f_inline(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
+	{
+		auto& engine = a_code.v_engine;
+		auto lambda = engine.f_pointer(static_cast<t_pair*>(a_pair->v_head));
+		auto body = f_as<t_pair>(lambda->v_tail);
+		if (!body) return nullptr;
+		size_t n = 0;
+		for (auto p = body->v_head; p; p = static_cast<t_pair*>(p)->v_tail, ++n) {
+			auto pair = f_as<t_pair>(p);
+			if (!pair || !f_as<t_symbol>(pair->v_head)) return nullptr;
+		}
+		for (auto p = a_pair->v_tail; p; p = static_cast<t_pair*>(p)->v_tail, --n)
+			if (!f_as<t_pair>(p)) return nullptr;
+		if (f_closes(a_code, a_location, body->v_tail)) return nullptr;
+		if (n != 0) a_location->f_try([]
+		{
+			throw t_error{L"wrong number of arguments"s};
+		});
+		auto pair = engine.f_pointer(a_pair);
+		auto block = engine.f_pointer(engine.f_node<t_pair>(nullptr, nullptr));
+		auto last = engine.f_pointer(block.v_value);
+		for (auto arguments = engine.f_pointer(pair->v_tail); arguments; arguments = static_cast<t_pair*>(arguments.v_value)->v_tail) {
+			auto p = static_cast<t_pair*>(arguments.v_value);
+			engine.f_push_node(last, a_code.f_render(p->v_head, a_location->f_at_head(p)));
+		}
+		a_code.v_shadows.push_back(std::move(a_code.v_bindings));
+		a_code.v_bindings.clear();
+		try {
+			auto argument = engine.f_pointer(block.v_value);
+			for (auto parameters = engine.f_pointer(static_cast<t_pair*>(lambda->v_tail)->v_head); parameters; parameters = static_cast<t_pair*>(parameters.v_value)->v_tail) {
+				auto local = engine.f_pointer(engine.f_new<t_code::t_local>(a_code.v_this, a_code.v_locals.size()));
+				auto symbol = static_cast<t_symbol*>(static_cast<t_pair*>(parameters.v_value)->v_head);
+				a_code.v_bindings.insert_or_assign(symbol, local);
+				a_code.v_locals.push_back(symbol);
+				argument = static_cast<t_pair*>(argument->v_tail);
+				auto value = local->f_render(a_code, argument->v_head);
+				argument->v_head = value;
+			}
+			auto location = a_location->f_at_head(pair);
+			if (auto p = static_cast<t_pair*>(lambda->v_tail)->v_tail) {
+				for (auto body = engine.f_pointer(location->f_cast<t_pair>(p));; body = location->f_cast_tail<t_pair>(body)) {
+					engine.f_push_node(last, a_code.f_render(body->v_head, location->f_at_head(body)));
+					if (!body->v_tail) break;
+				}
+			} else {
+				engine.f_push_node(last, a_code.f_render(nullptr, location));
+			}
+		} catch (...) {
+			a_code.v_bindings = std::move(a_code.v_shadows.back());
+			a_code.v_shadows.pop_back();
+			throw;
+		}
+		a_code.v_bindings = std::move(a_code.v_shadows.back());
+		a_code.v_shadows.pop_back();
+		return engine.f_node<decltype(v_begin)::t_instance>(engine.f_pointer(static_cast<t_pair*>(block->v_tail)));
+	}
+} v_lambda;
 
 struct : t_static
 {
@@ -84,8 +185,13 @@ struct : t_static
 		a_location->f_nil_tail(arguments);
 		auto local = engine.f_pointer(engine.f_new<t_code::t_local>(a_code.v_this, a_code.v_locals.size()));
 		a_code.v_bindings.emplace(symbol, local);
+		a_code.f_bind(symbol);
 		a_code.v_locals.push_back(symbol);
+		a_code.v_defining = local;
+		a_code.v_definition = expression;
 		auto value = a_code.f_render(expression, a_location->f_at_head(arguments));
+		a_code.v_defining = nullptr;
+		a_code.v_definition = nullptr;
 		return local->f_render(a_code, value);
 	}
 } v_define;
@@ -105,27 +211,13 @@ struct : t_static
 		arguments = a_location->f_cast_tail<t_pair>(arguments);
 		auto value = a_code.f_render(arguments->v_head, a_location->f_at_head(arguments));
 		a_location->f_nil_tail(arguments);
+		if (auto local = dynamic_cast<t_code::t_local*>(bound.v_value)) local->v_mutated = true;
 		return dynamic_cast<t_mutable*>(bound.v_value)->f_render(a_code, value);
 	}
 } v_set;
 
 struct : t_static
 {
-	struct t_instance : t_with_value<t_object_of<t_instance>, t_holder<t_code>>
-	{
-		using t_base::t_base;
-		virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
-		{
-			return a_location->f_try([&]
-			{
-				auto& engine = a_code.v_engine;
-				engine.f_run(*v_value, a_pair->v_tail);
-				auto p = engine.v_used[0];
-				return a_code.f_render(p, std::make_shared<t_at_expression>(engine, p));
-			});
-		}
-	};
-
 	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
 	{
 		auto& engine = a_code.v_engine;
@@ -135,10 +227,54 @@ struct : t_static
 		auto code = engine.f_pointer(a_code.f_new());
 		(*code)->v_macro = true;
 		(*code)->f_compile(at_tail, arguments);
-		return a_code.v_bindings.insert_or_assign(symbol, engine.f_new<t_instance>(code)).first->second;
+		auto macro = a_code.v_bindings.insert_or_assign(symbol, engine.f_new<t_macro>(code)).first->second;
+		a_code.f_bind(symbol);
+		return macro;
 	}
 } v_macro;
 
+// Binds the procedures as constants at compile time so that calls to them are compiled to the record instructions.
+struct : t_static
+{
+	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
+	{
+		auto& engine = a_code.v_engine;
+		auto arguments = engine.f_pointer(a_location->f_cast_tail<t_pair>(a_pair));
+		auto interned = [&](t_pair* a_p)
+		{
+			auto at_head = a_location->f_at_head(a_p);
+			auto symbol = at_head->f_cast<t_symbol>(a_p->v_head);
+			at_head->f_try([&]
+			{
+				if (symbol->v_entry == decltype(symbol->v_entry){}) throw t_error{L"must be interned"s};
+			});
+			return symbol->v_entry->first;
+		};
+		auto name = interned(arguments);
+		size_t n = 0;
+		for (auto p = arguments.v_value; p->v_tail; ++n) {
+			p = a_location->f_cast_tail<t_pair>(p);
+			interned(p);
+		}
+		auto type = engine.f_pointer(engine.f_new<t_record_type>(engine.f_pointer(static_cast<t_symbol*>(arguments->v_head)), n));
+		auto define = [&](const std::wstring& a_name, t_record_procedure::t_kind a_kind, size_t a_index)
+		{
+			auto symbol = engine.f_pointer(engine.f_symbol(a_name));
+			a_code.v_bindings.insert_or_assign(symbol, engine.f_new<t_record_procedure>(symbol, type, a_kind, a_index));
+			a_code.f_bind(symbol);
+		};
+		define(L"make-" + name, t_record_procedure::e_kind__CONSTRUCTOR, 0);
+		define(name + L"?", t_record_procedure::e_kind__PREDICATE, 0);
+		size_t i = 0;
+		for (auto p = engine.f_pointer(static_cast<t_pair*>(arguments->v_tail)); p; p = static_cast<t_pair*>(p->v_tail), ++i) {
+			auto field = static_cast<t_symbol*>(p->v_head)->v_entry->first;
+			define(name + L"-" + field, t_record_procedure::e_kind__ACCESSOR, i);
+			define(L"set-" + name + L"-" + field + L"!", t_record_procedure::e_kind__MODIFIER, i);
+		}
+		return engine.f_node<t_quote>(nullptr);
+	}
+} v_record;
+
 struct : t_static
 {
 	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
@@ -151,11 +287,11 @@ struct : t_static
 		a_location->f_nil_tail(arguments);
 		if (dynamic_cast<t_mutable*>(bound.v_value)) {
 			auto variable = engine.f_pointer(engine.f_new<t_module::t_variable>(nullptr));
-			(*a_code.v_module)->insert_or_assign(symbol, variable);
+			(*a_code.v_module)->f_export(symbol, variable);
 			return variable->f_render(a_code, bound);
 		}
-		(*a_code.v_module)->insert_or_assign(symbol, bound);
-		return engine.f_new<t_quote>(nullptr);
+		(*a_code.v_module)->f_export(symbol, bound);
+		return engine.f_node<t_quote>(nullptr);
 	}
 } v_export;
 
@@ -166,12 +302,14 @@ struct : t_static
 		auto& engine = a_code.v_engine;
 		auto arguments = engine.f_pointer(a_location->f_cast_tail<t_pair>(a_pair));
 		auto location = a_location->f_at_head(arguments);
-		a_code.v_imports.push_back(location->f_try([&]
+		auto module = location->f_try([&]
 		{
 			return engine.f_module((*a_code.v_module)->v_path.parent_path(), location->f_cast<t_symbol>(arguments->v_head)->v_entry->first);
-		}));
+		});
+		a_code.f_import(module);
+		(*a_code.v_module)->v_dependencies.push_back(module);
 		a_location->f_nil_tail(arguments);
-		return engine.f_new<t_quote>(nullptr);
+		return engine.f_node<t_quote>(nullptr);
 	}
 } v_import;
 
@@ -207,6 +345,26 @@ struct : t_static
 				a_emit(e_instruction__PUSH, a_stack + 1)(static_cast<t_object*>(nullptr));
 			label1.v_target = a_emit.v_code->v_instructions.size();
 		}
+		virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass)
+		{
+			auto& engine = a_code.v_engine;
+			auto thiz = engine.f_pointer(this);
+			auto condition = v_condition->f_optimize(a_code, a_pass);
+			thiz->v_condition = condition;
+			auto then = thiz->v_then->f_optimize(a_code, a_pass);
+			thiz->v_then = then;
+			if (thiz->v_else) {
+				auto elsee = thiz->v_else->f_optimize(a_code, a_pass);
+				thiz->v_else = elsee;
+			}
+			return a_pass.v_rewrite(a_code, thiz);
+		}
+		virtual void f_dump(const t_dump& a_dump) const
+		{
+			a_dump << L"(if "sv << v_condition << L" "sv << v_then;
+			if (v_else) a_dump << L" "sv << v_else;
+			a_dump << L")"sv;
+		}
 	};
 
 	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
@@ -216,11 +374,11 @@ struct : t_static
 		auto condition = engine.f_pointer(a_code.f_render(arguments->v_head, a_location->f_at_head(arguments)));
 		arguments = a_location->f_cast_tail<t_pair>(arguments);
 		auto then = engine.f_pointer(a_code.f_render(arguments->v_head, a_location->f_at_head(arguments)));
-		if (!arguments->v_tail) return engine.f_new<t_instance>(condition, then, nullptr);
+		if (!arguments->v_tail) return engine.f_node<t_instance>(condition, then, nullptr);
 		arguments = a_location->f_cast_tail<t_pair>(arguments);
 		auto elsee = engine.f_pointer(a_code.f_render(arguments->v_head, a_location->f_at_head(arguments)));
 		a_location->f_nil_tail(arguments);
-		return engine.f_new<t_instance>(condition, then, elsee);
+		return engine.f_node<t_instance>(condition, then, elsee);
 	}
 } v_if;
 
@@ -229,8 +387,7 @@ inline void f_try(t_engine& a_engine, size_t a_arguments, T a_do)
 {
 	auto used = a_engine.v_used - a_arguments;
 	try {
-		a_do(used);
-		a_engine.v_used = used;
+		a_engine.v_used = a_do(used) ? used : used - 1;
 	} catch (...) {
 		a_engine.v_used = used - 1;
 		throw;
@@ -243,85 +400,1453 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments != 2) throw t_error{L"requires OBJECT OBJECT"s};
-			a_xs[-1] = a_xs[0] == a_xs[1] ? this : nullptr;
-		});
-	}
-} v_eq;
+			if (a_arguments != 2) return a_engine.f_fail(L"requires OBJECT OBJECT"sv);
+			a_xs[-1] = a_xs[0] == a_xs[1] ? this : nullptr;
+			return true;
+		});
+	}
+} v_eq;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_pair>(a_xs[0]);
+			return true;
+		});
+	}
+} v_is_pair;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires OBJECT OBJECT"sv);
+			a_xs[-1] = a_engine.f_new<t_pair>(a_xs[0], a_xs[1]);
+			return true;
+		});
+	}
+} v_cons;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires PAIR"sv);
+			auto pair = f_as<t_pair>(a_xs[0]);
+			if (!pair) return a_engine.f_fail_cast<t_pair>();
+			a_xs[-1] = pair->v_head;
+			return true;
+		});
+	}
+} v_car;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires PAIR"sv);
+			auto pair = f_as<t_pair>(a_xs[0]);
+			if (!pair) return a_engine.f_fail_cast<t_pair>();
+			a_xs[-1] = pair->v_tail;
+			return true;
+		});
+	}
+} v_cdr;
+
+// A builtin on numbers, a call to which with two arguments is compiled to v_instruction.
+struct t_operator : t_static
+{
+	t_instruction v_instruction;
+
+	t_operator(t_instruction a_instruction) : v_instruction(a_instruction)
+	{
+	}
+};
+
+// Folds the arguments from the left.
+// A single argument is passed to v_single if any, or is folded into v_identity otherwise.
+struct t_arithmetic : t_operator
+{
+	bool (*v_do)(t_engine&, t_object*, t_object*, t_object*&);
+	t_object* v_identity;
+	size_t v_minimum;
+	size_t v_maximum;
+	std::wstring_view v_usage;
+	bool (*v_single)(t_engine&, t_object*, t_object*&);
+
+	t_arithmetic(t_instruction a_instruction, bool (*a_do)(t_engine&, t_object*, t_object*, t_object*&), intptr_t a_identity, size_t a_minimum, size_t a_maximum, std::wstring_view a_usage, bool (*a_single)(t_engine&, t_object*, t_object*&) = nullptr) : t_operator(a_instruction), v_do(a_do), v_identity(f_fixnum(a_identity)), v_minimum(a_minimum), v_maximum(a_maximum), v_usage(a_usage), v_single(a_single)
+	{
+	}
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < v_minimum || a_arguments > v_maximum) return a_engine.f_fail(v_usage);
+			if (a_arguments == 1 && v_single) return v_single(a_engine, a_xs[0], a_xs[-1]);
+			// Accumulates in the result slot which is reachable from the collector as floats may be allocated.
+			a_xs[-1] = a_arguments > 1 ? a_xs[0] : v_identity;
+			for (size_t i = a_arguments > 1 ? 1 : 0; i < a_arguments; ++i) if (!v_do(a_engine, a_xs[-1], a_xs[i], a_xs[-1])) return false;
+			return true;
+		});
+	}
+};
+
+t_arithmetic v_add{e_instruction__ADD, f_add, 0, 0, SIZE_MAX, L"requires NUMBER*"sv, [](t_engine& a_engine, t_object* a_x, t_object*& a_z)
+{
+	if (!f_number(a_engine, a_x)) return false;
+	a_z = a_x;
+	return true;
+}};
+t_arithmetic v_subtract{e_instruction__SUBTRACT, f_subtract, 0, 1, SIZE_MAX, L"requires NUMBER+"sv, f_negate};
+t_arithmetic v_multiply{e_instruction__MULTIPLY, f_multiply, 1, 0, SIZE_MAX, L"requires NUMBER*"sv};
+t_arithmetic v_divide{e_instruction__DIVIDE, f_divide, 1, 1, SIZE_MAX, L"requires NUMBER+"sv};
+t_arithmetic v_quotient{e_instruction__QUOTIENT, f_quotient, 0, 2, 2, L"requires INTEGER INTEGER"sv};
+t_arithmetic v_remainder{e_instruction__REMAINDER, f_remainder, 0, 2, 2, L"requires INTEGER INTEGER"sv};
+t_arithmetic v_modulo{e_instruction__MODULO, f_modulo, 0, 2, 2, L"requires INTEGER INTEGER"sv};
+
+// Returns itself if each argument is in order with the next one.
+struct t_comparison : t_operator
+{
+	bool (*v_do)(t_engine&, t_object*, t_object*, bool&);
+
+	t_comparison(t_instruction a_instruction, bool (*a_do)(t_engine&, t_object*, t_object*, bool&)) : t_operator(a_instruction), v_do(a_do)
+	{
+	}
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 1) return a_engine.f_fail(L"requires NUMBER+"sv);
+			if (!f_number(a_engine, a_xs[0])) return false;
+			auto z = true;
+			for (size_t i = 1; i < a_arguments; ++i) {
+				bool y;
+				if (!v_do(a_engine, a_xs[i - 1], a_xs[i], y)) return false;
+				z = z && y;
+			}
+			a_xs[-1] = z ? this : nullptr;
+			return true;
+		});
+	}
+};
+
+t_comparison v_equals{e_instruction__EQUALS, f_compare<std::equal_to<>>};
+t_comparison v_less{e_instruction__LESS, f_compare<std::less<>>};
+t_comparison v_less_equal{e_instruction__LESS_EQUAL, f_compare<std::less_equal<>>};
+t_comparison v_greater{e_instruction__GREATER, f_compare<std::greater<>>};
+t_comparison v_greater_equal{e_instruction__GREATER_EQUAL, f_compare<std::greater_equal<>>};
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_is_integer(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_integer;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_is_float(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_float;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires NUMBER"sv);
+			double x;
+			if (!f_double(a_engine, a_xs[0], x)) return false;
+			a_xs[-1] = f_float(a_engine, x);
+			return true;
+		});
+	}
+} v_inexact;
+
+// Truncates toward zero.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires NUMBER"sv);
+			double x;
+			if (!f_double(a_engine, a_xs[0], x)) return false;
+			if (f_is_integer(a_xs[0])) {
+				a_xs[-1] = a_xs[0];
+				return true;
+			}
+			if (!std::isfinite(x)) return a_engine.f_fail(L"must be finite"sv);
+			a_xs[-1] = t_integer::f_from(x).f_object(a_engine);
+			return true;
+		});
+	}
+} v_exact;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_string>(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_string;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires STRING"sv);
+			auto s = f_as<t_string>(a_xs[0]);
+			if (!s) return a_engine.f_fail_cast<t_string>();
+			a_xs[-1] = f_fixnum(s->v_size);
+			return true;
+		});
+	}
+} v_string_length;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires STRING INTEGER"sv);
+			auto s = f_as<t_string>(a_xs[0]);
+			if (!s) return a_engine.f_fail_cast<t_string>();
+			if (!f_index(a_engine, a_xs[1], s->v_size)) return false;
+			auto i = f_fixnum_value(a_xs[1]);
+			if (static_cast<size_t>(i) >= s->v_size) return a_engine.f_fail(L"out of range"sv);
+			a_xs[-1] = f_fixnum(static_cast<uint8_t>(s->f_data()[i]));
+			return true;
+		});
+	}
+} v_string_byte;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			size_t n = 0;
+			for (size_t i = 0; i < a_arguments; ++i) {
+				auto s = f_as<t_string>(a_xs[i]);
+				if (!s) return a_engine.f_fail_cast<t_string>();
+				n += s->v_size;
+			}
+			auto p = t_string::f_new(a_engine, n);
+			// The arguments may have been moved by the allocation.
+			auto q = p->f_data();
+			for (size_t i = 0; i < a_arguments; ++i) {
+				auto s = static_cast<t_string*>(a_xs[i])->f_view();
+				q = std::copy(s.begin(), s.end(), q);
+			}
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_string_append;
+
+// Offsets are in bytes.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 2 || a_arguments > 3) return a_engine.f_fail(L"requires STRING INTEGER [INTEGER]"sv);
+			auto s = f_as<t_string>(a_xs[0]);
+			if (!s) return a_engine.f_fail_cast<t_string>();
+			if (!f_index(a_engine, a_xs[1], s->v_size)) return false;
+			size_t i = f_fixnum_value(a_xs[1]);
+			size_t j = s->v_size;
+			if (a_arguments > 2) {
+				if (!f_index(a_engine, a_xs[2], s->v_size)) return false;
+				j = f_fixnum_value(a_xs[2]);
+				if (j < i) return a_engine.f_fail(L"out of range"sv);
+			}
+			auto p = t_string::f_new(a_engine, j - i);
+			auto v = static_cast<t_string*>(a_xs[0])->f_view().substr(i, j - i);
+			std::copy(v.begin(), v.end(), p->f_data());
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_substring;
+
+// Finds the first occurrence of a pattern with std::string_view::find, which scans for its first byte by memchr.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 2 || a_arguments > 3) return a_engine.f_fail(L"requires STRING STRING [INTEGER]"sv);
+			auto s = f_as<t_string>(a_xs[0]);
+			auto pattern = f_as<t_string>(a_xs[1]);
+			if (!s || !pattern) return a_engine.f_fail_cast<t_string>();
+			size_t i = 0;
+			if (a_arguments > 2) {
+				if (!f_index(a_engine, a_xs[2], s->v_size)) return false;
+				i = f_fixnum_value(a_xs[2]);
+			}
+			i = s->f_view().find(pattern->f_view(), i);
+			a_xs[-1] = i == std::string_view::npos ? nullptr : f_fixnum(i);
+			return true;
+		});
+	}
+} v_string_search;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires STRING STRING"sv);
+			auto x = f_as<t_string>(a_xs[0]);
+			auto y = f_as<t_string>(a_xs[1]);
+			if (!x || !y) return a_engine.f_fail_cast<t_string>();
+			a_xs[-1] = x->f_view() == y->f_view() ? this : nullptr;
+			return true;
+		});
+	}
+} v_string_equals;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_vector>(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_vector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 1 || a_arguments > 2) return a_engine.f_fail(L"requires INTEGER [OBJECT]"sv);
+			if (!f_index(a_engine, a_xs[0], c_FIXNUM_MAX / sizeof(t_object*))) return false;
+			auto p = t_vector::f_new(a_engine, f_fixnum_value(a_xs[0]));
+			if (a_arguments > 1) std::fill_n(p->f_elements(), p->v_size, a_xs[1]);
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_make_vector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			auto p = t_vector::f_new(a_engine, a_arguments);
+			std::copy_n(a_xs, a_arguments, p->f_elements());
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_vector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires VECTOR"sv);
+			auto p = f_as<t_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_vector>();
+			a_xs[-1] = f_fixnum(p->v_size);
+			return true;
+		});
+	}
+} v_vector_length;
+
+// Whether a_x is an index of an element of a_vector.
+bool f_element(t_engine& a_engine, t_vector* a_vector, t_object* a_x)
+{
+	if (!f_index(a_engine, a_x, a_vector->v_size)) return false;
+	return static_cast<size_t>(f_fixnum_value(a_x)) < a_vector->v_size || a_engine.f_fail(L"out of range"sv);
+}
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires VECTOR INTEGER"sv);
+			auto p = f_as<t_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_vector>();
+			if (!f_element(a_engine, p, a_xs[1])) return false;
+			a_xs[-1] = p->f_elements()[f_fixnum_value(a_xs[1])];
+			return true;
+		});
+	}
+} v_vector_ref;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires VECTOR INTEGER OBJECT"sv);
+			auto p = f_as<t_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_vector>();
+			if (!f_element(a_engine, p, a_xs[1])) return false;
+			a_xs[-1] = p->f_elements()[f_fixnum_value(a_xs[1])] = a_xs[2];
+			return true;
+		});
+	}
+} v_vector_set;
+
+// Reads optional [start [end]] from a_xs into a_start and a_end within a_size.
+bool f_range(t_engine& a_engine, t_object** a_xs, size_t a_arguments, size_t a_size, size_t& a_start, size_t& a_end)
+{
+	a_start = 0;
+	a_end = a_size;
+	if (a_arguments > 0) {
+		if (!f_index(a_engine, a_xs[0], a_size)) return false;
+		a_start = f_fixnum_value(a_xs[0]);
+	}
+	if (a_arguments > 1) {
+		if (!f_index(a_engine, a_xs[1], a_size)) return false;
+		a_end = f_fixnum_value(a_xs[1]);
+	}
+	return a_start <= a_end || a_engine.f_fail(L"out of range"sv);
+}
+
+// Fills with std::fill, which the compiler vectorizes for pointers.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 2 || a_arguments > 4) return a_engine.f_fail(L"requires VECTOR OBJECT [INTEGER [INTEGER]]"sv);
+			auto p = f_as<t_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_vector>();
+			size_t i;
+			size_t j;
+			if (!f_range(a_engine, a_xs + 2, a_arguments - 2, p->v_size, i, j)) return false;
+			std::fill(p->f_elements() + i, p->f_elements() + j, a_xs[1]);
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_vector_fill;
+
+// Copies with std::copy, which is memmove for pointers and works for overlapping ranges in the same vector.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 3 || a_arguments > 5) return a_engine.f_fail(L"requires VECTOR INTEGER VECTOR [INTEGER [INTEGER]]"sv);
+			auto to = f_as<t_vector>(a_xs[0]);
+			auto from = f_as<t_vector>(a_xs[2]);
+			if (!to || !from) return a_engine.f_fail_cast<t_vector>();
+			if (!f_index(a_engine, a_xs[1], to->v_size)) return false;
+			size_t at = f_fixnum_value(a_xs[1]);
+			size_t i;
+			size_t j;
+			if (!f_range(a_engine, a_xs + 3, a_arguments - 3, from->v_size, i, j)) return false;
+			if (j - i > to->v_size - at) return a_engine.f_fail(L"out of range"sv);
+			std::copy(from->f_elements() + i, from->f_elements() + j, to->f_elements() + at);
+			a_xs[-1] = to;
+			return true;
+		});
+	}
+} v_vector_copy;
+
+// Compares with std::equal, which is memcmp for pointers.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires VECTOR VECTOR"sv);
+			auto x = f_as<t_vector>(a_xs[0]);
+			auto y = f_as<t_vector>(a_xs[1]);
+			if (!x || !y) return a_engine.f_fail_cast<t_vector>();
+			a_xs[-1] = std::equal(x->f_elements(), x->f_elements() + x->v_size, y->f_elements(), y->f_elements() + y->v_size) ? this : nullptr;
+			return true;
+		});
+	}
+} v_vector_eq;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments > 1) return a_engine.f_fail(L"requires [OBJECT]"sv);
+			a_xs[-1] = a_engine.f_new<t_hash_table>(a_arguments > 0 && a_xs[0]);
+			return true;
+		});
+	}
+} v_make_hash_table;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_hash_table>(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_hash_table;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 2 || a_arguments > 3) return a_engine.f_fail(L"requires HASH-TABLE OBJECT [OBJECT]"sv);
+			auto p = f_as<t_hash_table>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_hash_table>();
+			auto entry = p->f_find(a_engine, a_xs[1]);
+			a_xs[-1] = entry ? entry->v_value : a_arguments > 2 ? a_xs[2] : nullptr;
+			return true;
+		});
+	}
+} v_hash_table_ref;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires HASH-TABLE OBJECT OBJECT"sv);
+			auto p = f_as<t_hash_table>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_hash_table>();
+			p->f_put(a_engine, a_xs[1], a_xs[2]);
+			a_xs[-1] = a_xs[2];
+			return true;
+		});
+	}
+} v_hash_table_set;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires HASH-TABLE OBJECT"sv);
+			auto p = f_as<t_hash_table>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_hash_table>();
+			a_xs[-1] = p->f_remove(a_engine, a_xs[1]) ? this : nullptr;
+			return true;
+		});
+	}
+} v_hash_table_delete;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires HASH-TABLE"sv);
+			auto p = f_as<t_hash_table>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_hash_table>();
+			a_xs[-1] = f_fixnum(p->v_size);
+			return true;
+		});
+	}
+} v_hash_table_count;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_bytevector>(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_bytevector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 1 || a_arguments > 2) return a_engine.f_fail(L"requires INTEGER [INTEGER]"sv);
+			if (!f_index(a_engine, a_xs[0], c_FIXNUM_MAX)) return false;
+			if (a_arguments > 1 && !f_index(a_engine, a_xs[1], 255)) return false;
+			auto p = t_bytevector::f_new(a_engine, f_fixnum_value(a_xs[0]));
+			if (a_arguments > 1) std::fill_n(p->f_data(), p->v_size, f_fixnum_value(a_xs[1]));
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_make_bytevector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires STRING"sv);
+			auto s = f_as<t_string>(a_xs[0]);
+			if (!s) return a_engine.f_fail_cast<t_string>();
+			auto p = t_bytevector::f_map(a_engine, std::string(s->f_view()));
+			if (!p) return a_engine.f_fail(L"unable to map"sv);
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_map_file;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires BYTEVECTOR"sv);
+			auto p = f_as<t_bytevector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_bytevector>();
+			a_xs[-1] = f_fixnum(p->v_size);
+			return true;
+		});
+	}
+} v_bytevector_length;
+
+// Whether a_x is an index of a_size bytes in a_bytevector.
+bool f_bytes(t_engine& a_engine, t_bytevector* a_bytevector, t_object* a_x, size_t a_size)
+{
+	if (!f_index(a_engine, a_x, a_bytevector->v_size)) return false;
+	return a_bytevector->v_size - f_fixnum_value(a_x) >= a_size || a_engine.f_fail(L"out of range"sv);
+}
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires BYTEVECTOR INTEGER"sv);
+			auto p = f_as<t_bytevector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_bytevector>();
+			if (!f_bytes(a_engine, p, a_xs[1], 1)) return false;
+			a_xs[-1] = f_fixnum(p->f_data()[f_fixnum_value(a_xs[1])]);
+			return true;
+		});
+	}
+} v_bytevector_u8_ref;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires BYTEVECTOR INTEGER INTEGER"sv);
+			auto p = f_as<t_bytevector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_bytevector>();
+			if (p->v_mapped) return a_engine.f_fail(L"read only"sv);
+			if (!f_bytes(a_engine, p, a_xs[1], 1) || !f_index(a_engine, a_xs[2], 255)) return false;
+			p->f_data()[f_fixnum_value(a_xs[1])] = f_fixnum_value(a_xs[2]);
+			a_xs[-1] = a_xs[2];
+			return true;
+		});
+	}
+} v_bytevector_u8_set;
+
+// Loads a T from the bytes at an index in little endian, or in big endian if the last argument is given other than nil.
+template<typename T>
+struct t_bytevector_ref : t_static
+{
+	using t_bits = std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 2 || a_arguments > 3) return a_engine.f_fail(L"requires BYTEVECTOR INTEGER [OBJECT]"sv);
+			auto p = f_as<t_bytevector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_bytevector>();
+			if (!f_bytes(a_engine, p, a_xs[1], sizeof(T))) return false;
+			auto bytes = p->f_data() + f_fixnum_value(a_xs[1]);
+			auto big = a_arguments > 2 && a_xs[2];
+			t_bits bits = 0;
+			for (size_t i = 0; i < sizeof(T); ++i) bits |= static_cast<t_bits>(bytes[big ? sizeof(T) - 1 - i : i]) << i * 8;
+			auto value = std::bit_cast<T>(bits);
+			if constexpr (std::is_floating_point_v<T>) {
+				a_xs[-1] = f_float(a_engine, value);
+			} else if (std::cmp_less_equal(value, INTPTR_MAX)) {
+				auto x = static_cast<intptr_t>(value);
+				a_xs[-1] = x >= c_FIXNUM_MIN && x <= c_FIXNUM_MAX ? f_fixnum(x) : t_integer(x).f_object(a_engine);
+			} else {
+				t_integer x;
+				x.v_digits = {static_cast<uint32_t>(bits), static_cast<uint32_t>(static_cast<uint64_t>(bits) >> 32)};
+				a_xs[-1] = x.f_object(a_engine);
+			}
+			return true;
+		});
+	}
+};
+
+t_bytevector_ref<uint16_t> v_bytevector_u16_ref;
+t_bytevector_ref<int16_t> v_bytevector_s16_ref;
+t_bytevector_ref<uint32_t> v_bytevector_u32_ref;
+t_bytevector_ref<int32_t> v_bytevector_s32_ref;
+t_bytevector_ref<uint64_t> v_bytevector_u64_ref;
+t_bytevector_ref<int64_t> v_bytevector_s64_ref;
+t_bytevector_ref<float> v_bytevector_f32_ref;
+t_bytevector_ref<double> v_bytevector_f64_ref;
+
+bool f_key(t_engine& a_engine, t_object* a_x, uint32_t& a_hash)
+{
+	return f_hash(a_x, a_hash) || a_engine.f_fail(L"not hashable"sv);
+}
+
+// Reads either a persistent map or a transient one.
+bool f_map(t_engine& a_engine, t_object* a_x, size_t& a_count, t_map_node*& a_root)
+{
+	if (auto p = f_as<t_persistent_map>(a_x)) {
+		a_count = p->v_count;
+		a_root = p->v_root;
+		return true;
+	}
+	if (auto p = f_as<t_transient_map>(a_x)) {
+		a_count = p->v_count;
+		a_root = p->v_root;
+		return true;
+	}
+	return a_engine.f_fail_cast<t_persistent_map>();
+}
+
+// Reads either a persistent vector or a transient one.
+const t_vector_trie* f_vector_trie(t_engine& a_engine, t_object* a_x)
+{
+	if (auto p = f_as<t_persistent_vector>(a_x)) return &p->v_trie;
+	if (auto p = f_as<t_transient_vector>(a_x)) return &p->v_trie;
+	a_engine.f_fail_cast<t_persistent_vector>();
+	return nullptr;
+}
+
+// Whether a_x is an index of a value of a_trie.
+bool f_element(t_engine& a_engine, const t_vector_trie* a_trie, t_object* a_x)
+{
+	if (!f_index(a_engine, a_x, a_trie->v_size)) return false;
+	return static_cast<size_t>(f_fixnum_value(a_x)) < a_trie->v_size || a_engine.f_fail(L"out of range"sv);
+}
+
+// Returns a_x if it is a transient of T still to be updated.
+template<typename T>
+T* f_transient(t_engine& a_engine, t_object* a_x)
+{
+	auto p = f_as<T>(a_x);
+	if (!p)
+		a_engine.f_fail_cast<T>();
+	else if (!p->v_edit)
+		a_engine.f_fail(L"already persistent"sv);
+	return p && p->v_edit ? p : nullptr;
+}
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments % 2 != 0) return a_engine.f_fail(L"requires (OBJECT OBJECT)*"sv);
+			// Built in place as a transient never exposed.
+			auto edit = ++a_engine.v_edits;
+			auto root = a_engine.f_pointer<t_map_node>(nullptr);
+			size_t count = 0;
+			for (size_t i = 0; i < a_arguments; i += 2) {
+				uint32_t hash;
+				if (!f_key(a_engine, a_xs[i], hash)) return false;
+				bool added = false;
+				root = f_map_put(a_engine, root, 0, hash, a_xs + i, edit, added);
+				if (added) ++count;
+			}
+			a_xs[-1] = a_engine.f_new<t_persistent_map>(count, root);
+			return true;
+		});
+	}
+} v_persistent_map;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_persistent_map>(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_persistent_map;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments < 2 || a_arguments > 3) return a_engine.f_fail(L"requires PERSISTENT-MAP OBJECT [OBJECT]"sv);
+			size_t count;
+			t_map_node* root;
+			uint32_t hash;
+			if (!f_map(a_engine, a_xs[0], count, root) || !f_key(a_engine, a_xs[1], hash)) return false;
+			auto value = f_map_find(root, hash, a_xs[1]);
+			a_xs[-1] = value ? *value : a_arguments > 2 ? a_xs[2] : nullptr;
+			return true;
+		});
+	}
+} v_persistent_map_ref;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires PERSISTENT-MAP OBJECT OBJECT"sv);
+			auto p = f_as<t_persistent_map>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_persistent_map>();
+			uint32_t hash;
+			if (!f_key(a_engine, a_xs[1], hash)) return false;
+			bool added = false;
+			auto root = f_map_put(a_engine, p->v_root, 0, hash, a_xs + 1, 0, added);
+			p = static_cast<t_persistent_map*>(a_xs[0]);
+			a_xs[-1] = root == p->v_root ? p : a_engine.f_new<t_persistent_map>(p->v_count + (added ? 1 : 0), a_engine.f_pointer(root));
+			return true;
+		});
+	}
+} v_persistent_map_set;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires PERSISTENT-MAP OBJECT"sv);
+			auto p = f_as<t_persistent_map>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_persistent_map>();
+			uint32_t hash;
+			if (!f_key(a_engine, a_xs[1], hash)) return false;
+			bool removed = false;
+			auto root = f_map_remove(a_engine, p->v_root, 0, hash, a_xs + 1, 0, removed);
+			p = static_cast<t_persistent_map*>(a_xs[0]);
+			a_xs[-1] = removed ? a_engine.f_new<t_persistent_map>(p->v_count - 1, a_engine.f_pointer(root)) : p;
+			return true;
+		});
+	}
+} v_persistent_map_delete;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires PERSISTENT-MAP"sv);
+			size_t count;
+			t_map_node* root;
+			if (!f_map(a_engine, a_xs[0], count, root)) return false;
+			a_xs[-1] = f_fixnum(count);
+			return true;
+		});
+	}
+} v_persistent_map_count;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			auto edit = ++a_engine.v_edits;
+			t_vector_root trie(a_engine, {});
+			for (size_t i = 0; i < a_arguments; ++i) trie.f_push(a_engine, a_xs + i, edit);
+			a_xs[-1] = a_engine.f_new<t_persistent_vector>(trie);
+			return true;
+		});
+	}
+} v_persistent_vector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_as<t_persistent_vector>(a_xs[0]) ? a_xs[0] : nullptr;
+			return true;
+		});
+	}
+} v_is_persistent_vector;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires PERSISTENT-VECTOR"sv);
+			auto trie = f_vector_trie(a_engine, a_xs[0]);
+			if (!trie) return false;
+			a_xs[-1] = f_fixnum(trie->v_size);
+			return true;
+		});
+	}
+} v_persistent_vector_length;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires PERSISTENT-VECTOR INTEGER"sv);
+			auto trie = f_vector_trie(a_engine, a_xs[0]);
+			if (!trie || !f_element(a_engine, trie, a_xs[1])) return false;
+			a_xs[-1] = trie->f_get(f_fixnum_value(a_xs[1]));
+			return true;
+		});
+	}
+} v_persistent_vector_ref;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires PERSISTENT-VECTOR INTEGER OBJECT"sv);
+			auto p = f_as<t_persistent_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_persistent_vector>();
+			if (!f_element(a_engine, &p->v_trie, a_xs[1])) return false;
+			t_vector_root trie(a_engine, p->v_trie);
+			trie.f_set(a_engine, f_fixnum_value(a_xs[1]), a_xs + 2, 0);
+			a_xs[-1] = a_engine.f_new<t_persistent_vector>(trie);
+			return true;
+		});
+	}
+} v_persistent_vector_set;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires PERSISTENT-VECTOR OBJECT"sv);
+			auto p = f_as<t_persistent_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_persistent_vector>();
+			t_vector_root trie(a_engine, p->v_trie);
+			trie.f_push(a_engine, a_xs + 1, 0);
+			a_xs[-1] = a_engine.f_new<t_persistent_vector>(trie);
+			return true;
+		});
+	}
+} v_persistent_vector_push;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires PERSISTENT-MAP or PERSISTENT-VECTOR"sv);
+			if (auto p = f_as<t_persistent_map>(a_xs[0])) {
+				size_t count = p->v_count;
+				a_xs[-1] = a_engine.f_new<t_transient_map>(count, a_engine.f_pointer(p->v_root), ++a_engine.v_edits);
+				return true;
+			}
+			auto p = f_as<t_persistent_vector>(a_xs[0]);
+			if (!p) return a_engine.f_fail_cast<t_persistent_map>();
+			t_vector_root trie(a_engine, p->v_trie);
+			a_xs[-1] = a_engine.f_new<t_transient_vector>(trie, ++a_engine.v_edits);
+			return true;
+		});
+	}
+} v_transient;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires TRANSIENT"sv);
+			if (auto p = f_as<t_transient_vector>(a_xs[0])) {
+				if (!p->v_edit) return a_engine.f_fail(L"already persistent"sv);
+				t_vector_root trie(a_engine, p->v_trie);
+				a_xs[-1] = a_engine.f_new<t_persistent_vector>(trie);
+				static_cast<t_transient_vector*>(a_xs[0])->v_edit = 0;
+				return true;
+			}
+			auto p = f_transient<t_transient_map>(a_engine, a_xs[0]);
+			if (!p) return false;
+			size_t count = p->v_count;
+			a_xs[-1] = a_engine.f_new<t_persistent_map>(count, a_engine.f_pointer(p->v_root));
+			static_cast<t_transient_map*>(a_xs[0])->v_edit = 0;
+			return true;
+		});
+	}
+} v_persistent;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires TRANSIENT-MAP OBJECT OBJECT"sv);
+			auto p = f_transient<t_transient_map>(a_engine, a_xs[0]);
+			uint32_t hash;
+			if (!p || !f_key(a_engine, a_xs[1], hash)) return false;
+			bool added = false;
+			auto root = f_map_put(a_engine, p->v_root, 0, hash, a_xs + 1, p->v_edit, added);
+			p = static_cast<t_transient_map*>(a_xs[0]);
+			p->v_root = root;
+			if (added) ++p->v_count;
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_transient_map_set;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires TRANSIENT-MAP OBJECT"sv);
+			auto p = f_transient<t_transient_map>(a_engine, a_xs[0]);
+			uint32_t hash;
+			if (!p || !f_key(a_engine, a_xs[1], hash)) return false;
+			bool removed = false;
+			auto root = f_map_remove(a_engine, p->v_root, 0, hash, a_xs + 1, p->v_edit, removed);
+			p = static_cast<t_transient_map*>(a_xs[0]);
+			p->v_root = root;
+			if (removed) --p->v_count;
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_transient_map_delete;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 3) return a_engine.f_fail(L"requires TRANSIENT-VECTOR INTEGER OBJECT"sv);
+			auto p = f_transient<t_transient_vector>(a_engine, a_xs[0]);
+			if (!p || !f_element(a_engine, &p->v_trie, a_xs[1])) return false;
+			t_vector_root trie(a_engine, p->v_trie);
+			trie.f_set(a_engine, f_fixnum_value(a_xs[1]), a_xs + 2, p->v_edit);
+			p = static_cast<t_transient_vector*>(a_xs[0]);
+			p->v_trie = trie;
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_transient_vector_set;
+
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 2) return a_engine.f_fail(L"requires TRANSIENT-VECTOR OBJECT"sv);
+			auto p = f_transient<t_transient_vector>(a_engine, a_xs[0]);
+			if (!p) return false;
+			t_vector_root trie(a_engine, p->v_trie);
+			trie.f_push(a_engine, a_xs + 1, p->v_edit);
+			p = static_cast<t_transient_vector*>(a_xs[0]);
+			p->v_trie = trie;
+			a_xs[-1] = p;
+			return true;
+		});
+	}
+} v_transient_vector_push;
+
+namespace list
+{
+	// Counts the pairs of a_list, or fails if it is not a list.
+	bool f_length(t_engine& a_engine, t_object* a_list, size_t& a_n)
+	{
+		a_n = 0;
+		for (; a_list; ++a_n) {
+			auto p = f_as<t_pair>(a_list);
+			if (!p) return a_engine.f_fail_cast<t_pair>();
+			a_list = p->v_tail;
+		}
+		return true;
+	}
+	// Allocates the pairs of the reversed list of a_n values at once, in the order of the result.
+	t_object* f_reverse(t_engine& a_engine, t_object* a_list, size_t a_n)
+	{
+		if (a_n <= 0) return nullptr;
+		auto list = a_engine.f_pointer(a_list);
+		auto size = std::max(sizeof(t_pair), sizeof(gc::t_collector::t_forward));
+		auto p = a_engine.f_allocate(size * a_n);
+		t_object* reversed = nullptr;
+		for (auto q = static_cast<t_pair*>(list.v_value); q; q = static_cast<t_pair*>(q->v_tail)) reversed = new(p + size * --a_n) t_pair(q->v_head, reversed);
+		return reversed;
+	}
+
+	// Calls back a procedure for each element of a list without nesting native calls.
+	// The state, which is the procedure, the rest of the list, and an accumulator, is kept on the stack above this.
+	// A frame of v_code is pushed for each call, and passes the state and the result of the call to this.
+	struct t_iteration : t_static
+	{
+		inline static void* v_code[] = {
+			reinterpret_cast<void*>(e_instruction__CALL_TAIL),
+			reinterpret_cast<void*>(4)
+		};
+
+		size_t v_arguments;
+
+		t_iteration(size_t a_arguments) : v_arguments(a_arguments)
+		{
+		}
+		// Updates the accumulator a_xs[2] with the result a_xs[3] of the call for the head of a_xs[1].
+		virtual void f_accumulate(t_engine& a_engine, t_object** a_xs) = 0;
+		virtual t_object* f_result(t_engine& a_engine, t_object* a_accumulator) = 0;
+		// Called with the state at a_xs and a_engine.v_used right above it.
+		void f_next(t_engine& a_engine, t_object** a_xs)
+		{
+			try {
+				if (!a_xs[1]) {
+					a_xs[-1] = f_result(a_engine, a_xs[2]);
+					a_engine.v_used = a_xs;
+					return;
+				}
+				auto pair = f_as<t_pair>(a_xs[1]);
+				if (!pair) {
+					a_engine.v_used = a_xs - 1;
+					return void(a_engine.f_fail_cast<t_pair>());
+				}
+				auto used = a_xs + 3;
+				if (used + 3 >= a_engine.v_stack_tail) a_engine.f_grow_stack(used + 4);
+				if (a_engine.v_frame <= a_engine.v_frames_head) a_engine.f_grow_frames(a_engine.v_frame - 1);
+				a_xs[-1] = this;
+				--a_engine.v_frame;
+				a_engine.v_frame->v_stack = a_xs - 1;
+				a_engine.v_frame->v_code = nullptr;
+				a_engine.v_frame->v_current = v_code;
+				a_engine.v_frame->v_scope = nullptr;
+				used[0] = a_xs[0];
+				used[1] = pair->v_head;
+				used[2] = a_xs[2];
+				a_engine.v_used = used + 1 + v_arguments;
+				a_engine.f_call(used[0], v_arguments);
+			} catch (...) {
+				a_engine.v_used = a_xs - 1;
+				throw;
+			}
+		}
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		{
+			auto xs = a_engine.v_used - 4;
+			try {
+				f_accumulate(a_engine, xs);
+			} catch (...) {
+				a_engine.v_used = xs - 1;
+				throw;
+			}
+			xs[1] = static_cast<t_pair*>(xs[1])->v_tail;
+			a_engine.v_used = xs + 3;
+			f_next(a_engine, xs);
+		}
+		// Starts with the procedure a_xs[0] and the list a_xs[1] to be called back with a_arguments.
+		void f_start(t_engine& a_engine, t_object** a_xs, t_object* a_accumulator)
+		{
+			if (a_xs + 3 >= a_engine.v_stack_tail)
+				try {
+					a_engine.f_grow_stack(a_xs + 4);
+				} catch (...) {
+					a_engine.v_used = a_xs - 1;
+					throw;
+				}
+			a_xs[2] = a_accumulator;
+			a_engine.v_used = a_xs + 3;
+			f_next(a_engine, a_xs);
+		}
+	};
+
+	struct : t_iteration
+	{
+		using t_iteration::t_iteration;
+		virtual void f_accumulate(t_engine& a_engine, t_object** a_xs)
+		{
+			a_xs[2] = a_engine.f_new<t_pair>(a_xs[3], a_xs[2]);
+		}
+		virtual t_object* f_result(t_engine& a_engine, t_object* a_accumulator)
+		{
+			size_t n = 0;
+			for (auto p = a_accumulator; p; p = static_cast<t_pair*>(p)->v_tail) ++n;
+			return f_reverse(a_engine, a_accumulator, n);
+		}
+	} v_map_step{1};
+
+	struct : t_iteration
+	{
+		using t_iteration::t_iteration;
+		virtual void f_accumulate(t_engine& a_engine, t_object** a_xs)
+		{
+			if (!a_xs[3]) return;
+			a_xs[3] = static_cast<t_pair*>(a_xs[1])->v_head;
+			a_xs[2] = a_engine.f_new<t_pair>(a_xs[3], a_xs[2]);
+		}
+		virtual t_object* f_result(t_engine& a_engine, t_object* a_accumulator)
+		{
+			size_t n = 0;
+			for (auto p = a_accumulator; p; p = static_cast<t_pair*>(p)->v_tail) ++n;
+			return f_reverse(a_engine, a_accumulator, n);
+		}
+	} v_filter_step{1};
+
+	struct : t_iteration
+	{
+		using t_iteration::t_iteration;
+		virtual void f_accumulate(t_engine& a_engine, t_object** a_xs)
+		{
+			a_xs[2] = a_xs[3];
+		}
+		virtual t_object* f_result(t_engine& a_engine, t_object* a_accumulator)
+		{
+			return a_accumulator;
+		}
+	} v_fold_step{2};
+
+	struct : t_static
+	{
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		{
+			auto xs = a_engine.v_used - a_arguments;
+			if (a_arguments != 2) {
+				a_engine.v_used = xs - 1;
+				return void(a_engine.f_fail(L"requires PROCEDURE LIST"sv));
+			}
+			v_map_step.f_start(a_engine, xs, nullptr);
+		}
+	} v_map;
 
-struct : t_static
-{
-	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	struct : t_static
 	{
-		f_try(a_engine, a_arguments, [&](auto a_xs)
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
-			if (a_arguments != 1) throw t_error{L"requires OBJECT"s};
-			a_xs[-1] = dynamic_cast<t_pair*>(a_xs[0]);
-		});
-	}
-} v_is_pair;
+			auto xs = a_engine.v_used - a_arguments;
+			if (a_arguments != 2) {
+				a_engine.v_used = xs - 1;
+				return void(a_engine.f_fail(L"requires PROCEDURE LIST"sv));
+			}
+			v_filter_step.f_start(a_engine, xs, nullptr);
+		}
+	} v_filter;
 
-struct : t_static
-{
-	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	struct : t_static
 	{
-		f_try(a_engine, a_arguments, [&](auto a_xs)
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
-			if (a_arguments != 2) throw t_error{L"requires OBJECT OBJECT"s};
-			a_xs[-1] = a_engine.f_new<t_pair>(a_xs[0], a_xs[1]);
-		});
-	}
-} v_cons;
+			auto xs = a_engine.v_used - a_arguments;
+			if (a_arguments != 3) {
+				a_engine.v_used = xs - 1;
+				return void(a_engine.f_fail(L"requires PROCEDURE OBJECT LIST"sv));
+			}
+			v_fold_step.f_start(a_engine, xs, std::exchange(xs[1], xs[2]));
+		}
+	} v_fold;
 
-struct : t_static
-{
-	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	struct : t_static
 	{
-		f_try(a_engine, a_arguments, [&](auto a_xs)
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
-			if (a_arguments != 1) throw t_error{L"requires PAIR"s};
-			a_xs[-1] = f_cast<t_pair>(a_xs[0])->v_head;
-		});
-	}
-} v_car;
+			f_try(a_engine, a_arguments, [&](auto a_xs)
+			{
+				if (a_arguments != 1) return a_engine.f_fail(L"requires LIST"sv);
+				size_t n;
+				if (!f_length(a_engine, a_xs[0], n)) return false;
+				a_xs[-1] = f_fixnum(n);
+				return true;
+			});
+		}
+	} v_length;
 
-struct : t_static
-{
-	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	struct : t_static
 	{
-		f_try(a_engine, a_arguments, [&](auto a_xs)
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
-			if (a_arguments != 1) throw t_error{L"requires PAIR"s};
-			a_xs[-1] = f_cast<t_pair>(a_xs[0])->v_tail;
-		});
-	}
-} v_cdr;
+			f_try(a_engine, a_arguments, [&](auto a_xs)
+			{
+				if (a_arguments != 1) return a_engine.f_fail(L"requires LIST"sv);
+				size_t n;
+				if (!f_length(a_engine, a_xs[0], n)) return false;
+				a_xs[-1] = f_reverse(a_engine, a_xs[0], n);
+				return true;
+			});
+		}
+	} v_reverse;
 
-struct : t_static
-{
-	struct t_instance : t_symbol
+	struct : t_static
 	{
-		t_instance() : t_symbol({})
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
+			f_try(a_engine, a_arguments, [&](auto a_xs)
+			{
+				if (a_arguments != 2) return a_engine.f_fail(L"requires LIST INTEGER"sv);
+				if (!f_index(a_engine, a_xs[1], c_FIXNUM_MAX)) return false;
+				auto list = a_xs[0];
+				for (auto i = f_fixnum_value(a_xs[1]);; --i) {
+					if (!list) return a_engine.f_fail(L"out of range"sv);
+					auto p = f_as<t_pair>(list);
+					if (!p) return a_engine.f_fail_cast<t_pair>();
+					if (i <= 0) {
+						a_xs[-1] = p->v_head;
+						return true;
+					}
+					list = p->v_tail;
+				}
+			});
 		}
-		virtual void f_scan(gc::t_collector& a_collector)
+	} v_list_ref;
+
+	struct : t_static
+	{
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
+			f_try(a_engine, a_arguments, [&](auto a_xs)
+			{
+				if (a_arguments != 1) return a_engine.f_fail(L"requires PAIR"sv);
+				auto p = f_as<t_pair>(a_xs[0]);
+				if (!p) return a_engine.f_fail_cast<t_pair>();
+				while (auto q = f_as<t_pair>(p->v_tail)) p = q;
+				a_xs[-1] = p;
+				return true;
+			});
 		}
-		virtual void f_destruct(gc::t_collector& a_collector)
+	} v_last_pair;
+
+	// Returns the first tail of the list whose head is a_xs[0].
+	struct : t_static
+	{
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
+			f_try(a_engine, a_arguments, [&](auto a_xs)
+			{
+				if (a_arguments != 2) return a_engine.f_fail(L"requires OBJECT LIST"sv);
+				for (auto list = a_xs[1]; list;) {
+					auto p = f_as<t_pair>(list);
+					if (!p) return a_engine.f_fail_cast<t_pair>();
+					if (p->v_head == a_xs[0]) {
+						a_xs[-1] = p;
+						return true;
+					}
+					list = p->v_tail;
+				}
+				a_xs[-1] = nullptr;
+				return true;
+			});
 		}
-		virtual void f_dump(const t_dump& a_dump) const
+	} v_memq;
+
+	// Returns the first pair of the list whose head is a_xs[0].
+	struct : t_static
+	{
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
-			t_object::f_dump(a_dump);
+			f_try(a_engine, a_arguments, [&](auto a_xs)
+			{
+				if (a_arguments != 2) return a_engine.f_fail(L"requires OBJECT LIST"sv);
+				for (auto list = a_xs[1]; list;) {
+					auto p = f_as<t_pair>(list);
+					if (!p) return a_engine.f_fail_cast<t_pair>();
+					auto entry = f_as<t_pair>(p->v_head);
+					if (!entry) return a_engine.f_fail_cast<t_pair>();
+					if (entry->v_head == a_xs[0]) {
+						a_xs[-1] = entry;
+						return true;
+					}
+					list = p->v_tail;
+				}
+				a_xs[-1] = nullptr;
+				return true;
+			});
 		}
-	};
+	} v_assq;
+}
 
+struct : t_static
+{
 	virtual void f_call(t_engine& a_engine, size_t a_arguments)
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments > 0) throw t_error{L"requires no arguments"s};
-			a_xs[-1] = a_engine.f_new<t_instance>();
+			if (a_arguments > 0) return a_engine.f_fail(L"requires no arguments"sv);
+			a_xs[-1] = f_gensym(a_engine);
+			return true;
 		});
 	}
 } v_gensym;
@@ -332,8 +1857,9 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments > 0) throw t_error{L"requires no arguments"s};
+			if (a_arguments > 0) return a_engine.f_fail(L"requires no arguments"sv);
 			a_xs[-1] = a_engine.f_new<t_holder<t_module>>(a_engine, ""sv);
+			return true;
 		});
 	}
 } v_module;
@@ -351,12 +1877,12 @@ struct : t_static
 		virtual std::shared_ptr<t_location> f_at_head(t_pair* a_pair)
 		{
 			auto p = dynamic_cast<t_parsed_pair<std::wstring>*>(a_pair);
-			return p ? std::make_shared<t_at_string>(p->v_source, p->v_where_head) : shared_from_this();
+			return p ? std::make_shared<t_at_string>(*p->v_source, p->v_where_head) : shared_from_this();
 		}
 		virtual std::shared_ptr<t_location> f_at_tail(t_pair* a_pair)
 		{
 			auto p = dynamic_cast<t_parsed_pair<std::wstring>*>(a_pair);
-			return p ? std::make_shared<t_at_string>(p->v_source, p->v_where_tail) : shared_from_this();
+			return p ? std::make_shared<t_at_string>(*p->v_source, p->v_where_tail) : shared_from_this();
 		}
 		virtual void f_dump(const t_dump& a_dump) const
 		{
@@ -376,15 +1902,16 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments > 1) throw t_error{L"requires [EOF]"s};
+			if (a_arguments > 1) return a_engine.f_fail(L"requires [EOF]"sv);
 			std::wcout << L"> ";
 			std::wstring cs;
 			std::getline(std::wcin, cs);
 			if (cs.empty()) {
 				a_xs[-1] = !std::wcin && a_arguments > 0 ? a_xs[0] : nullptr;
-				return;
+				return true;
 			}
 			cs.push_back(WEOF);
+			auto source = std::make_shared<const std::wstring>(cs);
 			auto parse = [&](auto&& a_get, auto&& a_pair, auto&& a_location)
 			{
 				return t_parser<decltype(a_get), decltype(a_pair), decltype(a_location)>(a_engine, std::move(a_get), std::move(a_pair), std::move(a_location)).f_expression();
@@ -394,11 +1921,12 @@ struct : t_static
 				return *i++;
 			}, [&](t_object* a_value, const t_at& a_at)
 			{
-				return a_engine.f_new<t_parsed_pair<std::wstring>>(a_engine.f_pointer(a_value), cs, a_at);
+				return a_engine.f_new<t_parsed_pair<std::wstring>>(a_engine.f_pointer(a_value), source, a_at);
 			}, [&](const t_at& a_at)
 			{
 				return std::make_shared<t_at_string>(cs, a_at);
 			});
+			return true;
 		});
 	}
 } v_read;
@@ -409,22 +1937,27 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments != 2) throw t_error{L"requires OBJECT MODULE"s};
+			if (a_arguments != 2) return a_engine.f_fail(L"requires OBJECT MODULE"sv);
 			if (!a_xs[0]) {
 				a_xs[-1] = nullptr;
-				return;
+				return true;
 			}
-			auto module = a_engine.f_pointer(f_cast<t_holder<t_module>>(a_xs[1]));
+			auto p = f_as<t_holder<t_module>>(a_xs[1]);
+			if (!p) return a_engine.f_fail_cast<t_holder<t_module>>();
+			auto module = a_engine.f_pointer(p);
 			auto code = a_engine.f_pointer(a_engine.f_new<t_holder<t_code>>(a_engine, nullptr, module));
 			(*code)->v_imports.push_back(a_engine.v_global);
 			(*code)->v_imports.push_back(module);
 			{
+				t_compilation compilation(a_engine);
 				t_emit emit{*code};
-				a_xs[0]->f_render(**code, std::make_shared<t_at_expression>(a_engine, a_xs[0]))->f_emit(emit, 0, true);
+				(*code)->f_optimize((*code)->f_render(a_xs[0], std::make_shared<t_at_expression>(a_engine, a_xs[0])))->f_emit(emit, 0, true);
 				emit.f_end();
 			}
+			a_engine.f_link();
 			a_engine.f_run(*code, nullptr);
 			a_xs[-1] = a_engine.v_used[0];
+			return true;
 		});
 	}
 } v_eval;
@@ -457,7 +1990,10 @@ namespace prompt
 			auto head = a_frame[v_frames - 1].v_stack;
 			auto frames = reinterpret_cast<t_frame*>(std::copy_n(head, v_stack, reinterpret_cast<t_object**>(this + 1)));
 			std::copy_n(a_frame, v_frames, frames);
-			for (size_t i = 0; i < v_frames; ++i) frames[i].v_stack -= head - static_cast<t_object**>(nullptr);
+			for (size_t i = 0; i < v_frames; ++i) {
+				frames[i].v_stack -= head - static_cast<t_object**>(nullptr);
+				if (frames[i].v_scope) frames[i].v_scope->v_captured = true;
+			}
 		}
 		virtual size_t f_size() const
 		{
@@ -473,9 +2009,10 @@ namespace prompt
 		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
 			a_engine.v_used -= a_arguments + 1;
-			if (a_arguments != 1) throw t_error{L"requires OBJECT"s};
+			if (a_arguments != 1) return void(a_engine.f_fail(L"requires OBJECT"sv));
 			auto used = a_engine.v_used;
-			if (used + v_stack > a_engine.v_stack.get() + t_engine::c_STACK || a_engine.v_frame - v_frames < a_engine.v_frames.get()) throw t_error{L"stack overflow"s};
+			if (used + v_stack >= a_engine.v_stack_tail) a_engine.f_grow_stack(used + v_stack + 1);
+			if (a_engine.v_frame - v_frames < a_engine.v_frames_head) a_engine.f_grow_frames(a_engine.v_frame - v_frames);
 			auto value = used[1];
 			auto p = reinterpret_cast<t_object**>(this + 1);
 			a_engine.v_used = std::copy_n(p, v_stack, used);
@@ -489,35 +2026,147 @@ namespace prompt
 	{
 		inline static void* v_return = reinterpret_cast<void*>(e_instruction__RETURN);
 
-		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		// Pushes the prompt frame.
+		static bool f_prompt(t_engine& a_engine, size_t a_arguments)
 		{
 			if (a_arguments != 3) {
 				a_engine.v_used -= a_arguments + 1;
-				throw t_error{L"requires TAG HANDLER THUNK"s};
-			}
-			if (a_engine.v_frame <= a_engine.v_frames.get()) {
-				a_engine.v_used -= 4;
-				throw t_error{L"stack overflow"s};
+				return a_engine.f_fail(L"requires TAG HANDLER THUNK"sv);
 			}
+			if (a_engine.v_frame <= a_engine.v_frames_head)
+				try {
+					a_engine.f_grow_frames(a_engine.v_frame - 1);
+				} catch (...) {
+					a_engine.v_used -= 4;
+					throw;
+				}
 			--a_engine.v_frame;
 			a_engine.v_frame->v_stack = a_engine.v_used - 4;
 			a_engine.v_frame->v_code = nullptr;
 			a_engine.v_frame->v_current = &v_return;
 			a_engine.v_frame->v_scope = nullptr;
-			a_engine.v_used[-1]->f_call(a_engine, 0);
+			return true;
+		}
+
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		{
+			if (f_prompt(a_engine, a_arguments)) a_engine.f_call(a_engine.v_used[-1], 0);
 		}
 	} v_call;
+	// Returns the result of the thunk to the prompt.
+	struct t_leave : t_static
+	{
+		inline static void* v_code[] = {
+			reinterpret_cast<void*>(e_instruction__CALL_TAIL),
+			reinterpret_cast<void*>(1)
+		};
+
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		{
+			auto value = a_engine.v_used[-1];
+			a_engine.v_used -= 2;
+			if (a_engine.v_frame == a_engine.v_segment->v_frames.f_tail()) {
+				auto segment = a_engine.v_segment;
+				a_engine.f_switch(segment->v_parent);
+				a_engine.f_release(segment);
+			}
+			*a_engine.v_used++ = value;
+		}
+	} v_leave;
+	// Runs the thunk on a new segment.
+	struct t_call_one_shot : t_call
+	{
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		{
+			if (!f_prompt(a_engine, a_arguments)) return;
+			auto thunk = a_engine.v_used[-1];
+			auto segment = a_engine.f_segment();
+			segment->v_parent = a_engine.v_segment;
+			a_engine.f_switch(segment);
+			*a_engine.v_used++ = &v_leave;
+			*a_engine.v_used++ = thunk;
+			--a_engine.v_frame;
+			a_engine.v_frame->v_stack = segment->v_stack.f_head();
+			a_engine.v_frame->v_code = nullptr;
+			a_engine.v_frame->v_current = v_leave.v_code;
+			a_engine.v_frame->v_scope = nullptr;
+			a_engine.f_call(thunk, 0);
+		}
+	} v_call_one_shot;
+	// Takes over the segments between the abort and the prompt.
+	struct t_one_shot : t_object_of<t_one_shot>
+	{
+		t_segment* v_segment;
+		t_object* v_tag;
+		t_object* v_handler;
+		t_object* v_thunk;
+
+		t_one_shot(t_segment* a_segment, t_object** a_prompt) : v_segment(a_segment), v_tag(a_prompt[1]), v_handler(a_prompt[2]), v_thunk(a_prompt[3])
+		{
+		}
+		virtual void f_scan(gc::t_collector& a_collector)
+		{
+			for (auto p = v_segment; p; p = p->v_parent) p->f_scan(a_collector);
+			v_tag = a_collector.f_forward(v_tag);
+			v_handler = a_collector.f_forward(v_handler);
+			v_thunk = a_collector.f_forward(v_thunk);
+		}
+		virtual void f_destruct(gc::t_collector& a_collector)
+		{
+			while (auto p = v_segment) {
+				v_segment = p->v_parent;
+				static_cast<t_engine&>(a_collector).f_release(p);
+			}
+		}
+		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		{
+			a_engine.v_used -= a_arguments + 1;
+			if (a_arguments != 1) return void(a_engine.f_fail(L"requires OBJECT"sv));
+			if (!v_segment) return void(a_engine.f_fail(L"already resumed"sv));
+			auto used = a_engine.v_used;
+			if (used + 4 >= a_engine.v_stack_tail) a_engine.f_grow_stack(used + 5);
+			auto value = used[1];
+			used[0] = &v_call_one_shot;
+			used[1] = v_tag;
+			used[2] = v_handler;
+			used[3] = v_thunk;
+			a_engine.v_used = used + 4;
+			t_call::f_prompt(a_engine, 3);
+			auto bottom = v_segment;
+			while (bottom->v_parent) bottom = bottom->v_parent;
+			bottom->v_parent = a_engine.v_segment;
+			a_engine.f_switch(v_segment);
+			v_segment = nullptr;
+			*a_engine.v_used++ = value;
+		}
+	};
 	struct : t_static
 	{
 		virtual void f_call(t_engine& a_engine, size_t a_arguments)
 		{
 			auto tail = a_engine.v_used - a_arguments - 1;
+			auto fail = [&](std::wstring_view a_message)
+			{
+				a_engine.v_used = tail;
+				a_engine.f_fail(a_message);
+			};
+			if (a_arguments < 1) return fail(L"requires TAG [OBJECT...]"sv);
+			auto segment = a_engine.v_segment;
+			auto frame = a_engine.v_frame;
+			while (frame == segment->v_frames.f_tail() || !f_as<t_call>(frame->v_stack[0]) || frame->v_stack[1] != tail[1])
+				if (frame == segment->v_frames.f_tail()) {
+					segment = segment->v_parent;
+					if (!segment) return fail(L"no matching prompt found"sv);
+					frame = segment->v_frame;
+				} else {
+					++frame;
+				}
+			if (segment != a_engine.v_segment) {
+				if (f_as<t_call_one_shot>(frame->v_stack[0]) && frame == segment->v_frame) return f_one_shot(a_engine, a_arguments, segment);
+				while (a_engine.v_segment != segment) a_engine.f_flatten();
+				tail = a_engine.v_used - a_arguments - 1;
+			}
 			try {
-				if (a_arguments < 1) throw t_error{L"requires TAG [OBJECT...]"s};
-				auto frame = a_engine.v_frame;
-				while (!dynamic_cast<t_call*>(frame->v_stack[0]) || frame->v_stack[1] != tail[1])
-					if (++frame == a_engine.v_frames.get() + t_engine::c_FRAMES)
-						throw t_error{L"no matching prompt found"s};
 				auto head = frame->v_stack;
 				auto stack = tail - head;
 				auto frames = ++frame - a_engine.v_frame;
@@ -526,26 +2175,47 @@ namespace prompt
 				auto handler = head[2];
 				a_engine.v_used = std::copy(tail + 2, a_engine.v_used, head + 2);
 				a_engine.v_frame = frame;
-				handler->f_call(a_engine, a_arguments);
+				a_engine.f_call(handler, a_arguments);
 			} catch (...) {
 				a_engine.v_used = tail;
 				throw;
 			}
 		}
+		// Detaches the segments above a_segment, whose top frame is the prompt.
+		void f_one_shot(t_engine& a_engine, size_t a_arguments, t_segment* a_segment)
+		{
+			auto head = a_segment->v_frame->v_stack;
+			auto continuation = a_engine.f_new<t_one_shot>(a_engine.v_segment, head);
+			auto tail = a_engine.v_used - a_arguments - 1;
+			auto used = a_engine.v_used;
+			auto top = a_engine.v_segment;
+			auto bottom = top;
+			while (bottom->v_parent != a_segment) bottom = bottom->v_parent;
+			a_engine.f_switch(a_segment);
+			top->v_used = tail;
+			bottom->v_parent = nullptr;
+			head[0] = this;
+			head[1] = continuation;
+			auto handler = head[2];
+			a_engine.v_used = std::copy(tail + 2, used, head + 2);
+			++a_engine.v_frame;
+			a_engine.f_call(handler, a_arguments);
+		}
 	} v_abort;
 }
 
 struct : t_static
 {
+	// a_list must be a proper list.
 	static t_object* f_append(t_engine& a_engine, t_object* a_list, t_object* a_tail)
 	{
 		if (!a_list) return a_tail;
 		auto tail = a_engine.f_pointer(a_tail);
-		auto pair = a_engine.f_pointer(f_cast<t_pair>(a_list));
+		auto pair = a_engine.f_pointer(static_cast<t_pair*>(a_list));
 		auto list = a_engine.f_pointer(a_engine.f_new<t_pair>(a_engine.f_pointer(pair->v_head), nullptr));
 		auto last = a_engine.f_pointer(list.v_value);
 		while (pair->v_tail) {
-			pair = f_cast<t_pair>(pair->v_tail);
+			pair = static_cast<t_pair*>(pair->v_tail);
 			f_push(a_engine, last, pair->v_head);
 		}
 		last->v_tail = tail;
@@ -556,20 +2226,38 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments != 2) throw t_error{L"requires PAIR OBJECT"s};
+			if (a_arguments != 2) return a_engine.f_fail(L"requires PAIR OBJECT"sv);
+			for (auto p = a_xs[0]; p; p = static_cast<t_pair*>(p)->v_tail) if (!f_as<t_pair>(p)) return a_engine.f_fail_cast<t_pair>();
 			a_xs[-1] = f_append(a_engine, a_xs[0], a_xs[1]);
+			return true;
 		});
 	}
 } v_append;
 
+// Checks the last splice of a quasiquote, which is shared instead of copied by append.
+struct : t_static
+{
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		f_try(a_engine, a_arguments, [&](auto a_xs)
+		{
+			if (a_arguments != 1) return a_engine.f_fail(L"requires LIST"sv);
+			for (auto p = a_xs[0]; p; p = static_cast<t_pair*>(p)->v_tail) if (!f_as<t_pair>(p)) return a_engine.f_fail_cast<t_pair>();
+			a_xs[-1] = a_xs[0];
+			return true;
+		});
+	}
+} v_splice;
+
 struct : t_static
 {
 	virtual void f_call(t_engine& a_engine, size_t a_arguments)
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments != 1) throw t_error{L"requires OBJECT"s};
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
 			a_xs[-1] = a_engine.f_new<t_quote>(a_xs[0]);
+			return true;
 		});
 	}
 } v_quote;
@@ -580,10 +2268,11 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments != 1) throw t_error{L"requires MESSAGE"s};
+			if (a_arguments != 1) return a_engine.f_fail(L"requires MESSAGE"sv);
 			std::wstringstream out;
 			out << a_xs[0];
 			a_xs[-1] = a_engine.f_new<t_error::t_holder>(t_error{out.str()});
+			return true;
 		});
 	}
 } v_error;
@@ -594,13 +2283,25 @@ struct : t_static
 	{
 		f_try(a_engine, a_arguments, [&](auto a_xs)
 		{
-			if (a_arguments != 2) throw t_error{L"requires CONTINUATION ERROR"s};
-			auto continuation = f_cast<prompt::t_continuation>(a_xs[0]);
-			auto& backtrace = f_cast<t_error::t_holder>(a_xs[1])->v_value->v_backtrace;
-			auto p = reinterpret_cast<t_frame*>(reinterpret_cast<char*>(continuation + 1) + sizeof(t_object*) * continuation->v_stack);
-			for (auto q = p + continuation->v_frames; p != q; ++p)
-				if (p->v_code) backtrace.push_back((*p->v_code)->f_location(p->v_current));
+			if (a_arguments != 2) return a_engine.f_fail(L"requires CONTINUATION ERROR"sv);
+			auto continuation = f_as<prompt::t_continuation>(a_xs[0]);
+			auto one_shot = f_as<prompt::t_one_shot>(a_xs[0]);
+			if (!continuation && !one_shot) return a_engine.f_fail_cast<prompt::t_continuation>();
+			auto error = f_as<t_error::t_holder>(a_xs[1]);
+			if (!error) return a_engine.f_fail_cast<t_error::t_holder>();
+			auto& backtrace = error->f_value().v_backtrace;
+			auto push = [&](t_frame* p, t_frame* q)
+			{
+				for (; p != q; ++p) if (p->v_code) if (auto location = (*p->v_code)->f_location(p->v_current)) backtrace.push_back(location);
+			};
+			if (continuation) {
+				auto p = reinterpret_cast<t_frame*>(reinterpret_cast<char*>(continuation + 1) + sizeof(t_object*) * continuation->v_stack);
+				push(p, p + continuation->v_frames);
+			} else {
+				for (auto p = one_shot->v_segment; p; p = p->v_parent) push(p->v_frame, p->v_frames.f_tail());
+			}
 			a_xs[-1] = a_xs[1];
+			return true;
 		});
 	}
 } v_catch;
@@ -610,7 +2311,8 @@ struct : t_static
 	virtual void f_call(t_engine& a_engine, size_t a_arguments)
 	{
 		v_catch.f_call(a_engine, a_arguments);
-		throw std::move(*f_cast<t_error::t_holder>(a_engine.v_used[1])->v_value);
+		if (a_engine.v_failure) return;
+		throw std::move(static_cast<t_error::t_holder*>(a_engine.v_used[1])->f_value());
 	}
 } v_rethrow;
 
@@ -619,28 +2321,42 @@ struct : t_static
 t_object* f_unquasiquote(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_object* a_value)
 {
 	auto& engine = a_code.v_engine;
-	if (auto p = dynamic_cast<t_pair*>(a_value)) {
+	if (auto p = f_as<t_pair>(a_value)) {
+		// The elements up to a splice or the end are built by a single t_list, followed by the rest.
+		// The last splice is checked to be a list and shared instead of copied.
 		auto pair = engine.f_pointer(p);
-		auto tail = engine.f_pointer(engine.f_new<t_pair>(engine.f_pointer(f_unquasiquote(a_code, a_location, pair->v_tail)), nullptr));
-		if (auto p = dynamic_cast<t_unquote_splicing*>(pair->v_head))
-			return engine.f_new<t_call>(engine.f_pointer(engine.f_new<t_pair>(&v_append,
-				engine.f_pointer(engine.f_new<t_pair>(engine.f_pointer(a_code.f_render(p->v_value, a_location)), tail))
-			)), a_location);
-		else
-			return engine.f_new<t_call>(engine.f_pointer(engine.f_new<t_pair>(&v_cons,
-				engine.f_pointer(engine.f_new<t_pair>(engine.f_pointer(f_unquasiquote(a_code, a_location, pair->v_head)), tail))
-			)), a_location);
+		auto elements = engine.f_pointer(engine.f_node<t_pair>(nullptr, nullptr));
+		auto last = engine.f_pointer(elements.v_value);
+		auto rest = engine.f_pointer(static_cast<t_object*>(nullptr));
+		while (true) {
+			if (auto p = f_as<t_unquote_splicing>(pair->v_head)) {
+				rest = a_code.f_render(p->v_value, a_location);
+				auto tail = engine.f_pointer(pair->v_tail ? engine.f_node<t_pair>(engine.f_pointer(f_unquasiquote(a_code, a_location, pair->v_tail)), nullptr) : nullptr);
+				rest = engine.f_node<t_call>(engine.f_pointer(engine.f_node<t_pair>(tail ? static_cast<t_object*>(&v_append) : &v_splice, engine.f_pointer(engine.f_node<t_pair>(rest, tail)))), a_location);
+				break;
+			}
+			engine.f_push_node(last, f_unquasiquote(a_code, a_location, pair->v_head));
+			auto tail = f_as<t_pair>(pair->v_tail);
+			if (!tail) {
+				if (pair->v_tail) rest = f_unquasiquote(a_code, a_location, pair->v_tail);
+				break;
+			}
+			pair = tail;
+		}
+		if (!elements->v_tail) return rest;
+		return engine.f_node<t_list>(engine.f_pointer(static_cast<t_pair*>(elements->v_tail)), rest);
 	}
-	if (auto p = dynamic_cast<t_quote*>(a_value))
-		return engine.f_new<t_call>(engine.f_pointer(engine.f_new<t_pair>(&v_quote,
-			engine.f_pointer(engine.f_new<t_pair>(engine.f_pointer(f_unquasiquote(a_code, a_location, p->v_value)), nullptr))
+	if (auto p = f_as<t_quote>(a_value))
+		return engine.f_node<t_call>(engine.f_pointer(engine.f_node<t_pair>(&v_quote,
+			engine.f_pointer(engine.f_node<t_pair>(engine.f_pointer(f_unquasiquote(a_code, a_location, p->v_value)), nullptr))
 		)), a_location);
-	if (auto p = dynamic_cast<t_unquote*>(a_value)) return a_code.f_render(p->v_value, a_location);
-	return engine.f_new<t_quote>(engine.f_pointer(a_value));
+	if (auto p = f_as<t_unquote>(a_value)) return a_code.f_render(p->v_value, a_location);
+	return engine.f_node<t_quote>(engine.f_pointer(a_value));
 }
 
 void f_rethrow(t_engine& a_engine, t_object* a_thunk)
 {
+	if (a_engine.v_used + 4 > a_engine.v_stack_tail) a_engine.f_grow_stack(a_engine.v_used + 4);
 	*a_engine.v_used++ = &prompt::v_call;
 	*a_engine.v_used++ = &v_catch;
 	*a_engine.v_used++ = &v_rethrow;
@@ -648,38 +2364,366 @@ void f_rethrow(t_engine& a_engine, t_object* a_thunk)
 	prompt::v_call.f_call(a_engine, 3);
 }
 
-void f_throw(t_engine& a_engine, t_error&& a_error)
+void f_throw(t_engine& a_engine, const t_failure& a_failure);
+
+template<typename T>
+void f_abort(t_engine& a_engine, T&& a_error)
 {
+	if (a_engine.v_used + 3 > a_engine.v_stack_tail) a_engine.f_grow_stack(a_engine.v_used + 3);
 	*a_engine.v_used++ = &prompt::v_abort;
 	*a_engine.v_used++ = &v_catch;
-	*a_engine.v_used++ = a_engine.f_new<t_error::t_holder>(std::move(a_error));
+	*a_engine.v_used++ = a_engine.f_new<t_error::t_holder>(std::forward<T>(a_error));
 	prompt::v_abort.f_call(a_engine, 2);
+	if (a_engine.v_failure) f_throw(a_engine, std::exchange(a_engine.v_failure, {}));
+}
+
+void f_throw(t_engine& a_engine, t_error&& a_error)
+{
+	f_abort(a_engine, std::move(a_error));
+}
+
+void f_throw(t_engine& a_engine, const t_failure& a_failure)
+{
+	f_abort(a_engine, a_failure);
+}
+
+namespace
+{
+
+const std::pair<std::wstring_view, t_object*> v_builtins[] = {
+	{L"lambda"sv, &v_lambda},
+	{L"begin"sv, &v_begin},
+	{L"define"sv, &v_define},
+	{L"set!"sv, &v_set},
+	{L"define-macro"sv, &v_macro},
+	{L"define-record"sv, &v_record},
+	{L"export"sv, &v_export},
+	{L"import"sv, &v_import},
+	{L"if"sv, &v_if},
+	{L"eq?"sv, &v_eq},
+	{L"pair?"sv, &v_is_pair},
+	{L"cons"sv, &v_cons},
+	{L"car"sv, &v_car},
+	{L"cdr"sv, &v_cdr},
+	{L"integer?"sv, &v_is_integer},
+	{L"float?"sv, &v_is_float},
+	{L"inexact"sv, &v_inexact},
+	{L"exact"sv, &v_exact},
+	{L"+"sv, &v_add},
+	{L"-"sv, &v_subtract},
+	{L"*"sv, &v_multiply},
+	{L"/"sv, &v_divide},
+	{L"quotient"sv, &v_quotient},
+	{L"remainder"sv, &v_remainder},
+	{L"modulo"sv, &v_modulo},
+	{L"="sv, &v_equals},
+	{L"<"sv, &v_less},
+	{L"<="sv, &v_less_equal},
+	{L">"sv, &v_greater},
+	{L">="sv, &v_greater_equal},
+	{L"string?"sv, &v_is_string},
+	{L"string-length"sv, &v_string_length},
+	{L"string-byte"sv, &v_string_byte},
+	{L"string-append"sv, &v_string_append},
+	{L"substring"sv, &v_substring},
+	{L"string-search"sv, &v_string_search},
+	{L"string=?"sv, &v_string_equals},
+	{L"vector?"sv, &v_is_vector},
+	{L"make-vector"sv, &v_make_vector},
+	{L"vector"sv, &v_vector},
+	{L"vector-length"sv, &v_vector_length},
+	{L"vector-ref"sv, &v_vector_ref},
+	{L"vector-set!"sv, &v_vector_set},
+	{L"vector-fill!"sv, &v_vector_fill},
+	{L"vector-copy!"sv, &v_vector_copy},
+	{L"vector-eq?"sv, &v_vector_eq},
+	{L"make-hash-table"sv, &v_make_hash_table},
+	{L"hash-table?"sv, &v_is_hash_table},
+	{L"hash-table-ref"sv, &v_hash_table_ref},
+	{L"hash-table-set!"sv, &v_hash_table_set},
+	{L"hash-table-delete!"sv, &v_hash_table_delete},
+	{L"hash-table-count"sv, &v_hash_table_count},
+	{L"bytevector?"sv, &v_is_bytevector},
+	{L"make-bytevector"sv, &v_make_bytevector},
+	{L"map-file"sv, &v_map_file},
+	{L"bytevector-length"sv, &v_bytevector_length},
+	{L"bytevector-u8-ref"sv, &v_bytevector_u8_ref},
+	{L"bytevector-u8-set!"sv, &v_bytevector_u8_set},
+	{L"bytevector-u16-ref"sv, &v_bytevector_u16_ref},
+	{L"bytevector-s16-ref"sv, &v_bytevector_s16_ref},
+	{L"bytevector-u32-ref"sv, &v_bytevector_u32_ref},
+	{L"bytevector-s32-ref"sv, &v_bytevector_s32_ref},
+	{L"bytevector-u64-ref"sv, &v_bytevector_u64_ref},
+	{L"bytevector-s64-ref"sv, &v_bytevector_s64_ref},
+	{L"bytevector-f32-ref"sv, &v_bytevector_f32_ref},
+	{L"bytevector-f64-ref"sv, &v_bytevector_f64_ref},
+	{L"persistent-map"sv, &v_persistent_map},
+	{L"persistent-map?"sv, &v_is_persistent_map},
+	{L"persistent-map-ref"sv, &v_persistent_map_ref},
+	{L"persistent-map-set"sv, &v_persistent_map_set},
+	{L"persistent-map-delete"sv, &v_persistent_map_delete},
+	{L"persistent-map-count"sv, &v_persistent_map_count},
+	{L"persistent-vector"sv, &v_persistent_vector},
+	{L"persistent-vector?"sv, &v_is_persistent_vector},
+	{L"persistent-vector-length"sv, &v_persistent_vector_length},
+	{L"persistent-vector-ref"sv, &v_persistent_vector_ref},
+	{L"persistent-vector-set"sv, &v_persistent_vector_set},
+	{L"persistent-vector-push"sv, &v_persistent_vector_push},
+	{L"transient"sv, &v_transient},
+	{L"persistent!"sv, &v_persistent},
+	{L"transient-map-set!"sv, &v_transient_map_set},
+	{L"transient-map-delete!"sv, &v_transient_map_delete},
+	{L"transient-vector-set!"sv, &v_transient_vector_set},
+	{L"transient-vector-push!"sv, &v_transient_vector_push},
+	{L"length"sv, &list::v_length},
+	{L"reverse"sv, &list::v_reverse},
+	{L"map"sv, &list::v_map},
+	{L"filter"sv, &list::v_filter},
+	{L"fold"sv, &list::v_fold},
+	{L"memq"sv, &list::v_memq},
+	{L"assq"sv, &list::v_assq},
+	{L"list-ref"sv, &list::v_list_ref},
+	{L"last-pair"sv, &list::v_last_pair},
+	{L"gensym"sv, &v_gensym},
+	{L"module"sv, &v_module},
+	{L"read"sv, &v_read},
+	{L"eval"sv, &v_eval},
+	{L"print"sv, &v_print},
+	{L"call-with-prompt"sv, &prompt::v_call},
+	{L"call-with-prompt/one-shot"sv, &prompt::v_call_one_shot},
+	{L"abort-to-prompt"sv, &prompt::v_abort},
+	{L"error"sv, &v_error},
+	{L"catch"sv, &v_catch}
+};
+
+// Not bound to any symbol but named so that compiled code referring to them can be saved.
+const std::pair<std::wstring_view, t_object*> v_internals[] = {
+	{L"append"sv, &v_append},
+	{L"splice"sv, &v_splice},
+	{L"quote"sv, &v_quote}
+};
+
+void t_static::f_dump(const t_dump& a_dump) const
+{
+	for (auto& x : v_builtins) if (x.second == this) return void(a_dump << L"#"sv << x.first);
+	for (auto& x : v_internals) if (x.second == this) return void(a_dump << L"#"sv << x.first);
+	t_object::f_dump(a_dump);
+}
+
+}
+
+t_instruction f_instruction(t_object* a_value, size_t a_arguments)
+{
+	if (auto p = f_as<t_operator>(a_value)) return a_arguments == 2 ? p->v_instruction : e_instruction__END;
+	auto p = f_as<t_record_procedure>(a_value);
+	if (!p) return e_instruction__END;
+	switch (p->v_kind) {
+	case t_record_procedure::e_kind__CONSTRUCTOR:
+		return a_arguments == p->v_type->v_size ? e_instruction__RECORD_NEW : e_instruction__END;
+	case t_record_procedure::e_kind__PREDICATE:
+		return a_arguments == 1 ? e_instruction__RECORD_IS : e_instruction__END;
+	case t_record_procedure::e_kind__ACCESSOR:
+		return a_arguments == 1 ? e_instruction__RECORD_GET : e_instruction__END;
+	default:
+		return a_arguments == 2 ? e_instruction__RECORD_SET : e_instruction__END;
+	}
+}
+
+// Whether a_value can be referred to from bodies inlined into other codes.
+bool f_inlinable(t_object* a_value)
+{
+	if (dynamic_cast<t_module::t_variable*>(a_value) || dynamic_cast<t_record_procedure*>(a_value)) return true;
+	if (!dynamic_cast<t_static*>(a_value)) return false;
+	for (auto x : std::initializer_list<t_object*>{&v_lambda, &v_define, &v_set, &v_macro, &v_record, &v_export, &v_import}) if (a_value == x) return false;
+	return true;
+}
+
+namespace
+{
+
+// Folds (quote 'x) into ''x, and lists of quoted values into quoted lists.
+// The lists are rendered only from quasiquote templates, whose constant parts are not required to be fresh.
+// Calls to cons are never folded as each has to return a fresh pair.
+t_object* f_fold(t_code& a_code, t_object* a_node)
+{
+	auto& engine = a_code.v_engine;
+	if (auto list = dynamic_cast<t_list*>(a_node)) {
+		for (auto p = list->v_value; p; p = static_cast<t_pair*>(p->v_tail)) if (!dynamic_cast<t_quote*>(p->v_head)) return a_node;
+		if (list->v_tail && !dynamic_cast<t_quote*>(list->v_tail)) return a_node;
+		auto thiz = engine.f_pointer(list);
+		auto head = engine.f_pointer(engine.f_new<t_pair>(nullptr, nullptr));
+		auto last = engine.f_pointer(head.v_value);
+		for (auto p = engine.f_pointer(thiz->v_value); p; p = static_cast<t_pair*>(p->v_tail)) f_push(engine, last, static_cast<t_quote*>(p->v_head)->v_value);
+		if (thiz->v_tail) last->v_tail = static_cast<t_quote*>(thiz->v_tail)->v_value;
+		return engine.f_node<t_quote>(engine.f_pointer(head->v_tail));
+	}
+	auto call = dynamic_cast<t_call*>(a_node);
+	if (!call || call->v_expand || call->v_value->v_head != &v_quote) return a_node;
+	auto arguments = static_cast<t_pair*>(call->v_value->v_tail);
+	auto value = arguments && !arguments->v_tail ? dynamic_cast<t_quote*>(arguments->v_head) : nullptr;
+	if (!value) return a_node;
+	return engine.f_node<t_quote>(engine.f_pointer(engine.f_new<t_quote>(engine.f_pointer(value->v_value))));
+}
+
+// Replaces (if 'x then else) with the branch taken.
+t_object* f_prune(t_code& a_code, t_object* a_node)
+{
+	auto p = dynamic_cast<decltype(v_if)::t_instance*>(a_node);
+	if (!p) return a_node;
+	auto condition = dynamic_cast<t_quote*>(p->v_condition);
+	if (!condition) return a_node;
+	if (condition->v_value) return p->v_then;
+	return p->v_else ? p->v_else : a_code.v_engine.f_node<t_quote>(nullptr);
+}
+
+// Splices nested begin blocks and drops expressions without side effects whose values are discarded.
+t_object* f_flatten(t_code& a_code, t_object* a_node)
+{
+	using t_instance = decltype(v_begin)::t_instance;
+	auto p = dynamic_cast<t_instance*>(a_node);
+	if (!p) return a_node;
+	t_pair* first = nullptr;
+	t_pair* last = nullptr;
+	auto append = [&](t_pair* a_x)
+	{
+		if (last)
+			last->v_tail = a_x;
+		else
+			first = a_x;
+		last = a_x;
+	};
+	for (auto q = p->v_value; q;) {
+		auto next = static_cast<t_pair*>(q->v_tail);
+		if (auto block = dynamic_cast<t_instance*>(q->v_head))
+			for (auto r = block->v_value; r;) {
+				auto next = static_cast<t_pair*>(r->v_tail);
+				append(r);
+				r = next;
+			}
+		else
+			append(q);
+		q = next;
+	}
+	last->v_tail = nullptr;
+	auto pure = [](t_object* a_x)
+	{
+		return dynamic_cast<t_quote*>(a_x) || dynamic_cast<t_static*>(a_x) || dynamic_cast<t_code::t_local*>(a_x) || dynamic_cast<decltype(v_lambda)::t_instantiate*>(a_x);
+	};
+	while (first->v_tail && pure(first->v_head)) first = static_cast<t_pair*>(first->v_tail);
+	for (auto q = first; q->v_tail;) {
+		auto next = static_cast<t_pair*>(q->v_tail);
+		if (next->v_tail && pure(next->v_head))
+			q->v_tail = next->v_tail;
+		else
+			q = next;
+	}
+	if (!first->v_tail) return first->v_head;
+	p->v_value = first;
+	return p;
+}
+
+const t_pass v_passes[] = {
+	{L"fold"sv, f_fold},
+	{L"prune"sv, f_prune},
+	{L"flatten"sv, f_flatten}
+};
+
+}
+
+t_symbol* f_gensym(t_engine& a_engine)
+{
+	struct t_instance : t_symbol
+	{
+		t_instance() : t_symbol({})
+		{
+		}
+		virtual void f_scan(gc::t_collector& a_collector)
+		{
+		}
+		virtual void f_destruct(gc::t_collector& a_collector)
+		{
+		}
+		virtual void f_dump(const t_dump& a_dump) const
+		{
+			t_object::f_dump(a_dump);
+		}
+	};
+	return a_engine.f_new<t_instance>();
+}
+
+t_object* f_builtin(std::wstring_view a_name)
+{
+	for (auto& x : v_builtins) if (x.first == a_name) return x.second;
+	for (auto& x : v_internals) if (x.first == a_name) return x.second;
+	return nullptr;
+}
+
+std::wstring_view f_builtin(t_object* a_value)
+{
+	for (auto& x : v_builtins) if (x.second == a_value) return x.first;
+	for (auto& x : v_internals) if (x.second == a_value) return x.first;
+	return {};
+}
+
+t_object* t_macro::f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
+{
+	return a_location->f_try([&]
+	{
+		auto& engine = a_code.v_engine;
+		engine.f_run(*v_value, a_pair->v_tail);
+		auto p = engine.v_used[0];
+		return a_code.f_render(p, std::make_shared<t_at_expression>(engine, p));
+	});
+}
+
+void t_record_procedure::f_call(t_engine& a_engine, size_t a_arguments)
+{
+	f_try(a_engine, a_arguments, [&](auto a_xs)
+	{
+		switch (v_kind) {
+		case e_kind__CONSTRUCTOR:
+			{
+				if (a_arguments != v_type->v_size) return a_engine.f_fail(L"wrong number of arguments"sv);
+				auto p = t_record::f_new(a_engine, a_arguments);
+				// This may have been moved by the allocation.
+				p->v_type = static_cast<t_record_procedure*>(a_xs[-1])->v_type;
+				std::copy_n(a_xs, a_arguments, p->f_fields());
+				a_xs[-1] = p;
+			}
+			return true;
+		case e_kind__PREDICATE:
+			if (a_arguments != 1) return a_engine.f_fail(L"requires OBJECT"sv);
+			a_xs[-1] = f_record(a_xs[0]);
+			return true;
+		case e_kind__ACCESSOR:
+			{
+				if (a_arguments != 1) return a_engine.f_fail(L"requires RECORD"sv);
+				auto p = f_record(a_xs[0]);
+				if (!p) return a_engine.f_fail_cast<t_record>();
+				a_xs[-1] = p->f_fields()[v_index];
+			}
+			return true;
+		default:
+			{
+				if (a_arguments != 2) return a_engine.f_fail(L"requires RECORD OBJECT"sv);
+				auto p = f_record(a_xs[0]);
+				if (!p) return a_engine.f_fail_cast<t_record>();
+				a_xs[-1] = p->f_fields()[v_index] = a_xs[1];
+			}
+			return true;
+		}
+	});
+}
+
+void t_record_procedure::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#"sv << v_name;
 }
 
 void f_define_builtins(t_module& a_module)
 {
-	a_module.f_register(L"lambda"sv, &v_lambda);
-	a_module.f_register(L"begin"sv, &v_begin);
-	a_module.f_register(L"define"sv, &v_define);
-	a_module.f_register(L"set!"sv, &v_set);
-	a_module.f_register(L"define-macro"sv, &v_macro);
-	a_module.f_register(L"export"sv, &v_export);
-	a_module.f_register(L"import"sv, &v_import);
-	a_module.f_register(L"if"sv, &v_if);
-	a_module.f_register(L"eq?"sv, &v_eq);
-	a_module.f_register(L"pair?"sv, &v_is_pair);
-	a_module.f_register(L"cons"sv, &v_cons);
-	a_module.f_register(L"car"sv, &v_car);
-	a_module.f_register(L"cdr"sv, &v_cdr);
-	a_module.f_register(L"gensym"sv, &v_gensym);
-	a_module.f_register(L"module"sv, &v_module);
-	a_module.f_register(L"read"sv, &v_read);
-	a_module.f_register(L"eval"sv, &v_eval);
-	a_module.f_register(L"print"sv, &v_print);
-	a_module.f_register(L"call-with-prompt"sv, &prompt::v_call);
-	a_module.f_register(L"abort-to-prompt"sv, &prompt::v_abort);
-	a_module.f_register(L"error"sv, &v_error);
-	a_module.f_register(L"catch"sv, &v_catch);
+	for (auto& x : v_builtins) a_module.f_register(x.first, x.second);
+	a_module.v_engine.v_passes.assign(std::begin(v_passes), std::end(v_passes));
 }
 
 }
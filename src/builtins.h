@@ -1,12 +1,60 @@
 #ifndef LILIS__BUILTINS_H
 #define LILIS__BUILTINS_H
 
-#include "engine.h"
+#include "code.h"
 
 namespace lilis
 {
 
+struct t_macro : t_with_value<t_object_of<t_macro>, t_holder<t_code>>
+{
+	using t_base::t_base;
+	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair);
+};
+
+// A procedure made by define-record for v_type.
+// Calls to it with the right number of arguments are compiled to the instruction of v_kind, which checks the type of a record at once.
+struct t_record_procedure : t_object_of<t_record_procedure>
+{
+	enum t_kind
+	{
+		e_kind__CONSTRUCTOR,
+		e_kind__PREDICATE,
+		e_kind__ACCESSOR,
+		e_kind__MODIFIER
+	};
+
+	t_symbol* v_name;
+	t_record_type* v_type;
+	t_kind v_kind;
+	size_t v_index;
+
+	t_record_procedure(t_symbol* a_name, t_record_type* a_type, t_kind a_kind, size_t a_index) : v_name(a_name), v_type(a_type), v_kind(a_kind), v_index(a_index)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector)
+	{
+		v_name = a_collector.f_forward(v_name);
+		v_type = a_collector.f_forward(v_type);
+	}
+	virtual void f_call(t_engine& a_engine, size_t a_arguments);
+	virtual void f_dump(const t_dump& a_dump) const;
+	// Returns a_value if it is a record of v_type.
+	t_record* f_record(t_object* a_value) const
+	{
+		if (!a_value || gc::f_is_immediate(a_value) || typeid(*a_value) != typeid(t_record)) return nullptr;
+		auto p = static_cast<t_record*>(a_value);
+		return p->v_type == v_type ? p : nullptr;
+	}
+};
+
+t_symbol* f_gensym(t_engine& a_engine);
+t_object* f_builtin(std::wstring_view a_name);
+std::wstring_view f_builtin(t_object* a_value);
 t_object* f_unquasiquote(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_object* a_value);
+// The instruction a call to a_value with a_arguments arguments is compiled to, or e_instruction__END if none.
+t_instruction f_instruction(t_object* a_value, size_t a_arguments);
+bool f_inlinable(t_object* a_value);
 void f_define_builtins(t_module& a_module);
 
 }
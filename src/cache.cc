@@ -0,0 +1,970 @@
+#include "cache.h"
+#include "builtins.h"
+#include "numbers.h"
+#include "parser.h"
+#include <fstream>
+
+namespace lilis
+{
+
+namespace
+{
+
+constexpr std::string_view c_MAGIC = "lilis\x07"sv;
+
+enum t_tag
+{
+	e_tag__NIL,
+	e_tag__REFERENCE,
+	e_tag__SYMBOL,
+	e_tag__GENSYM,
+	e_tag__PAIR,
+	e_tag__PARSED_PAIR,
+	e_tag__CONSTANT,
+	e_tag__QUOTE,
+	e_tag__UNQUOTE,
+	e_tag__UNQUOTE_SPLICING,
+	e_tag__QUASIQUOTE,
+	e_tag__BUILTIN,
+	e_tag__MODULE,
+	e_tag__IMPORTED,
+	e_tag__VARIABLE,
+	e_tag__SET,
+	e_tag__MACRO,
+	e_tag__CODE,
+	e_tag__FIXNUM,
+	e_tag__FLOAT,
+	e_tag__STRING,
+	e_tag__BIGNUM,
+	e_tag__RECORD_TYPE,
+	e_tag__RECORD_PROCEDURE
+};
+
+enum t_location_tag
+{
+	e_location_tag__REFERENCE,
+	e_location_tag__FILE,
+	e_location_tag__TEXT
+};
+
+// Module references are 0 for the module being cached, 1 for the global module, and 2 + an index to the dependencies.
+enum
+{
+	e_module__THIS,
+	e_module__GLOBAL,
+	e_module__DEPENDENCY
+};
+
+struct t_invalid
+{
+};
+
+struct t_unserializable
+{
+};
+
+uint64_t f_hash(uint64_t a_hash, std::string_view a_bytes)
+{
+	for (unsigned char c : a_bytes) a_hash = (a_hash ^ c) * 0x100000001b3;
+	return a_hash;
+}
+
+uint64_t f_hash(uint64_t a_hash, uint64_t a_value)
+{
+	return f_hash(a_hash, {reinterpret_cast<const char*>(&a_value), sizeof(a_value)});
+}
+
+constexpr uint64_t c_HASH = 0xcbf29ce484222325;
+
+bool f_read(const std::filesystem::path& a_path, std::string& a_bytes)
+{
+	std::ifstream in(a_path, std::ios_base::binary);
+	if (!in) return false;
+	a_bytes.assign(std::istreambuf_iterator<char>(in), {});
+	return !in.bad();
+}
+
+struct t_stamp
+{
+	uint64_t v_time;
+	uint64_t v_size;
+
+	static t_stamp f_of(const std::filesystem::path& a_path)
+	{
+		return {static_cast<uint64_t>(std::filesystem::last_write_time(a_path).time_since_epoch().count()), std::filesystem::file_size(a_path)};
+	}
+};
+
+struct t_output
+{
+	std::string v_bytes;
+
+	void f_byte(uint8_t a_value)
+	{
+		v_bytes.push_back(a_value);
+	}
+	void f_size(uint64_t a_value)
+	{
+		for (; a_value >= 0x80; a_value >>= 7) f_byte(a_value | 0x80);
+		f_byte(a_value);
+	}
+	void f_fixed(uint64_t a_value)
+	{
+		for (size_t i = 0; i < 8; ++i, a_value >>= 8) f_byte(a_value);
+	}
+	void f_string(std::wstring_view a_value)
+	{
+		f_size(a_value.size());
+		for (auto c : a_value) f_size(c);
+	}
+};
+
+struct t_input
+{
+	std::string_view v_bytes;
+	size_t v_i;
+
+	uint8_t f_byte()
+	{
+		if (v_i >= v_bytes.size()) throw t_invalid();
+		return v_bytes[v_i++];
+	}
+	uint64_t f_size()
+	{
+		uint64_t value = 0;
+		for (size_t shift = 0;; shift += 7) {
+			if (shift >= 64) throw t_invalid();
+			uint64_t c = f_byte();
+			value |= (c & 0x7f) << shift;
+			if (c < 0x80) return value;
+		}
+	}
+	uint64_t f_fixed()
+	{
+		uint64_t value = 0;
+		for (size_t i = 0; i < 8; ++i) value |= uint64_t(f_byte()) << i * 8;
+		return value;
+	}
+	std::wstring f_string()
+	{
+		auto n = f_size();
+		if (n > v_bytes.size() - v_i) throw t_invalid();
+		std::wstring s;
+		s.reserve(n);
+		for (size_t i = 0; i < n; ++i) s.push_back(static_cast<wchar_t>(f_size()));
+		return s;
+	}
+};
+
+struct t_at_text : t_location
+{
+	std::wstring v_text;
+
+	t_at_text(std::wstring&& a_text) : v_text(std::move(a_text))
+	{
+	}
+	virtual std::shared_ptr<t_location> f_at_head(t_pair* a_pair)
+	{
+		return shared_from_this();
+	}
+	virtual std::shared_ptr<t_location> f_at_tail(t_pair* a_pair)
+	{
+		return shared_from_this();
+	}
+	virtual void f_dump(const t_dump& a_dump) const
+	{
+		a_dump << v_text;
+	}
+};
+
+struct t_writer : t_output
+{
+	t_engine& v_engine;
+	t_holder<t_module>* v_module;
+	std::vector<t_holder<t_module>*> v_dependencies;
+	std::map<t_object*, std::pair<t_holder<t_module>*, t_symbol*>> v_imported;
+	std::map<t_object*, size_t> v_objects;
+	std::map<std::tuple<std::wstring, long, size_t, size_t>, size_t> v_files;
+	std::map<t_location*, size_t> v_texts;
+	size_t v_locations = 0;
+
+	t_writer(t_engine& a_engine, t_holder<t_module>* a_module) : v_engine(a_engine), v_module(a_module)
+	{
+		for (auto x : (*a_module)->v_dependencies) f_dependency(x);
+		for (auto& [name, module] : a_engine.v_modules) {
+			if (module == a_module) continue;
+			for (auto& [symbol, value] : **module) v_imported.emplace(value, std::make_pair(module, symbol));
+		}
+	}
+	size_t f_dependency(t_holder<t_module>* a_module)
+	{
+		auto i = std::find(v_dependencies.begin(), v_dependencies.end(), a_module);
+		if (i != v_dependencies.end()) return i - v_dependencies.begin();
+		v_dependencies.push_back(a_module);
+		return v_dependencies.size() - 1;
+	}
+	void f_module(t_holder<t_module>* a_module)
+	{
+		if (a_module == v_module) {
+			f_size(e_module__THIS);
+		} else if (a_module == v_engine.v_global) {
+			f_size(e_module__GLOBAL);
+		} else {
+			if ((*a_module)->v_entry == decltype(t_module::v_entry){}) throw t_unserializable();
+			f_size(e_module__DEPENDENCY + f_dependency(a_module));
+		}
+	}
+	bool f_reference(t_object* a_value)
+	{
+		auto i = v_objects.find(a_value);
+		if (i == v_objects.end()) return false;
+		f_byte(e_tag__REFERENCE);
+		f_size(i->second);
+		return true;
+	}
+	void f_define(t_object* a_value)
+	{
+		v_objects.emplace(a_value, v_objects.size());
+	}
+	void f_at(const t_at& a_at)
+	{
+		f_size(a_at.v_position);
+		f_size(a_at.v_line);
+		f_size(a_at.v_column);
+	}
+	void f_object(t_object* a_value);
+	void f_code(t_holder<t_code>* a_value);
+	void f_location(const std::shared_ptr<t_location>& a_value);
+};
+
+void t_writer::f_object(t_object* a_value)
+{
+	if (!a_value) return f_byte(e_tag__NIL);
+	if (f_is_fixnum(a_value)) {
+		f_byte(e_tag__FIXNUM);
+		return f_fixed(f_fixnum_value(a_value));
+	}
+	if (f_is_float(a_value)) {
+		f_byte(e_tag__FLOAT);
+		double value;
+		if (!f_double(v_engine, a_value, value)) throw t_unserializable();
+		return f_fixed(std::bit_cast<uint64_t>(value));
+	}
+	if (auto p = f_as<t_bignum>(a_value)) {
+		f_byte(e_tag__BIGNUM);
+		f_byte(p->v_negative);
+		f_size(p->v_size);
+		for (size_t i = 0; i < p->v_size; ++i) f_size(p->f_digits()[i]);
+		return;
+	}
+	if (auto p = f_as<t_string>(a_value)) {
+		f_byte(e_tag__STRING);
+		f_size(p->v_size);
+		v_bytes += p->f_view();
+		return;
+	}
+	if (f_reference(a_value)) return;
+	auto name = f_builtin(a_value);
+	if (!name.empty()) {
+		f_byte(e_tag__BUILTIN);
+		return f_string(name);
+	}
+	if (auto i = v_imported.find(a_value); i != v_imported.end()) {
+		f_byte(e_tag__IMPORTED);
+		f_module(i->second.first);
+		return f_object(i->second.second);
+	}
+	if (auto p = f_as<t_symbol>(a_value)) {
+		if (p->v_entry == decltype(p->v_entry){}) {
+			f_byte(e_tag__GENSYM);
+			return f_define(p);
+		}
+		f_byte(e_tag__SYMBOL);
+		return f_string(p->v_entry->first);
+	}
+	if (auto p = f_as<t_holder<t_code>>(a_value)) return f_code(p);
+	if (auto p = f_as<t_module::t_variable::t_set>(a_value)) {
+		f_byte(e_tag__SET);
+		f_object(p->v_value);
+		return f_define(p);
+	}
+	if (auto p = f_as<t_module::t_variable>(a_value)) {
+		f_byte(e_tag__VARIABLE);
+		return f_define(p);
+	}
+	if (auto p = f_as<t_macro>(a_value)) {
+		f_byte(e_tag__MACRO);
+		f_object(p->v_value);
+		return f_define(p);
+	}
+	if (auto p = f_as<t_record_type>(a_value)) {
+		f_byte(e_tag__RECORD_TYPE);
+		f_object(p->v_name);
+		f_size(p->v_size);
+		return f_define(p);
+	}
+	if (auto p = f_as<t_record_procedure>(a_value)) {
+		f_byte(e_tag__RECORD_PROCEDURE);
+		f_object(p->v_name);
+		f_object(p->v_type);
+		f_byte(p->v_kind);
+		f_size(p->v_index);
+		return f_define(p);
+	}
+	if (auto p = f_as<t_holder<t_module>>(a_value)) {
+		f_byte(e_tag__MODULE);
+		return f_module(p);
+	}
+	if (auto p = dynamic_cast<t_parsed_pair<std::filesystem::path>*>(a_value)) {
+		f_byte(e_tag__PARSED_PAIR);
+		f_object(p->v_head);
+		f_object(p->v_tail);
+		f_string(p->v_source->wstring());
+		f_at(p->v_where_head);
+		f_at(p->v_where_tail);
+		return f_define(p);
+	}
+	auto& type = typeid(*a_value);
+	if (type == typeid(t_pair)) {
+		auto p = static_cast<t_pair*>(a_value);
+		f_byte(v_engine.v_constants.f_interned(p) ? e_tag__CONSTANT : e_tag__PAIR);
+		f_object(p->v_head);
+		f_object(p->v_tail);
+		return f_define(p);
+	}
+	auto quote = [&](t_tag a_tag, t_object* a_quoted)
+	{
+		f_byte(a_tag);
+		f_object(a_quoted);
+		f_define(a_value);
+	};
+	if (type == typeid(t_quote)) return quote(e_tag__QUOTE, static_cast<t_quote*>(a_value)->v_value);
+	if (type == typeid(t_unquote)) return quote(e_tag__UNQUOTE, static_cast<t_unquote*>(a_value)->v_value);
+	if (type == typeid(t_unquote_splicing)) return quote(e_tag__UNQUOTE_SPLICING, static_cast<t_unquote*>(a_value)->v_value);
+	if (type == typeid(t_quasiquote)) return quote(e_tag__QUASIQUOTE, static_cast<t_quasiquote*>(a_value)->v_value);
+	throw t_unserializable();
+}
+
+void t_writer::f_code(t_holder<t_code>* a_value)
+{
+	f_byte(e_tag__CODE);
+	f_define(a_value);
+	auto& code = **a_value;
+	f_object(code.v_outer);
+	f_module(code.v_module);
+	f_size(code.v_imports.size());
+	for (auto x : code.v_imports) f_module(x);
+	f_size(code.v_locals.size());
+	for (auto x : code.v_locals) f_object(x);
+	f_size(code.v_arguments);
+	f_byte(code.v_rest);
+	f_byte(code.v_macro);
+	f_size(code.v_stack);
+	auto& instructions = code.v_instructions;
+	f_size(instructions.size());
+	auto variable = code.v_variables.begin();
+	for (size_t i = 0; i < instructions.size();) {
+		// Reads linked by t_engine::f_link are saved as they were emitted.
+		if (variable != code.v_variables.end() && variable->first == i) {
+			f_size(e_instruction__VARIABLE);
+			f_object(variable++->second);
+			i += 2;
+			continue;
+		}
+		auto instruction = static_cast<t_instruction>(reinterpret_cast<intptr_t>(instructions[i++]));
+		f_size(instruction);
+		for (auto c : f_operands(instruction)) {
+			auto p = instructions[i++];
+			switch (c) {
+			case 'o':
+				f_object(static_cast<t_object*>(p));
+				break;
+			case 'l':
+				f_size(static_cast<void**>(p) - instructions.data());
+				break;
+			default:
+				f_size(reinterpret_cast<size_t>(p));
+			}
+		}
+	}
+	f_size(code.v_locations.size());
+	size_t address = 0;
+	for (auto& x : code.v_locations) {
+		f_size(x.v_address - address);
+		address = x.v_address;
+		f_location(x.v_location);
+	}
+}
+
+void t_writer::f_location(const std::shared_ptr<t_location>& a_value)
+{
+	if (auto p = dynamic_cast<t_at_file*>(a_value.get())) {
+		auto key = std::make_tuple(p->v_path.wstring(), p->v_at.v_position, p->v_at.v_line, p->v_at.v_column);
+		auto i = v_files.lower_bound(key);
+		if (i != v_files.end() && i->first == key) {
+			f_byte(e_location_tag__REFERENCE);
+			return f_size(i->second);
+		}
+		v_files.emplace_hint(i, key, v_locations++);
+		f_byte(e_location_tag__FILE);
+		f_string(p->v_path.wstring());
+		return f_at(p->v_at);
+	}
+	auto i = v_texts.lower_bound(a_value.get());
+	if (i != v_texts.end() && i->first == a_value.get()) {
+		f_byte(e_location_tag__REFERENCE);
+		return f_size(i->second);
+	}
+	v_texts.emplace_hint(i, a_value.get(), v_locations++);
+	std::wstring text;
+	a_value->f_dump({[&](auto x)
+	{
+		text += x;
+	}, [&](auto)
+	{
+	}, [&](auto)
+	{
+	}});
+	f_byte(e_location_tag__TEXT);
+	f_string(text);
+}
+
+struct t_reader : t_input, gc::t_root
+{
+	t_engine& v_engine;
+	t_holder<t_module>* v_module;
+	std::vector<t_object*> v_objects;
+	std::vector<std::shared_ptr<t_location>> v_locations;
+
+	t_reader(std::string_view a_bytes, size_t a_i, t_engine& a_engine, t_holder<t_module>* a_module) : t_input{a_bytes, a_i}, gc::t_root(a_engine), v_engine(a_engine), v_module(a_module)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector)
+	{
+		v_module = a_collector.f_forward(v_module);
+		for (auto& x : v_objects) x = a_collector.f_forward(x);
+	}
+	template<typename T>
+	T* f_define(T* a_value)
+	{
+		v_objects.push_back(a_value);
+		return a_value;
+	}
+	template<typename T>
+	T* f_expect(t_object* a_value)
+	{
+		auto p = f_as<T>(a_value);
+		if (!p) throw t_invalid();
+		return p;
+	}
+	t_holder<t_module>* f_module()
+	{
+		auto i = f_size();
+		if (i == e_module__THIS) return v_module;
+		if (i == e_module__GLOBAL) return v_engine.v_global;
+		i -= e_module__DEPENDENCY;
+		auto& dependencies = (*v_module)->v_dependencies;
+		if (i >= dependencies.size()) throw t_invalid();
+		return dependencies[i];
+	}
+	t_at f_at()
+	{
+		t_at at;
+		at.v_position = f_size();
+		at.v_line = f_size();
+		at.v_column = f_size();
+		return at;
+	}
+	t_object* f_object();
+	t_holder<t_code>* f_code();
+	std::shared_ptr<t_location> f_location();
+};
+
+t_object* t_reader::f_object()
+{
+	auto& engine = v_engine;
+	switch (f_byte()) {
+	case e_tag__NIL:
+		return nullptr;
+	case e_tag__REFERENCE:
+		{
+			auto i = f_size();
+			if (i >= v_objects.size()) throw t_invalid();
+			return v_objects[i];
+		}
+	case e_tag__SYMBOL:
+		return engine.f_symbol(f_string());
+	case e_tag__FIXNUM:
+		{
+			auto value = static_cast<intptr_t>(f_fixed());
+			if (value < c_FIXNUM_MIN || value > c_FIXNUM_MAX) throw t_invalid();
+			return f_fixnum(value);
+		}
+	case e_tag__FLOAT:
+		return f_float(engine, std::bit_cast<double>(f_fixed()));
+	case e_tag__BIGNUM:
+		{
+			t_integer value;
+			value.v_negative = f_byte();
+			auto n = f_size();
+			if (n > v_bytes.size() - v_i) throw t_invalid();
+			for (size_t i = 0; i < n; ++i) {
+				auto digit = f_size();
+				if (digit > UINT32_MAX) throw t_invalid();
+				value.v_digits.push_back(digit);
+			}
+			if (value.v_digits.empty() || value.v_digits.back() == 0) throw t_invalid();
+			return value.f_object(engine);
+		}
+	case e_tag__STRING:
+		{
+			auto n = f_size();
+			if (n > v_bytes.size() - v_i) throw t_invalid();
+			v_i += n;
+			return t_string::f_new(engine, v_bytes.substr(v_i - n, n));
+		}
+	case e_tag__GENSYM:
+		return f_define(f_gensym(engine));
+	case e_tag__PAIR:
+		{
+			auto head = engine.f_pointer(f_object());
+			auto tail = engine.f_pointer(f_object());
+			return f_define(engine.f_new<t_pair>(head, tail));
+		}
+	case e_tag__CONSTANT:
+		{
+			auto head = engine.f_pointer(f_object());
+			auto tail = f_object();
+			return f_define(engine.v_constants.f_pair(head, tail));
+		}
+	case e_tag__PARSED_PAIR:
+		{
+			auto head = engine.f_pointer(f_object());
+			auto tail = engine.f_pointer(f_object());
+			auto source = std::make_shared<const std::filesystem::path>(f_string());
+			auto where_head = f_at();
+			auto p = engine.f_new<t_parsed_pair<std::filesystem::path>>(head, source, where_head);
+			p->v_tail = tail;
+			p->v_where_tail = f_at();
+			return f_define(p);
+		}
+	case e_tag__QUOTE:
+		return f_define(engine.f_new<t_quote>(engine.f_pointer(f_object())));
+	case e_tag__UNQUOTE:
+		return f_define(engine.f_new<t_unquote>(engine.f_pointer(f_object())));
+	case e_tag__UNQUOTE_SPLICING:
+		return f_define(engine.f_new<t_unquote_splicing>(engine.f_pointer(f_object())));
+	case e_tag__QUASIQUOTE:
+		return f_define(engine.f_new<t_quasiquote>(engine.f_pointer(f_object())));
+	case e_tag__BUILTIN:
+		if (auto p = f_builtin(f_string())) return p;
+		throw t_invalid();
+	case e_tag__MODULE:
+		return f_module();
+	case e_tag__IMPORTED:
+		{
+			auto module = f_module();
+			auto symbol = f_expect<t_symbol>(f_object());
+			auto i = (*module)->find(symbol);
+			if (i == (*module)->end()) throw t_invalid();
+			return i->second;
+		}
+	case e_tag__VARIABLE:
+		return f_define(engine.f_new<t_module::t_variable>(nullptr));
+	case e_tag__SET:
+		return f_define(engine.f_new<t_module::t_variable::t_set>(engine.f_pointer(f_expect<t_module::t_variable>(f_object()))));
+	case e_tag__MACRO:
+		return f_define(engine.f_new<t_macro>(engine.f_pointer(f_expect<t_holder<t_code>>(f_object()))));
+	case e_tag__RECORD_TYPE:
+		{
+			auto name = engine.f_pointer(f_expect<t_symbol>(f_object()));
+			return f_define(engine.f_new<t_record_type>(name, f_size()));
+		}
+	case e_tag__RECORD_PROCEDURE:
+		{
+			auto name = engine.f_pointer(f_expect<t_symbol>(f_object()));
+			auto type = engine.f_pointer(f_expect<t_record_type>(f_object()));
+			auto kind = f_byte();
+			auto index = f_size();
+			if (kind > t_record_procedure::e_kind__MODIFIER || (kind >= t_record_procedure::e_kind__ACCESSOR && index >= type->v_size)) throw t_invalid();
+			return f_define(engine.f_new<t_record_procedure>(name, type, static_cast<t_record_procedure::t_kind>(kind), index));
+		}
+	case e_tag__CODE:
+		return f_code();
+	default:
+		throw t_invalid();
+	}
+}
+
+// Throws t_invalid unless the instructions reachable in a_code stay within the code.
+// The stack depth is traced along every path from the entry so that it is the same at each instruction, within v_stack, and deep enough for what the instruction takes.
+// a_starts marks where the instructions start, to which labels must point.
+void f_verify(t_code& a_code, const std::vector<bool>& a_starts)
+{
+	auto& instructions = a_code.v_instructions;
+	auto n = instructions.size();
+	if (a_code.v_stack > n) throw t_invalid();
+	auto size = [&](size_t a_i)
+	{
+		return reinterpret_cast<size_t>(instructions[a_i]);
+	};
+	auto object = [&](size_t a_i)
+	{
+		return static_cast<t_object*>(instructions[a_i]);
+	};
+	auto label = [&](size_t a_i)
+	{
+		size_t target = static_cast<void**>(instructions[a_i]) - instructions.data();
+		if (!a_starts[target]) throw t_invalid();
+		return target;
+	};
+	constexpr auto unknown = ~size_t(0);
+	std::vector<size_t> depths(n, unknown);
+	std::vector<size_t> pendings;
+	auto flow = [&](size_t a_i, size_t a_depth)
+	{
+		if (a_i >= n) throw t_invalid();
+		if (depths[a_i] == unknown) {
+			depths[a_i] = a_depth;
+			pendings.push_back(a_i);
+		} else if (depths[a_i] != a_depth) {
+			throw t_invalid();
+		}
+	};
+	flow(0, 0);
+	while (!pendings.empty()) {
+		auto i = pendings.back();
+		pendings.pop_back();
+		auto depth = depths[i];
+		// Pops a_pop values and then pushes a_push values.
+		auto take = [&](size_t a_pop, size_t a_push)
+		{
+			if (depth < a_pop) throw t_invalid();
+			depth += a_push - a_pop;
+			if (depth > a_code.v_stack) throw t_invalid();
+		};
+		auto procedure = [&](t_record_procedure::t_kind a_kind)
+		{
+			auto p = f_as<t_record_procedure>(object(i + 1));
+			if (!p || p->v_kind != a_kind) throw t_invalid();
+			return p;
+		};
+		auto instruction = static_cast<t_instruction>(size(i));
+		auto next = i + 1 + f_operands(instruction).size();
+		switch (instruction) {
+		case e_instruction__POP:
+			take(1, 0);
+			break;
+		case e_instruction__PUSH:
+			take(0, 1);
+			break;
+		case e_instruction__GET:
+		case e_instruction__SET:
+			{
+				auto code = &a_code;
+				for (auto outer = size(i + 1); outer > 0; --outer) {
+					if (!code->v_outer) throw t_invalid();
+					code = &**code->v_outer;
+				}
+				if (size(i + 2) >= code->v_locals.size()) throw t_invalid();
+				if (instruction == e_instruction__GET)
+					take(0, 1);
+				else
+					take(1, 1);
+			}
+			break;
+		case e_instruction__CALL:
+		case e_instruction__CALL_WITH_EXPANSION:
+			// The arguments and then the callee.
+			take(size(i + 1), 0);
+			take(1, 1);
+			break;
+		case e_instruction__CALL_TAIL:
+		case e_instruction__CALL_TAIL_WITH_EXPANSION:
+			take(size(i + 1), 0);
+			take(1, 0);
+			continue;
+		case e_instruction__RETURN:
+			take(1, 0);
+			continue;
+		case e_instruction__LAMBDA:
+		case e_instruction__LAMBDA_WITH_REST:
+			{
+				auto p = f_as<t_holder<t_code>>(object(i + 1));
+				if (!p || (*p)->v_outer != a_code.v_this) throw t_invalid();
+				take(0, 1);
+			}
+			break;
+		case e_instruction__JUMP:
+			flow(label(i + 1), depth);
+			continue;
+		case e_instruction__BRANCH:
+			take(1, 0);
+			flow(label(i + 1), depth);
+			break;
+		case e_instruction__LOOP:
+			if (size(i + 1) > a_code.v_locals.size()) throw t_invalid();
+			take(size(i + 1), 0);
+			continue;
+		case e_instruction__GUARD:
+			if (!f_as<t_module::t_variable>(object(i + 1))) throw t_invalid();
+			flow(label(i + 3), depth);
+			break;
+		case e_instruction__VARIABLE:
+			if (!f_as<t_module::t_variable>(object(i + 1))) throw t_invalid();
+			take(0, 1);
+			break;
+		case e_instruction__LIST:
+			take(size(i + 1), 1);
+			break;
+		case e_instruction__LIST_WITH_TAIL:
+			if (size(i + 1) < 1) throw t_invalid();
+			take(size(i + 1), 1);
+			break;
+		case e_instruction__RECORD_NEW:
+			take(procedure(t_record_procedure::e_kind__CONSTRUCTOR)->v_type->v_size, 1);
+			break;
+		case e_instruction__RECORD_IS:
+			procedure(t_record_procedure::e_kind__PREDICATE);
+			take(1, 1);
+			break;
+		case e_instruction__RECORD_GET:
+			procedure(t_record_procedure::e_kind__ACCESSOR);
+			take(1, 1);
+			break;
+		case e_instruction__RECORD_SET:
+			procedure(t_record_procedure::e_kind__MODIFIER);
+			take(2, 1);
+			break;
+		default:
+			// Arithmetics and comparisons.
+			take(2, 1);
+		}
+		flow(next, depth);
+	}
+}
+
+t_holder<t_code>* t_reader::f_code()
+{
+	auto& engine = v_engine;
+	auto index = v_objects.size();
+	f_define(engine.f_new<t_holder<t_code>>(engine, nullptr, nullptr));
+	// The holder may move whenever an object is read.
+	auto code = [&]() -> t_code&
+	{
+		return **static_cast<t_holder<t_code>*>(v_objects[index]);
+	};
+	if (auto outer = f_object()) code().v_outer = f_expect<t_holder<t_code>>(outer);
+	code().v_module = f_module();
+	for (auto n = f_size(); n > 0; --n) code().v_imports.push_back(f_module());
+	for (auto n = f_size(); n > 0; --n) {
+		auto local = f_expect<t_symbol>(f_object());
+		code().v_locals.push_back(local);
+	}
+	code().v_arguments = f_size();
+	code().v_rest = f_byte();
+	if (code().v_arguments + (code().v_rest ? 1 : 0) > code().v_locals.size()) throw t_invalid();
+	code().v_macro = f_byte();
+	code().v_stack = f_size();
+	auto n = f_size();
+	if (n > v_bytes.size() - v_i) throw t_invalid();
+	code().v_instructions.resize(n);
+	std::vector<bool> starts(n);
+	for (size_t i = 0; i < n;) {
+		starts[i] = true;
+		auto instruction = f_size();
+		if (instruction >= e_instruction__END) throw t_invalid();
+		code().v_instructions[i++] = reinterpret_cast<void*>(instruction);
+		for (auto c : f_operands(static_cast<t_instruction>(instruction))) {
+			if (i >= n) throw t_invalid();
+			switch (c) {
+			case 'o':
+				{
+					auto p = f_object();
+					code().v_objects.push_back(i);
+					code().v_instructions[i] = p;
+				}
+				break;
+			case 'l':
+				{
+					auto target = f_size();
+					if (target >= n) throw t_invalid();
+					code().v_instructions[i] = code().v_instructions.data() + target;
+				}
+				break;
+			default:
+				code().v_instructions[i] = reinterpret_cast<void*>(f_size());
+			}
+			++i;
+		}
+	}
+	f_verify(code(), starts);
+	size_t address = 0;
+	for (auto n = f_size(); n > 0; --n) {
+		auto delta = f_size();
+		if (delta > code().v_instructions.size() - address) throw t_invalid();
+		address += delta;
+		auto location = f_location();
+		code().v_locations.push_back({address, location});
+	}
+	code().f_record_variables();
+	return static_cast<t_holder<t_code>*>(v_objects[index]);
+}
+
+std::shared_ptr<t_location> t_reader::f_location()
+{
+	switch (f_byte()) {
+	case e_location_tag__REFERENCE:
+		{
+			auto i = f_size();
+			if (i >= v_locations.size()) throw t_invalid();
+			return v_locations[i];
+		}
+	case e_location_tag__FILE:
+		{
+			std::filesystem::path path = f_string();
+			return v_locations.emplace_back(std::make_shared<t_at_file>(path, f_at()));
+		}
+	case e_location_tag__TEXT:
+		return v_locations.emplace_back(std::make_shared<t_at_text>(f_string()));
+	default:
+		throw t_invalid();
+	}
+}
+
+}
+
+t_cache::t_cache(t_engine& a_engine, const std::filesystem::path& a_source) : v_engine(a_engine), v_source(a_source)
+{
+	if (v_engine.v_cache.empty()) return;
+	std::wstring name = v_source.stem().wstring() + L"-";
+	auto hash = f_hash(c_HASH, v_source.string());
+	for (size_t i = 0; i < 16; ++i, hash >>= 4) name.push_back(L"0123456789abcdef"[hash & 15]);
+	v_path = v_engine.v_cache / (name + L".lilisc");
+}
+
+bool t_cache::f_open()
+{
+	if (v_path.empty() || !f_read(v_path, v_image)) return false;
+	try {
+		t_input input{v_image, 0};
+		for (auto c : c_MAGIC) if (input.f_byte() != static_cast<uint8_t>(c)) return false;
+		if (input.f_string() != v_source.wstring()) return false;
+		auto time = input.f_fixed();
+		auto size = input.f_fixed();
+		auto hash = input.f_fixed();
+		auto stamp = t_stamp::f_of(v_source);
+		if (stamp.v_time != time || stamp.v_size != size) {
+			std::string source;
+			if (!f_read(v_source, source) || f_hash(c_HASH, source) != hash) return false;
+		}
+		v_hash = hash;
+		v_hashed = true;
+		v_body = input.v_i;
+		return true;
+	} catch (t_invalid&) {
+		return false;
+	} catch (std::filesystem::filesystem_error&) {
+		return false;
+	}
+}
+
+t_holder<t_code>* t_cache::f_load(t_holder<t_module>* a_module)
+{
+	auto& engine = v_engine;
+	auto module = v_engine.f_pointer(a_module);
+	auto& dependencies = (*module)->v_dependencies;
+	try {
+		t_reader reader(v_image, v_body, v_engine, module);
+		auto hash = reader.f_fixed();
+		for (auto n = reader.f_size(); n > 0; --n) {
+			auto name = reader.f_string();
+			std::filesystem::path directory = reader.f_string();
+			auto dependency = v_engine.f_module(directory, name);
+			dependencies.push_back(dependency);
+			if ((*dependency)->v_hash != reader.f_fixed()) throw t_invalid();
+		}
+		if (reader.f_byte() != e_tag__CODE) throw t_invalid();
+		auto index = reader.v_objects.size();
+		reader.f_code();
+		for (auto n = reader.f_size(); n > 0; --n) {
+			auto symbol = engine.f_pointer(reader.f_expect<t_symbol>(reader.f_object()));
+			auto value = reader.f_object();
+			(*module)->f_export(symbol, value);
+		}
+		if (reader.v_i != v_image.size()) throw t_invalid();
+		auto code = static_cast<t_holder<t_code>*>(reader.v_objects[index]);
+		(*module)->v_hash = hash;
+		if (v_engine.v_verbose) std::cerr << "cache loaded: " << v_path << std::endl;
+		return code;
+	} catch (t_invalid&) {
+		(*module)->clear();
+		++v_engine.v_exports;
+		dependencies.clear();
+		if (v_engine.v_verbose) std::cerr << "cache invalid: " << v_path << std::endl;
+		return nullptr;
+	}
+}
+
+void t_cache::f_store(t_holder<t_module>* a_module, t_holder<t_code>* a_code)
+{
+	if (v_path.empty()) return;
+	auto& module = **a_module;
+	t_stamp stamp;
+	try {
+		stamp = t_stamp::f_of(v_source);
+		if (!v_hashed) {
+			std::string source;
+			if (!f_read(v_source, source)) return;
+			v_hash = f_hash(c_HASH, source);
+		}
+	} catch (std::filesystem::filesystem_error&) {
+		return;
+	}
+	t_writer writer(v_engine, a_module);
+	auto hash = [&]
+	{
+		auto hash = f_hash(c_HASH, v_hash);
+		for (auto x : writer.v_dependencies) hash = f_hash(hash, (*x)->v_hash);
+		return hash;
+	};
+	try {
+		writer.f_code(a_code);
+		writer.f_size(module.size());
+		for (auto& x : module) {
+			writer.f_object(x.first);
+			writer.f_object(x.second);
+		}
+	} catch (t_unserializable&) {
+		module.v_hash = hash();
+		if (v_engine.v_verbose) std::cerr << "cache unavailable: " << v_source << std::endl;
+		return;
+	}
+	module.v_hash = hash();
+	t_output output;
+	for (auto c : c_MAGIC) output.f_byte(c);
+	output.f_string(v_source.wstring());
+	output.f_fixed(stamp.v_time);
+	output.f_fixed(stamp.v_size);
+	output.f_fixed(v_hash);
+	output.f_fixed(module.v_hash);
+	output.f_size(writer.v_dependencies.size());
+	for (auto x : writer.v_dependencies) {
+		output.f_string((*x)->v_entry->first);
+		output.f_string((*x)->v_path.parent_path().wstring());
+		output.f_fixed((*x)->v_hash);
+	}
+	std::error_code error;
+	std::filesystem::create_directories(v_engine.v_cache, error);
+	auto temporary = v_path;
+	temporary += ".tmp";
+	{
+		std::ofstream out(temporary, std::ios_base::binary | std::ios_base::trunc);
+		if (!out) return;
+		out << output.v_bytes << writer.v_bytes;
+		if (!out) return;
+	}
+	std::filesystem::rename(temporary, v_path, error);
+}
+
+}
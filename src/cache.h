@@ -0,0 +1,29 @@
+#ifndef LILIS__CACHE_H
+#define LILIS__CACHE_H
+
+#include "code.h"
+
+namespace lilis
+{
+
+// Saves compiled modules to and loads them from t_engine::v_cache.
+// A cached module is valid as long as its source and the hashes of its dependencies are unchanged.
+struct t_cache
+{
+	t_engine& v_engine;
+	std::filesystem::path v_source;
+	std::filesystem::path v_path;
+	uint64_t v_hash = 0;
+	bool v_hashed = false;
+	std::string v_image;
+	size_t v_body = 0;
+
+	t_cache(t_engine& a_engine, const std::filesystem::path& a_source);
+	bool f_open();
+	t_holder<t_code>* f_load(t_holder<t_module>* a_module);
+	void f_store(t_holder<t_module>* a_module, t_holder<t_code>* a_code);
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include "code.h"
+#include "builtins.h"
 #include <fstream>
 
 namespace lilis
@@ -11,7 +12,10 @@ void t_error::t_holder::f_destruct(gc::t_collector& a_collector)
 
 void t_error::t_holder::f_dump(const t_dump& a_dump) const
 {
-	v_value->f_dump(a_dump);
+	if (v_value)
+		v_value->f_dump(a_dump);
+	else
+		a_dump << v_failure.f_message() << L"\n"sv;
 }
 
 void t_error::f_dump(const t_dump& a_dump) const
@@ -20,55 +24,135 @@ void t_error::f_dump(const t_dump& a_dump) const
 	for (auto& x : v_backtrace) x->f_dump(a_dump);
 }
 
-namespace
+void t_module::t_variable::t_set::f_call(t_engine& a_engine, size_t a_arguments)
 {
+	a_engine.v_used[-1] = v_value->v_value = *--a_engine.v_used;
+	++v_value->v_version;
+	if (v_value->v_constant) v_value->f_unlink(a_engine);
+}
 
-template<typename T>
-struct t_with_expression : t_with_value<t_object_of<t_with_expression<T>>, T>
+void t_module::t_variable::t_set::f_dump(const t_dump& a_dump) const
 {
-	t_object* v_expression;
-
-	t_with_expression(T* a_value, t_object* a_expression) : t_with_value<t_object_of<t_with_expression<T>>, T>(a_value), v_expression(a_expression)
-	{
-	}
-	virtual void f_scan(gc::t_collector& a_collector)
-	{
-		t_with_value<t_object_of<t_with_expression<T>>, T>::f_scan(a_collector);
-		v_expression = a_collector.f_forward(v_expression);
-	}
-};
-
+	a_dump << L"#set!"sv;
 }
 
 t_object* t_module::t_variable::f_render(t_code& a_code, t_object* a_expression)
 {
-	struct t_set : t_with_expression<t_variable>
+	struct t_node : t_with_expression<t_set>
 	{
-		using t_with_expression<t_variable>::t_with_expression;
+		using t_with_expression<t_set>::t_with_expression;
 		virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 		{
-			a_emit(e_instruction__PUSH, a_stack + 1)(this);
+			a_emit(e_instruction__PUSH, a_stack + 1)(v_value);
 			v_expression->f_emit(a_emit, a_stack + 1, false);
 			a_emit(a_tail ? e_instruction__CALL_TAIL : e_instruction__CALL, a_stack + 1)(1);
 		}
-		virtual void f_call(t_engine& a_engine, size_t a_arguments)
+		virtual void f_dump(const t_dump& a_dump) const
 		{
-			a_engine.v_used[-1] = v_value->v_value = *--a_engine.v_used;
+			a_dump << L"(set! "sv << v_value->v_value << L" "sv << v_expression << L")"sv;
 		}
 	};
 	auto& engine = a_code.v_engine;
-	return engine.f_new<t_set>(engine.f_pointer(this), engine.f_pointer(a_expression));
+	auto expression = engine.f_pointer(a_expression);
+	auto set = engine.f_pointer(engine.f_new<t_set>(engine.f_pointer(this)));
+	return engine.f_node<t_node>(set, expression);
+}
+
+t_object* t_module::t_variable::f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
+{
+	auto lambda = dynamic_cast<t_lambda*>(v_value);
+	if (a_code.v_inlining > 0 || !lambda || typeid(*lambda) != typeid(t_lambda) || !(*lambda->v_code)->v_inline) return t_object::f_apply(a_code, a_location, a_pair);
+	auto& callee = **lambda->v_code;
+	size_t n = 0;
+	for (auto p = a_pair->v_tail; p; p = static_cast<t_pair*>(p)->v_tail, ++n)
+		if (!f_as<t_pair>(p)) return t_object::f_apply(a_code, a_location, a_pair);
+	if (n != callee.v_arguments) return t_object::f_apply(a_code, a_location, a_pair);
+	for (auto& x : callee.v_resolved)
+		if (auto p = dynamic_cast<t_code::t_local*>(x.second))
+			if (*p->v_value != &callee && p->v_mutated) return t_object::f_apply(a_code, a_location, a_pair);
+	auto& engine = a_code.v_engine;
+	auto thiz = engine.f_pointer(this);
+	auto pair = engine.f_pointer(a_pair);
+	auto code = engine.f_pointer(lambda->v_code);
+	auto block = engine.f_pointer(engine.f_node<t_pair>(nullptr, nullptr));
+	auto last = engine.f_pointer(block.v_value);
+	for (auto arguments = engine.f_pointer(pair->v_tail); arguments; arguments = static_cast<t_pair*>(arguments.v_value)->v_tail) {
+		auto p = static_cast<t_pair*>(arguments.v_value);
+		engine.f_push_node(last, a_code.f_render(p->v_head, a_location->f_at_head(p)));
+	}
+	auto call = engine.f_pointer(engine.f_node<t_pair>(thiz, nullptr));
+	last = call.v_value;
+	a_code.v_shadows.push_back(std::move(a_code.v_bindings));
+	a_code.v_bindings.clear();
+	++a_code.v_inlining;
+	auto restore = [&]
+	{
+		--a_code.v_inlining;
+		a_code.v_bindings = std::move(a_code.v_shadows.back());
+		a_code.v_shadows.pop_back();
+	};
+	try {
+		auto argument = engine.f_pointer(block.v_value);
+		for (size_t i = 0; i < n; ++i) {
+			auto local = engine.f_pointer(engine.f_new<t_code::t_local>(a_code.v_this, a_code.v_locals.size()));
+			auto symbol = (*code)->v_locals[i];
+			a_code.v_bindings.insert_or_assign(symbol, local);
+			a_code.v_locals.push_back(symbol);
+			argument = static_cast<t_pair*>(argument->v_tail);
+			auto value = local->f_render(a_code, argument->v_head);
+			argument->v_head = value;
+			engine.f_push_node(last, local);
+		}
+		// The only other locals are the ones the lambda is defined to, which are never set! and refer to this variable's value.
+		for (auto& x : (*code)->v_resolved) {
+			auto p = dynamic_cast<t_code::t_local*>(x.second);
+			if (!p)
+				a_code.v_bindings.emplace(x.first, x.second);
+			else if (*p->v_value != *code)
+				a_code.v_bindings.emplace(x.first, thiz);
+		}
+		auto inline_ = engine.f_pointer(a_code.f_render((*code)->v_inline, a_location));
+		restore();
+		auto call_ = engine.f_pointer(engine.f_node<t_call>(call, a_location));
+		return engine.f_node<t_guard>(engine.f_pointer(static_cast<t_pair*>(block->v_tail)), thiz, thiz->v_version, inline_, call_);
+	} catch (...) {
+		restore();
+		throw;
+	}
 }
 
 void t_module::t_variable::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 {
-	a_emit(e_instruction__PUSH, a_stack + 1)(this);
-	a_emit(a_tail ? e_instruction__CALL_TAIL : e_instruction__CALL, a_stack + 1)(size_t(0));
+	a_emit(e_instruction__VARIABLE, a_stack + 1)(this);
+}
+
+void t_module::t_variable::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#variable"sv;
 }
 
-void t_module::t_variable::f_call(t_engine& a_engine, size_t a_arguments)
+void t_module::t_variable::f_unlink(t_engine& a_engine)
 {
-	a_engine.v_used[-1] = v_value;
+	v_constant = false;
+	for (auto code : a_engine.v_readers)
+		for (auto [i, variable] : code->v_variables)
+			if (variable == this && code->v_instructions[i] == reinterpret_cast<void*>(e_instruction__PUSH)) {
+				code->v_instructions[i] = reinterpret_cast<void*>(e_instruction__VARIABLE);
+				code->v_instructions[i + 1] = this;
+			}
+}
+
+void t_lambda_with_rest::f_call_with_expansion(t_engine& a_engine, size_t a_arguments)
+{
+	// A list spread only into the rest parameter is taken as the tail of the rest list without being copied.
+	if (a_arguments - 1 < (*v_code)->v_arguments) return t_object::f_call_with_expansion(a_engine, a_arguments);
+	auto last = *--a_engine.v_used;
+	for (auto p = last; p; p = static_cast<t_pair*>(p)->v_tail)
+		if (!f_as<t_pair>(p)) {
+			a_engine.v_used -= a_arguments;
+			return void(a_engine.f_fail_cast<t_pair>());
+		}
+	(*v_code)->f_call(true, v_scope, a_arguments - 1, last);
 }
 
 size_t t_scope::f_size() const
@@ -79,8 +163,7 @@ size_t t_scope::f_size() const
 void t_scope::f_scan(gc::t_collector& a_collector)
 {
 	v_outer = a_collector.f_forward(v_outer);
-	auto p = f_locals();
-	for (size_t i = 0; i < v_size; ++i) p[i] = a_collector.f_forward(p[i]);
+	a_collector.f_forward(f_locals(), v_size);
 }
 
 size_t t_code::t_local::f_outer(t_code* a_code) const
@@ -102,9 +185,13 @@ t_object* t_code::t_local::f_render(t_code& a_code, t_object* a_expression)
 			v_expression->f_emit(a_emit, a_stack, false);
 			a_emit(e_instruction__SET, a_stack + 1)(v_value->f_outer(a_emit.v_code))(v_value->v_index);
 		}
+		virtual void f_dump(const t_dump& a_dump) const
+		{
+			a_dump << L"(set! "sv << v_value << L" "sv << v_expression << L")"sv;
+		}
 	};
 	auto& engine = a_code.v_engine;
-	return engine.f_new<t_set>(engine.f_pointer(this), engine.f_pointer(a_expression));
+	return engine.f_node<t_set>(engine.f_pointer(this), engine.f_pointer(a_expression));
 }
 
 void t_code::t_local::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
@@ -112,6 +199,11 @@ void t_code::t_local::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 	a_emit(e_instruction__GET, a_stack + 1)(f_outer(a_emit.v_code))(v_index);
 }
 
+void t_code::t_local::f_dump(const t_dump& a_dump) const
+{
+	a_dump << (*v_value)->v_locals[v_index];
+}
+
 void t_code::f_scan()
 {
 	v_this = v_engine.f_forward(v_this);
@@ -120,36 +212,126 @@ void t_code::f_scan()
 	for (auto& x : v_imports) x = v_engine.f_forward(x);
 	for (auto& x : v_locals) x = v_engine.f_forward(x);
 	v_bindings.f_scan(v_engine);
+	for (auto& x : v_shadows) x.f_scan(v_engine);
+	v_index.f_scan(v_engine);
+	v_self = v_engine.f_forward(v_self);
+	for (auto& x : v_recursions) x = v_engine.f_forward(x);
+	v_defining = v_engine.f_forward(v_defining);
+	v_definition = v_engine.f_forward(v_definition);
+	v_resolved.f_scan(v_engine);
+	v_inline = v_engine.f_forward(v_inline);
+	for (auto& x : v_variables) x.second = v_engine.f_forward(x.second);
 	for (auto i : v_objects) v_instructions[i] = v_engine.f_forward(static_cast<t_object*>(v_instructions[i]));
 }
 
-t_object* t_code::f_resolve(t_symbol* a_symbol, const std::shared_ptr<t_location>& a_location) const
+void t_code::f_record_variables()
+{
+	for (size_t i = 0; i < v_instructions.size();) {
+		auto instruction = static_cast<t_instruction>(reinterpret_cast<intptr_t>(v_instructions[i]));
+		if (instruction == e_instruction__VARIABLE) v_variables.emplace_back(i, static_cast<t_module::t_variable*>(v_instructions[i + 1]));
+		i += 1 + f_operands(instruction).size();
+	}
+	if (v_variables.empty()) return;
+	v_engine.v_readers.insert(this);
+	for (size_t i = 0; i < v_variables.size(); ++i) v_unlinked.push_back(i);
+	v_engine.v_linking.insert(this);
+}
+
+void t_code::f_import(t_holder<t_module>* a_module)
+{
+	v_imports.push_back(a_module);
+	if (!v_indexed) return;
+	auto& bindings = v_shadows.empty() ? v_bindings : v_shadows.front();
+	for (auto& [symbol, value] : **a_module) if (!bindings.f_find(symbol)) v_index.f_assign(symbol, value);
+}
+
+t_object* t_code::f_resolve(t_symbol* a_symbol, const std::shared_ptr<t_location>& a_location)
 {
 	return a_location->f_try([&]
 	{
 		for (auto code = this;; code = *code->v_outer) {
-			if (auto p = code->v_bindings.f_find(a_symbol)) return p;
-			for (auto i = code->v_imports.rbegin(); i != code->v_imports.rend(); ++i)
-				if (auto p = (**i)->f_find(a_symbol)) return p;
+			if (code->v_imports.empty()) {
+				if (auto p = code->v_bindings.f_find(a_symbol)) return p;
+				for (auto i = code->v_shadows.rbegin(); i != code->v_shadows.rend(); ++i)
+					if (auto p = i->f_find(a_symbol)) return p;
+			} else {
+				if (!code->v_shadows.empty()) {
+					if (auto p = code->v_bindings.f_find(a_symbol)) return p;
+					for (auto i = code->v_shadows.rbegin(); i + 1 != code->v_shadows.rend(); ++i)
+						if (auto p = i->f_find(a_symbol)) return p;
+				}
+				if (code->v_indexed && code->v_indexed_version != v_engine.v_exports) {
+					code->v_index.clear();
+					code->v_indexed = false;
+				}
+				if (!code->v_indexed) {
+					for (auto x : code->v_imports)
+						for (auto& [symbol, value] : **x) code->v_index.f_assign(symbol, value);
+					for (auto& [symbol, value] : code->v_shadows.empty() ? code->v_bindings : code->v_shadows.front()) code->v_index.f_assign(symbol, value);
+					code->v_indexed = true;
+					code->v_indexed_version = v_engine.v_exports;
+				}
+				if (auto p = code->v_index.f_find(a_symbol)) return p;
+			}
 			if (!code->v_outer) throw t_error{L"not found"s};
 		}
 	});
 }
 
+namespace
+{
+
+// Whether a_value has no more than a_budget pairs.
+bool f_small(t_object* a_value, size_t& a_budget)
+{
+	auto p = f_as<t_pair>(a_value);
+	if (!p) return true;
+	if (a_budget == 0) return false;
+	--a_budget;
+	return f_small(p->v_head, a_budget) && f_small(p->v_tail, a_budget);
+}
+
+}
+
+t_object* t_code::f_optimize(t_object* a_node)
+{
+	auto node = v_engine.f_pointer(a_node);
+	auto dump = [&](const wchar_t* a_when, const t_pass& a_pass)
+	{
+		std::wcerr << a_pass.v_name << a_when << L":\n\t" << node.v_value << std::endl;
+	};
+	for (auto& x : v_engine.v_passes) {
+		if (v_engine.v_dump_passes) dump(L" before", x);
+		node = node->f_optimize(*this, x);
+		if (v_engine.v_dump_passes) dump(L" after", x);
+	}
+	return node;
+}
+
 void t_code::f_compile_body(const std::shared_ptr<t_location>& a_location, t_pair* a_body)
 {
 	t_emit emit{this};
 	if (a_body) {
 		auto body = v_engine.f_pointer(a_body);
 		for (; body->v_tail; body = a_location->f_cast_tail<t_pair>(body)) {
-			f_render(body->v_head, a_location->f_at_head(body))->f_emit(emit, 0, false);
+			t_compilation compilation(v_engine);
+			f_optimize(f_render(body->v_head, a_location->f_at_head(body)))->f_emit(emit, 0, false);
 			emit(e_instruction__POP, 0);
 		}
-		f_render(body->v_head, a_location->f_at_head(body))->f_emit(emit, 0, true);
+		t_compilation compilation(v_engine);
+		f_optimize(f_render(body->v_head, a_location->f_at_head(body)))->f_emit(emit, 0, true);
 	} else {
 		emit(e_instruction__PUSH, 1)(static_cast<t_object*>(nullptr));
 	}
 	emit.f_end();
+	for (auto x : v_recursions) {
+		auto& code = **x;
+		if (!code.v_self->v_mutated)
+			for (auto i : code.v_loops) code.v_instructions[i] = reinterpret_cast<void*>(e_instruction__LOOP);
+		code.v_self = nullptr;
+		code.v_loops.clear();
+	}
+	v_recursions.clear();
 }
 
 void t_code::f_compile(const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
@@ -157,7 +339,7 @@ void t_code::f_compile(const std::shared_ptr<t_location>& a_location, t_pair* a_
 	auto body = v_engine.f_pointer(a_location->f_cast_tail<t_pair>(a_pair));
 	auto location = a_location->f_at_head(body);
 	for (auto arguments = v_engine.f_pointer(body->v_head); arguments;) {
-		auto symbol = v_engine.f_pointer(dynamic_cast<t_symbol*>(arguments.v_value));
+		auto symbol = v_engine.f_pointer(f_as<t_symbol>(arguments.v_value));
 		if (symbol) {
 			v_rest = true;
 			arguments = nullptr;
@@ -173,6 +355,16 @@ void t_code::f_compile(const std::shared_ptr<t_location>& a_location, t_pair* a_
 	}
 	location = a_location->f_at_tail(body);
 	f_compile_body(location, body->v_tail ? location->f_cast<t_pair>(body->v_tail) : nullptr);
+	auto expressions = static_cast<t_pair*>(body->v_tail);
+	size_t budget = 32;
+	if (!v_rest && v_locals.size() == v_arguments && expressions && !expressions->v_tail && f_small(expressions->v_head, budget) && std::all_of(v_resolved.begin(), v_resolved.end(), [&](auto& x)
+	{
+		auto p = dynamic_cast<t_local*>(x.second);
+		return p ? *p->v_value == this || (p == v_self && !(*p->v_value)->v_outer) : f_inlinable(x.second);
+	}))
+		v_inline = expressions->v_head;
+	else
+		v_resolved.clear();
 }
 
 std::shared_ptr<t_location> t_code::f_location(void** a_address) const
@@ -267,15 +459,251 @@ void t_at_expression::f_dump(const t_dump& a_dump) const
 	f_dump_at_expression(a_dump, v_expression) << L"\t^\n"sv;
 }
 
+// Threads jumps, turns jumps to RETURN into RETURN, and removes unreachable code, jumps to the next instruction and pushes immediately popped.
+// Labels, object operands, locations and self tail calls are remapped to the compacted instructions.
+void t_emit::f_peephole()
+{
+	auto& instructions = v_code->v_instructions;
+	auto n = instructions.size();
+	auto at = [&](size_t a_i)
+	{
+		return static_cast<t_instruction>(reinterpret_cast<intptr_t>(instructions[a_i]));
+	};
+	std::vector<char> dead(n);
+	auto skip = [&](size_t a_i)
+	{
+		while (a_i < n && dead[a_i]) a_i += 1 + f_operands(at(a_i)).size();
+		return a_i;
+	};
+	std::map<size_t, size_t> jumps;
+	auto kill = [&](size_t a_i)
+	{
+		auto operands = f_operands(at(a_i));
+		for (size_t i = 0; i < operands.size(); ++i) if (operands[i] == 'l') jumps.erase(a_i + 1 + i);
+		std::fill_n(dead.begin() + a_i, 1 + operands.size(), true);
+	};
+	for (auto& x : v_labels) for (auto i : x) jumps.emplace(i, x.v_target);
+	for (auto changed = true; changed;) {
+		changed = false;
+		for (auto& x : jumps) {
+			auto target = skip(x.second);
+			for (size_t i = 0; i < n && target < n && at(target) == e_instruction__JUMP; ++i) target = skip(jumps.at(target + 1));
+			if (target != x.second) {
+				x.second = target;
+				changed = true;
+			}
+		}
+		std::vector<char> targeted(n + 1);
+		for (auto& x : jumps) targeted[x.second] = true;
+		auto unreachable = false;
+		for (size_t i = skip(0); i < n; i = skip(i)) {
+			auto instruction = at(i);
+			auto next = skip(i + 1 + f_operands(instruction).size());
+			if (unreachable && !targeted[i]) {
+				kill(i);
+				changed = true;
+				i = next;
+				continue;
+			}
+			unreachable = false;
+			switch (instruction) {
+			case e_instruction__PUSH:
+			case e_instruction__GET:
+			case e_instruction__VARIABLE:
+				if (next < n && at(next) == e_instruction__POP && !targeted[next]) {
+					kill(i);
+					kill(next);
+					changed = true;
+				}
+				break;
+			case e_instruction__JUMP:
+				if (jumps.at(i + 1) == next) {
+					kill(i);
+					changed = true;
+					break;
+				}
+				if (at(jumps.at(i + 1)) == e_instruction__RETURN) {
+					jumps.erase(i + 1);
+					instructions[i] = reinterpret_cast<void*>(e_instruction__RETURN);
+					instructions[i + 1] = reinterpret_cast<void*>(e_instruction__POP);
+					dead[i + 1] = true;
+					changed = true;
+				}
+				unreachable = true;
+				break;
+			case e_instruction__BRANCH:
+				if (jumps.at(i + 1) == next) {
+					jumps.erase(i + 1);
+					instructions[i] = reinterpret_cast<void*>(e_instruction__POP);
+					instructions[i + 1] = reinterpret_cast<void*>(e_instruction__POP);
+					dead[i + 1] = true;
+					changed = true;
+				}
+				break;
+			case e_instruction__CALL_TAIL:
+			case e_instruction__CALL_TAIL_WITH_EXPANSION:
+			case e_instruction__RETURN:
+			case e_instruction__LOOP:
+			case e_instruction__END:
+				unreachable = true;
+				break;
+			default:
+				break;
+			}
+			i = next;
+		}
+	}
+	std::vector<size_t> map(n + 1);
+	size_t m = 0;
+	for (size_t i = 0; i < n; ++i) {
+		map[i] = m;
+		if (!dead[i]) instructions[m++] = instructions[i];
+	}
+	map[n] = m;
+	instructions.resize(m);
+	v_labels.clear();
+	for (auto& x : jumps) {
+		auto& label = v_labels.emplace_back();
+		label.push_back(map[x.first]);
+		label.v_target = map[x.second];
+	}
+	auto& objects = v_code->v_objects;
+	objects.erase(std::remove_if(objects.begin(), objects.end(), [&](auto x)
+	{
+		return dead[x];
+	}), objects.end());
+	for (auto& x : objects) x = map[x];
+	for (auto& x : v_code->v_locations) x.v_address = map[x.v_address];
+	auto& loops = v_code->v_loops;
+	loops.erase(std::remove_if(loops.begin(), loops.end(), [&](auto x)
+	{
+		return dead[x];
+	}), loops.end());
+	for (auto& x : loops) x = map[x];
+}
+
+t_object* t_call::f_optimize(t_code& a_code, const t_pass& a_pass)
+{
+	auto& engine = a_code.v_engine;
+	auto thiz = engine.f_pointer(this);
+	for (auto p = engine.f_pointer(v_value); p; p = static_cast<t_pair*>(p->v_tail)) {
+		auto x = p->v_head->f_optimize(a_code, a_pass);
+		p->v_head = x;
+	}
+	return a_pass.v_rewrite(a_code, thiz);
+}
+
 void t_call::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 {
+	size_t arguments = 0;
+	for (auto p = static_cast<t_pair*>(v_value->v_tail); p; p = static_cast<t_pair*>(p->v_tail)) ++arguments;
+	if (auto instruction = v_expand ? e_instruction__END : f_instruction(v_value->v_head, arguments); instruction != e_instruction__END) {
+		auto n = a_stack;
+		for (auto p = static_cast<t_pair*>(v_value->v_tail); p; p = static_cast<t_pair*>(p->v_tail)) p->v_head->f_emit(a_emit, n++, false);
+		a_emit(instruction, a_stack + 1);
+		if (!f_operands(instruction).empty()) a_emit(v_value->v_head);
+		a_emit.f_at(v_location);
+		return;
+	}
 	v_value->v_head->f_emit(a_emit, a_stack, false);
 	auto n = a_stack;
 	for (auto p = static_cast<t_pair*>(v_value->v_tail); p; p = static_cast<t_pair*>(p->v_tail)) p->v_head->f_emit(a_emit, ++n, false);
 	int instruction = v_expand ? e_instruction__CALL_WITH_EXPANSION : e_instruction__CALL;
-	if (a_tail) instruction += e_instruction__CALL_TAIL - e_instruction__CALL;
+	if (a_tail) {
+		instruction += e_instruction__CALL_TAIL - e_instruction__CALL;
+		auto code = a_emit.v_code;
+		if (!v_expand && v_value->v_head == code->v_self && !code->v_rest && n - a_stack == code->v_arguments) code->v_loops.push_back(code->v_instructions.size());
+	}
 	a_emit(static_cast<t_instruction>(instruction), a_stack + 1)(n - a_stack);
 	a_emit.f_at(v_location);
 }
 
+void t_call::f_dump(const t_dump& a_dump) const
+{
+	a_dump << v_value;
+}
+
+void t_guard::f_scan(gc::t_collector& a_collector)
+{
+	t_base::f_scan(a_collector);
+	v_variable = a_collector.f_forward(v_variable);
+	v_inline = a_collector.f_forward(v_inline);
+	v_call = a_collector.f_forward(v_call);
+}
+
+t_object* t_guard::f_optimize(t_code& a_code, const t_pass& a_pass)
+{
+	auto& engine = a_code.v_engine;
+	auto thiz = engine.f_pointer(this);
+	for (auto p = engine.f_pointer(v_value); p; p = static_cast<t_pair*>(p->v_tail)) {
+		auto x = p->v_head->f_optimize(a_code, a_pass);
+		p->v_head = x;
+	}
+	auto inline_ = thiz->v_inline->f_optimize(a_code, a_pass);
+	thiz->v_inline = inline_;
+	auto call = thiz->v_call->f_optimize(a_code, a_pass);
+	thiz->v_call = call;
+	return a_pass.v_rewrite(a_code, thiz);
+}
+
+void t_guard::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
+{
+	for (auto p = v_value; p; p = static_cast<t_pair*>(p->v_tail)) {
+		p->v_head->f_emit(a_emit, a_stack, false);
+		a_emit(e_instruction__POP, a_stack);
+	}
+	auto& label0 = a_emit.v_labels.emplace_back();
+	a_emit(e_instruction__GUARD, a_stack)(v_variable)(v_version)(label0);
+	v_inline->f_emit(a_emit, a_stack, a_tail);
+	auto& label1 = a_emit.v_labels.emplace_back();
+	a_emit(e_instruction__JUMP, a_stack)(label1);
+	label0.v_target = a_emit.v_code->v_instructions.size();
+	v_call->f_emit(a_emit, a_stack, a_tail);
+	label1.v_target = a_emit.v_code->v_instructions.size();
+}
+
+void t_guard::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"(guard"sv;
+	for (auto p = v_value; p; p = static_cast<t_pair*>(p->v_tail)) a_dump << L" "sv << p->v_head;
+	a_dump << L" "sv << v_inline << L" "sv << v_call << L")"sv;
+}
+
+void t_list::f_scan(gc::t_collector& a_collector)
+{
+	t_base::f_scan(a_collector);
+	v_tail = a_collector.f_forward(v_tail);
+}
+
+t_object* t_list::f_optimize(t_code& a_code, const t_pass& a_pass)
+{
+	auto& engine = a_code.v_engine;
+	auto thiz = engine.f_pointer(this);
+	for (auto p = engine.f_pointer(v_value); p; p = static_cast<t_pair*>(p->v_tail)) {
+		auto x = p->v_head->f_optimize(a_code, a_pass);
+		p->v_head = x;
+	}
+	if (thiz->v_tail) {
+		auto tail = thiz->v_tail->f_optimize(a_code, a_pass);
+		thiz->v_tail = tail;
+	}
+	return a_pass.v_rewrite(a_code, thiz);
+}
+
+void t_list::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
+{
+	auto n = a_stack;
+	for (auto p = v_value; p; p = static_cast<t_pair*>(p->v_tail)) p->v_head->f_emit(a_emit, ++n, false);
+	if (v_tail) v_tail->f_emit(a_emit, ++n, false);
+	a_emit(v_tail ? e_instruction__LIST_WITH_TAIL : e_instruction__LIST, a_stack + 1)(n - a_stack);
+}
+
+void t_list::f_dump(const t_dump& a_dump) const
+{
+	a_dump << (v_tail ? L"(#list*"sv : L"(#list"sv);
+	for (auto p = v_value; p; p = static_cast<t_pair*>(p->v_tail)) a_dump << L" "sv << p->v_head;
+	if (v_tail) a_dump << L" "sv << v_tail;
+	a_dump << L")"sv;
+}
+
 }
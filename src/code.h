@@ -3,6 +3,7 @@
 
 #include "engine.h"
 #include <list>
+#include <unordered_map>
 #include <vector>
 
 namespace lilis
@@ -12,13 +13,22 @@ struct t_error
 {
 	struct t_holder : t_object_of<t_holder>
 	{
-		t_error* v_value;
+		t_failure v_failure;
+		t_error* v_value = nullptr;
 
 		t_holder(t_error&& a_value) : v_value(new t_error(std::move(a_value)))
 		{
 		}
+		t_holder(const t_failure& a_failure) : v_failure(a_failure)
+		{
+		}
 		virtual void f_destruct(gc::t_collector& a_collector);
 		virtual void f_dump(const t_dump& a_dump) const;
+		t_error& f_value()
+		{
+			if (!v_value) v_value = new t_error{v_failure.f_message()};
+			return *v_value;
+		}
 	};
 
 	std::wstring v_message;
@@ -27,6 +37,22 @@ struct t_error
 	void f_dump(const t_dump& a_dump) const;
 };
 
+template<typename T>
+struct t_with_expression : t_with_value<t_object_of<t_with_expression<T>>, T>
+{
+	t_object* v_expression;
+
+	t_with_expression(T* a_value, t_object* a_expression) : t_with_value<t_object_of<t_with_expression<T>>, T>(a_value), v_expression(a_expression)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector)
+	{
+		t_with_value<t_object_of<t_with_expression<T>>, T>::f_scan(a_collector);
+		v_expression = a_collector.f_forward(v_expression);
+	}
+	virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass);
+};
+
 struct t_bindings : std::map<t_symbol*, t_object*>
 {
 	void f_scan(gc::t_collector& a_collector)
@@ -42,6 +68,24 @@ struct t_bindings : std::map<t_symbol*, t_object*>
 	}
 };
 
+// Bindings keyed by the names of symbols, which stay in place while the symbols are moved by the collector.
+struct t_index : std::unordered_map<const std::wstring*, t_object*>
+{
+	void f_scan(gc::t_collector& a_collector)
+	{
+		for (auto& x : *this) x.second = a_collector.f_forward(x.second);
+	}
+	t_object* f_find(t_symbol* a_symbol) const
+	{
+		auto i = find(&a_symbol->v_entry->first);
+		return i == end() ? nullptr : i->second;
+	}
+	void f_assign(t_symbol* a_symbol, t_object* a_value)
+	{
+		insert_or_assign(&a_symbol->v_entry->first, a_value);
+	}
+};
+
 struct t_mutable
 {
 	virtual t_object* f_render(t_code& a_code, t_object* a_expression) = 0;
@@ -51,16 +95,29 @@ struct t_module : t_bindings
 {
 	struct t_variable : t_with_value<t_object_of<t_variable>, t_object>, t_mutable
 	{
+		struct t_set;
+
+		// Counts assignments so that inlined calls can check that the value is still the one inlined.
+		size_t v_version = 0;
+		// Counts set! nodes to this variable including the one made by export.
+		size_t v_sets = 0;
+		// Whether t_engine::f_link has replaced reads of this variable with its value.
+		bool v_constant = false;
+
 		using t_base::t_base;
 		virtual t_object* f_render(t_code& a_code, t_object* a_expression);
+		virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair);
 		virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail);
-		virtual void f_call(t_engine& a_engine, size_t a_arguments);
+		virtual void f_dump(const t_dump& a_dump) const;
+		void f_unlink(t_engine& a_engine);
 	};
 
 	t_engine& v_engine;
 	t_holder<t_module>* v_this;
 	std::filesystem::path v_path;
 	std::map<std::wstring, t_holder<t_module>*, std::less<>>::iterator v_entry;
+	uint64_t v_hash = 0;
+	std::vector<t_holder<t_module>*> v_dependencies;
 
 	t_module(t_engine& a_engine, t_holder<t_module>* a_this, const std::filesystem::path& a_path) : v_engine(a_engine), v_this(a_this), v_path(a_path)
 	{
@@ -74,18 +131,39 @@ struct t_module : t_bindings
 		t_bindings::f_scan(v_engine);
 		v_this = v_engine.f_forward(v_this);
 		if (v_entry != decltype(v_entry){}) v_entry->second = v_this;
+		for (auto& x : v_dependencies) x = v_engine.f_forward(x);
 	}
 	void f_register(std::wstring_view a_name, t_object* a_value)
 	{
 		auto value = v_engine.f_pointer(a_value);
 		emplace(v_engine.f_symbol(a_name), value);
+		++v_engine.v_exports;
+	}
+	void f_export(t_symbol* a_symbol, t_object* a_value)
+	{
+		insert_or_assign(a_symbol, a_value);
+		++v_engine.v_exports;
 	}
 };
 
+// Called with a value to assign it to the variable.
+// It is referred to from the emitted code, so the expression is kept by a separate node.
+struct t_module::t_variable::t_set : t_with_value<t_object_of<t_set>, t_variable>
+{
+	t_set(t_variable* a_value) : t_base(a_value)
+	{
+		++a_value->v_sets;
+	}
+	virtual void f_call(t_engine& a_engine, size_t a_arguments);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
 struct t_scope : t_object_of<t_scope>
 {
 	t_scope* v_outer;
-	size_t v_size;
+	uint32_t v_size;
+	// Set once a closure or a continuation may refer to this scope, which then must not be reused by a self tail call.
+	bool v_captured = false;
 
 	t_scope(t_scope* a_outer, size_t a_size, t_object** a_stack, size_t a_arguments) : v_outer(a_outer), v_size(a_size)
 	{
@@ -104,6 +182,7 @@ struct t_code
 	struct t_local : t_with_value<t_object_of<t_local>, t_holder<t_code>>, t_mutable
 	{
 		size_t v_index;
+		bool v_mutated = false;
 
 		t_local(t_holder<t_code>* a_code, size_t a_index) : t_base(a_code), v_index(a_index)
 		{
@@ -111,6 +190,7 @@ struct t_code
 		size_t f_outer(t_code* a_code) const;
 		virtual t_object* f_render(t_code& a_code, t_object* a_expression);
 		virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail);
+		virtual void f_dump(const t_dump& a_dump) const;
 	};
 	struct t_address_location
 	{
@@ -133,20 +213,57 @@ struct t_code
 	bool v_rest = false;
 	bool v_macro = false;
 	t_bindings v_bindings;
+	// Outer layers of bindings while the bodies of immediately applied lambdas are rendered into this code.
+	std::vector<t_bindings> v_shadows;
+	// The outermost layer of bindings merged over v_imports so that a symbol not in the inner layers is resolved by a single probe.
+	// Built at the first resolution in a code with imports, kept up to date by f_bind and f_import, and rebuilt once any module has changed.
+	t_index v_index;
+	bool v_indexed = false;
+	// t_engine::v_exports when v_index was built.
+	size_t v_indexed_version = 0;
 	std::vector<void*> v_instructions;
 	std::vector<size_t> v_objects;
 	std::vector<t_address_location> v_locations;
 	size_t v_stack = 1;
+	// Self tail call tracking, only alive while the enclosing code is compiled.
+	// v_self is the local this code is bound to by (define symbol (lambda ...)), and v_loops are the addresses of CALL_TAIL to it.
+	// v_recursions are the inner codes which have such calls, patched to LOOP at the end of this code unless their locals are set!.
+	t_local* v_self = nullptr;
+	std::vector<size_t> v_loops;
+	std::vector<t_holder<t_code>*> v_recursions;
+	t_local* v_defining = nullptr;
+	t_object* v_definition = nullptr;
+	// Symbols resolved while compiling the body, kept with the body in v_inline if it is small enough to be inlined at calls through module variables.
+	t_bindings v_resolved;
+	t_object* v_inline = nullptr;
+	size_t v_inlining = 0;
+	// The addresses of VARIABLE instructions with their variables, registered in t_engine::v_readers.
+	std::vector<std::pair<size_t, t_module::t_variable*>> v_variables;
+	// The indices to v_variables of the reads which t_engine::f_link may still link, registered in t_engine::v_linking while any.
+	std::vector<size_t> v_unlinked;
 
 	t_code(t_engine& a_engine, t_holder<t_code>* a_this, t_holder<t_code>* a_outer, t_holder<t_module>* a_module) : v_engine(a_engine), v_this(a_this), v_outer(a_outer), v_module(a_module)
 	{
 	}
+	~t_code()
+	{
+		if (!v_variables.empty()) v_engine.v_readers.erase(this);
+		if (!v_unlinked.empty()) v_engine.v_linking.erase(this);
+	}
 	void f_scan();
+	void f_record_variables();
 	t_object* f_render(t_object* a_value, const std::shared_ptr<t_location>& a_location)
 	{
-		return a_value ? a_value->f_render(*this, a_location) : v_engine.f_new<t_quote>(nullptr);
+		return a_value && !gc::f_is_immediate(a_value) ? a_value->f_render(*this, a_location) : v_engine.f_node<t_quote>(a_value);
 	}
-	t_object* f_resolve(t_symbol* a_symbol, const std::shared_ptr<t_location>& a_location) const;
+	// Called after a_symbol is bound in v_bindings.
+	void f_bind(t_symbol* a_symbol)
+	{
+		if (v_indexed && v_shadows.empty()) v_index.f_assign(a_symbol, v_bindings.f_find(a_symbol));
+	}
+	void f_import(t_holder<t_module>* a_module);
+	t_object* f_resolve(t_symbol* a_symbol, const std::shared_ptr<t_location>& a_location);
+	t_object* f_optimize(t_object* a_node);
 	void f_compile_body(const std::shared_ptr<t_location>& a_location, t_pair* a_body);
 	void f_compile(const std::shared_ptr<t_location>& a_location, t_pair* a_pair);
 	t_holder<t_code>* f_new() const
@@ -154,25 +271,27 @@ struct t_code
 		return v_engine.f_new<t_holder<t_code>>(v_engine, v_this, v_module);
 	}
 	std::shared_ptr<t_location> f_location(void** a_address) const;
-	void f_call(bool a_rest, t_scope* a_outer, size_t a_arguments)
+	// a_tail is a list which the rest of the arguments ends with.
+	void f_call(bool a_rest, t_scope* a_outer, size_t a_arguments, t_object* a_tail = nullptr)
 	{
 		auto used = v_engine.v_used - a_arguments;
+		if (a_rest ? a_arguments < v_arguments : a_arguments != v_arguments) {
+			v_engine.v_used = used - 1;
+			v_engine.f_fail(a_rest ? L"too few arguments"sv : L"wrong number of arguments"sv);
+			return;
+		}
 		try {
-			if (a_rest) {
-				if (a_arguments < v_arguments) throw t_error{L"too few arguments"s};
-			} else {
-				if (a_arguments != v_arguments) throw t_error{L"wrong number of arguments"s};
-			}
 			auto scope = v_engine.f_pointer(a_outer);
+			auto tail = v_engine.f_pointer(a_tail);
 			auto p = v_engine.f_allocate(sizeof(t_scope) + sizeof(t_object) * v_locals.size());
 			scope = new(p) t_scope(scope, v_locals.size(), used, v_arguments);
 			if (a_rest) {
-				auto tail = v_engine.f_pointer(scope->f_locals()[v_arguments]);
-				for (auto p = used + v_arguments; v_engine.v_used != p; --v_engine.v_used)
-					tail = scope->f_locals()[v_arguments] = v_engine.f_new<t_pair>(v_engine.v_used[-1], tail);
+				auto rest = v_engine.f_list(used + v_arguments, a_arguments - v_arguments, tail);
+				scope->f_locals()[v_arguments] = rest;
 			}
 			v_engine.v_used = used--;
-			if (used + v_stack > v_engine.v_stack.get() + t_engine::c_STACK || v_engine.v_frame <= v_engine.v_frames.get()) throw t_error{L"stack overflow"s};
+			if (used + v_stack >= v_engine.v_stack_tail) v_engine.f_grow_stack(used + v_stack + 1);
+			if (v_engine.v_frame <= v_engine.v_frames_head) v_engine.f_grow_frames(v_engine.v_frame - 1);
 			--v_engine.v_frame;
 			v_engine.v_frame->v_stack = used;
 			v_engine.v_frame->v_code = v_this;
@@ -185,6 +304,44 @@ struct t_code
 	}
 };
 
+template<typename T>
+t_object* t_with_expression<T>::f_optimize(t_code& a_code, const t_pass& a_pass)
+{
+	auto thiz = a_code.v_engine.f_pointer(this);
+	auto expression = v_expression->f_optimize(a_code, a_pass);
+	thiz->v_expression = expression;
+	return a_pass.v_rewrite(a_code, thiz);
+}
+
+struct t_lambda : t_object_of<t_lambda>
+{
+	t_holder<t_code>* v_code;
+	t_scope* v_scope;
+
+	t_lambda(t_holder<t_code>* a_code, t_scope* a_scope) : v_code(a_code), v_scope(a_scope)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector)
+	{
+		v_code = a_collector.f_forward(v_code);
+		v_scope = a_collector.f_forward(v_scope);
+	}
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		(*v_code)->f_call(false, v_scope, a_arguments);
+	}
+};
+
+struct t_lambda_with_rest : t_lambda
+{
+	using t_lambda::t_lambda;
+	virtual void f_call(t_engine& a_engine, size_t a_arguments)
+	{
+		(*v_code)->f_call(true, v_scope, a_arguments);
+	}
+	virtual void f_call_with_expansion(t_engine& a_engine, size_t a_arguments);
+};
+
 struct t_at
 {
 	long v_position;
@@ -214,7 +371,7 @@ struct t_at
 template<typename T, typename U>
 inline T* f_cast(U* a_p)
 {
-	auto p = dynamic_cast<T*>(a_p);
+	auto p = gc::f_is_immediate(a_p) ? nullptr : dynamic_cast<T*>(a_p);
 	if (!p) throw t_error{L"must be "s + std::filesystem::path(typeid(T).name()).wstring()};
 	return p;
 }
@@ -276,6 +433,19 @@ struct t_at_expression : t_location, gc::t_root
 	virtual void f_dump(const t_dump& a_dump) const;
 };
 
+struct t_at_file : t_location
+{
+	std::filesystem::path v_path;
+	t_at v_at;
+
+	t_at_file(const std::filesystem::path& a_path, const t_at& a_at) : v_path(a_path), v_at(a_at)
+	{
+	}
+	virtual std::shared_ptr<t_location> f_at_head(t_pair* a_pair);
+	virtual std::shared_ptr<t_location> f_at_tail(t_pair* a_pair);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
 inline std::wostream& operator<<(std::wostream& a_out, t_object* a_value)
 {
 	t_dump{[&](auto x)
@@ -297,7 +467,41 @@ struct t_call : t_with_value<t_object_of<t_call>, t_pair>
 	t_call(t_pair* a_value, const std::shared_ptr<t_location>& a_location) : t_base(a_value), v_location(a_location)
 	{
 	}
+	virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass);
+	virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+// An inlined call through a module variable.
+// v_value binds the arguments, then v_inline runs as long as the variable has not been assigned since, otherwise v_call.
+struct t_guard : t_with_value<t_object_of<t_guard>, t_pair>
+{
+	t_module::t_variable* v_variable;
+	size_t v_version;
+	t_object* v_inline;
+	t_object* v_call;
+
+	t_guard(t_pair* a_value, t_module::t_variable* a_variable, size_t a_version, t_object* a_inline, t_object* a_call) : t_base(a_value), v_variable(a_variable), v_version(a_version), v_inline(a_inline), v_call(a_call)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass);
+	virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+// Builds a list of the values of v_value at once, ending with the value of v_tail if any.
+struct t_list : t_with_value<t_object_of<t_list>, t_pair>
+{
+	t_object* v_tail;
+
+	t_list(t_pair* a_value, t_object* a_tail) : t_base(a_value), v_tail(a_tail)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass);
 	virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail);
+	virtual void f_dump(const t_dump& a_dump) const;
 };
 
 enum t_instruction
@@ -315,9 +519,73 @@ enum t_instruction
 	e_instruction__LAMBDA_WITH_REST,
 	e_instruction__JUMP,
 	e_instruction__BRANCH,
+	e_instruction__LOOP,
+	e_instruction__GUARD,
+	e_instruction__VARIABLE,
+	e_instruction__LIST,
+	e_instruction__LIST_WITH_TAIL,
+	// Replace the top two values with the result, or with nil on failure.
+	// The operand of comparisons is the value for true.
+	e_instruction__ADD,
+	e_instruction__SUBTRACT,
+	e_instruction__MULTIPLY,
+	e_instruction__DIVIDE,
+	e_instruction__QUOTIENT,
+	e_instruction__REMAINDER,
+	e_instruction__MODULO,
+	e_instruction__EQUALS,
+	e_instruction__LESS,
+	e_instruction__LESS_EQUAL,
+	e_instruction__GREATER,
+	e_instruction__GREATER_EQUAL,
+	// The operand is the t_record_procedure called.
+	// Replace the arguments with the result, or with nil on failure.
+	e_instruction__RECORD_NEW,
+	e_instruction__RECORD_IS,
+	e_instruction__RECORD_GET,
+	e_instruction__RECORD_SET,
 	e_instruction__END
 };
 
+// Operand layout of each instruction: 'o' for an object, 's' for a size, and 'l' for a label.
+inline std::string_view f_operands(t_instruction a_instruction)
+{
+	switch (a_instruction) {
+	case e_instruction__PUSH:
+	case e_instruction__VARIABLE:
+	case e_instruction__LAMBDA:
+	case e_instruction__LAMBDA_WITH_REST:
+	case e_instruction__EQUALS:
+	case e_instruction__LESS:
+	case e_instruction__LESS_EQUAL:
+	case e_instruction__GREATER:
+	case e_instruction__GREATER_EQUAL:
+	case e_instruction__RECORD_NEW:
+	case e_instruction__RECORD_IS:
+	case e_instruction__RECORD_GET:
+	case e_instruction__RECORD_SET:
+		return "o"sv;
+	case e_instruction__GET:
+	case e_instruction__SET:
+		return "ss"sv;
+	case e_instruction__CALL:
+	case e_instruction__CALL_WITH_EXPANSION:
+	case e_instruction__CALL_TAIL:
+	case e_instruction__CALL_TAIL_WITH_EXPANSION:
+	case e_instruction__LOOP:
+	case e_instruction__LIST:
+	case e_instruction__LIST_WITH_TAIL:
+		return "s"sv;
+	case e_instruction__JUMP:
+	case e_instruction__BRANCH:
+		return "l"sv;
+	case e_instruction__GUARD:
+		return "osl"sv;
+	default:
+		return ""sv;
+	}
+}
+
 struct t_emit
 {
 	struct t_label : std::vector<size_t>
@@ -352,13 +620,16 @@ struct t_emit
 		v_code->v_instructions.push_back(nullptr);
 		return *this;
 	}
+	void f_peephole();
 	void f_end()
 	{
 		(*this)(e_instruction__RETURN, 0);
+		f_peephole();
 		for (auto& x : v_labels) {
 			auto p = v_code->v_instructions.data() + x.v_target;
 			for (auto i : x) v_code->v_instructions[i] = p;
 		}
+		v_code->f_record_variables();
 	}
 	void f_at(const std::shared_ptr<t_location>& a_location)
 	{
@@ -1,5 +1,7 @@
 #include "parser.h"
 #include "builtins.h"
+#include "cache.h"
+#include "numbers.h"
 #include <fstream>
 
 namespace lilis
@@ -7,11 +9,60 @@ namespace lilis
 
 void t_engine::f_scan(gc::t_collector& a_collector)
 {
-	for (auto p = v_stack.get(); p != v_used; ++p) *p = f_forward(*p);
-	for (auto p = v_frame; p != v_frames.get() + c_FRAMES; ++p) p->f_scan(*this);
+	v_segment->v_used = v_used;
+	v_segment->v_frame = v_frame;
+	for (auto p = v_segment; p; p = p->v_parent) p->f_scan(*this);
 	v_global = f_forward(v_global);
 }
 
+t_constants::t_constants(t_engine& a_engine) : gc::t_root(a_engine), v_engine(a_engine)
+{
+}
+
+void t_constants::f_scan(gc::t_collector& a_collector)
+{
+	for (auto& x : v_pending) x = a_collector.f_forward(x);
+}
+
+void t_constants::f_sweep(gc::t_collector& a_collector)
+{
+	decltype(v_index) index;
+	index.reserve(v_index.size());
+	for (auto [key, p] : v_index)
+		if (a_collector.f_survive(p)) index.emplace(std::make_pair(p->v_head, p->v_tail), p);
+	v_index = std::move(index);
+}
+
+t_pair* t_constants::f_pair(t_object* a_head, t_object* a_tail)
+{
+	auto i = v_index.find({a_head, a_tail});
+	if (i != v_index.end()) return i->second;
+	auto p = v_engine.f_new<t_pair>(v_engine.f_pointer(a_head), v_engine.f_pointer(a_tail));
+	v_index.emplace(std::make_pair(p->v_head, p->v_tail), p);
+	return p;
+}
+
+t_object* t_constants::f_intern(t_object* a_value)
+{
+	using t_parsed = t_parsed_pair<std::filesystem::path>;
+	if (!f_as<t_parsed>(a_value)) return a_value;
+	// Interns the pairs of a list from the last one not to recurse along tails.
+	auto base = v_pending.size();
+	do {
+		v_pending.push_back(a_value);
+		a_value = static_cast<t_pair*>(a_value)->v_tail;
+	} while (f_as<t_parsed>(a_value));
+	v_pending.push_back(a_value);
+	while (v_pending.size() > base + 1) {
+		auto head = f_intern(static_cast<t_pair*>(v_pending.end()[-2])->v_head);
+		v_pending.end()[-2] = f_pair(head, v_pending.back());
+		v_pending.pop_back();
+	}
+	a_value = v_pending.back();
+	v_pending.pop_back();
+	return a_value;
+}
+
 t_symbol* t_engine::f_symbol(std::wstring_view a_name)
 {
 	auto i = v_symbols.lower_bound(a_name);
@@ -20,68 +71,123 @@ t_symbol* t_engine::f_symbol(std::wstring_view a_name)
 	return i->second = f_new<t_symbol>(i);
 }
 
+void t_engine::f_grow_stack(t_object** a_tail)
+{
+	if (a_tail <= v_stack_tail) return;
+	auto& stack = v_segment->v_stack;
+	if (a_tail > stack.f_tail()) throw t_error{L"stack overflow"s};
+	auto tail = std::min(std::max(v_stack_tail + (v_stack_tail - stack.f_head()), a_tail), stack.f_tail());
+	stack.f_commit(v_stack_tail, tail);
+	v_segment->v_stack_tail = v_stack_tail = tail;
+}
+
+void t_engine::f_grow_frames(t_frame* a_head)
+{
+	if (a_head >= v_frames_head) return;
+	auto& frames = v_segment->v_frames;
+	if (a_head < frames.f_head()) throw t_error{L"stack overflow"s};
+	auto head = std::max(std::min(v_frames_head - (frames.f_tail() - v_frames_head), a_head), frames.f_head());
+	frames.f_commit(head, v_frames_head);
+	v_segment->v_frames_head = v_frames_head = head;
+}
+
+t_segment* t_engine::f_segment()
+{
+	if (v_segments.empty()) return new t_segment(v_stack_size, v_stack_maximum, v_frames_size, v_frames_maximum);
+	auto p = v_segments.back().release();
+	v_segments.pop_back();
+	return p;
+}
+
+void t_engine::f_release(t_segment* a_segment)
+{
+	a_segment->v_used = a_segment->v_stack.f_head();
+	a_segment->v_frame = a_segment->v_frames.f_tail();
+	a_segment->v_parent = nullptr;
+	v_segments.emplace_back(a_segment);
+}
+
+// Moves the running segment on top of its parent.
+void t_engine::f_flatten()
+{
+	auto segment = v_segment;
+	auto head = segment->v_stack.f_head();
+	size_t stack = v_used - head;
+	auto frame = v_frame;
+	size_t frames = segment->v_frames.f_tail() - frame;
+	f_switch(segment->v_parent);
+	if (v_used + stack > v_stack_tail) f_grow_stack(v_used + stack);
+	if (v_frame - frames < v_frames_head) f_grow_frames(v_frame - frames);
+	auto used = v_used;
+	v_used = std::copy_n(head, stack, used);
+	v_frame -= frames;
+	std::copy_n(frame, frames, v_frame);
+	for (size_t i = 0; i < frames; ++i) v_frame[i].v_stack += used - head;
+	f_release(segment);
+}
+
 void f_rethrow(t_engine& a_engine, t_object* a_thunk);
 void f_throw(t_engine& a_engine, t_error&& a_error);
+void f_throw(t_engine& a_engine, const t_failure& a_failure);
 
 void t_engine::f_run(t_code* a_code, t_object* a_arguments)
 {
-	struct t_lambda : t_object_of<t_lambda>
-	{
-		t_holder<t_code>* v_code;
-		t_scope* v_scope;
-
-		t_lambda(t_holder<t_code>* a_code, t_scope* a_scope) : v_code(a_code), v_scope(a_scope)
-		{
-		}
-		virtual void f_scan(gc::t_collector& a_collector)
-		{
-			v_code = a_collector.f_forward(v_code);
-			v_scope = a_collector.f_forward(v_scope);
-		}
-		virtual void f_call(t_engine& a_engine, size_t a_arguments)
-		{
-			(*v_code)->f_call(false, v_scope, a_arguments);
-		}
-	};
-	struct t_lambda_with_rest : t_lambda
-	{
-		using t_lambda::t_lambda;
-		virtual void f_call(t_engine& a_engine, size_t a_arguments)
-		{
-			(*v_code)->f_call(true, v_scope, a_arguments);
-		}
-	};
-	auto expand = [&](size_t a_arguments)
-	{
-		--a_arguments;
-		if (auto last = *--v_used)
-			while (true) {
-				auto pair = f_cast<t_pair>(last);
-				*v_used++ = pair->v_head;
-				last = pair->v_tail;
-				++a_arguments;
-				if (!last) break;
-				if (v_used >= v_stack.get() + c_STACK) throw t_error{L"stack overflow"s};
-			}
-		return a_arguments;
-	};
 	auto call = [&](bool a_expand)
 	{
 		auto arguments = reinterpret_cast<size_t>(*++v_frame->v_current);
 		++v_frame->v_current;
 		auto callee = v_used[-1 - arguments];
-		if (!callee) throw t_error{L"calling nil"s};
-		callee->f_call(*this, a_expand ? expand(arguments) : arguments);
+		if (!callee)
+			f_fail(L"calling nil"sv);
+		else if (gc::f_is_immediate(callee))
+			f_fail(L"not callable"sv);
+		else if (a_expand)
+			callee->f_call_with_expansion(*this, arguments);
+		else
+			callee->f_call(*this, arguments);
 	};
 	auto tail = [&](bool a_expand)
 	{
 		auto arguments = reinterpret_cast<size_t>(*++v_frame->v_current);
 		v_used = std::copy(v_used - arguments - 1, v_used, v_frame->v_stack);
 		auto callee = *v_frame++->v_stack;
-		if (!callee) throw t_error{L"calling nil"s};
-		callee->f_call(*this, a_expand ? expand(arguments) : arguments);
+		if (!callee)
+			f_fail(L"calling nil"sv);
+		else if (gc::f_is_immediate(callee))
+			f_fail(L"not callable"sv);
+		else if (a_expand)
+			callee->f_call_with_expansion(*this, arguments);
+		else
+			callee->f_call(*this, arguments);
+	};
+	auto list = [&](bool a_tail)
+	{
+		auto n = reinterpret_cast<size_t>(*++v_frame->v_current);
+		++v_frame->v_current;
+		auto xs = v_used - n;
+		if (a_tail) --n;
+		auto list = f_list(xs, n, a_tail ? xs[n] : nullptr);
+		v_used = xs;
+		*v_used++ = list;
+	};
+	auto arithmetic = [&](auto a_do)
+	{
+		++v_frame->v_current;
+		auto xs = --v_used - 1;
+		t_object* z = nullptr;
+		a_do(*this, xs[0], xs[1], z);
+		xs[0] = z;
+	};
+	auto compare = [&](auto a_do)
+	{
+		auto value = static_cast<t_object*>(*++v_frame->v_current);
+		++v_frame->v_current;
+		auto xs = --v_used - 1;
+		bool z;
+		xs[0] = a_do(*this, xs[0], xs[1], z) && z ? value : nullptr;
 	};
 	auto end = reinterpret_cast<void*>(e_instruction__END);
+	if (v_frame <= v_frames_head) f_grow_frames(v_frame - 1);
 	{
 		auto top = --v_frame;
 		top->v_code = nullptr;
@@ -95,7 +201,7 @@ void t_engine::f_run(t_code* a_code, t_object* a_arguments)
 		t_emit emit{*code};
 		size_t stack = 0;
 		emit(a_code->v_rest ? e_instruction__LAMBDA_WITH_REST : e_instruction__LAMBDA, ++stack)(a_code->v_this);
-		while (auto p = dynamic_cast<t_pair*>(arguments.v_value)) {
+		while (auto p = f_as<t_pair>(arguments.v_value)) {
 			emit(e_instruction__PUSH, ++stack)(p->v_head);
 			arguments = p->v_tail;
 		}
@@ -158,10 +264,12 @@ void t_engine::f_run(t_code* a_code, t_object* a_arguments)
 			case e_instruction__LAMBDA:
 				*v_used++ = f_new<t_lambda>(*reinterpret_cast<t_holder<t_code>**>(++v_frame->v_current), v_frame->v_scope);
 				++v_frame->v_current;
+				if (v_frame->v_scope) v_frame->v_scope->v_captured = true;
 				break;
 			case e_instruction__LAMBDA_WITH_REST:
 				*v_used++ = f_new<t_lambda_with_rest>(*reinterpret_cast<t_holder<t_code>**>(++v_frame->v_current), v_frame->v_scope);
 				++v_frame->v_current;
+				if (v_frame->v_scope) v_frame->v_scope->v_captured = true;
 				break;
 			case e_instruction__JUMP:
 				v_frame->v_current = static_cast<void**>(*++v_frame->v_current);
@@ -173,6 +281,114 @@ void t_engine::f_run(t_code* a_code, t_object* a_arguments)
 				else
 					v_frame->v_current = static_cast<void**>(*v_frame->v_current);
 				break;
+			case e_instruction__LOOP:
+				{
+					auto arguments = reinterpret_cast<size_t>(*++v_frame->v_current);
+					auto scope = v_frame->v_scope;
+					if (scope->v_captured) {
+						auto p = f_allocate(sizeof(t_scope) + sizeof(t_object*) * scope->v_size);
+						scope = v_frame->v_scope;
+						v_frame->v_scope = new(p) t_scope(scope->v_outer, scope->v_size, v_used - arguments, arguments);
+					} else {
+						std::fill(std::copy(v_used - arguments, v_used, scope->f_locals()), scope->f_locals() + scope->v_size, nullptr);
+					}
+					v_used = v_frame->v_stack + 1;
+					v_frame->v_current = (*v_frame->v_code)->v_instructions.data();
+				}
+				break;
+			case e_instruction__GUARD:
+				{
+					auto variable = static_cast<t_module::t_variable*>(*++v_frame->v_current);
+					auto version = reinterpret_cast<size_t>(*++v_frame->v_current);
+					++v_frame->v_current;
+					if (variable->v_version == version)
+						++v_frame->v_current;
+					else
+						v_frame->v_current = static_cast<void**>(*v_frame->v_current);
+				}
+				break;
+			case e_instruction__VARIABLE:
+				*v_used++ = static_cast<t_module::t_variable*>(*++v_frame->v_current)->v_value;
+				++v_frame->v_current;
+				break;
+			case e_instruction__LIST:
+				list(false);
+				break;
+			case e_instruction__LIST_WITH_TAIL:
+				list(true);
+				break;
+			case e_instruction__ADD:
+				arithmetic(f_add);
+				break;
+			case e_instruction__SUBTRACT:
+				arithmetic(f_subtract);
+				break;
+			case e_instruction__MULTIPLY:
+				arithmetic(f_multiply);
+				break;
+			case e_instruction__DIVIDE:
+				arithmetic(f_divide);
+				break;
+			case e_instruction__QUOTIENT:
+				arithmetic(f_quotient);
+				break;
+			case e_instruction__REMAINDER:
+				arithmetic(f_remainder);
+				break;
+			case e_instruction__MODULO:
+				arithmetic(f_modulo);
+				break;
+			case e_instruction__EQUALS:
+				compare(f_compare<std::equal_to<>>);
+				break;
+			case e_instruction__LESS:
+				compare(f_compare<std::less<>>);
+				break;
+			case e_instruction__LESS_EQUAL:
+				compare(f_compare<std::less_equal<>>);
+				break;
+			case e_instruction__GREATER:
+				compare(f_compare<std::greater<>>);
+				break;
+			case e_instruction__GREATER_EQUAL:
+				compare(f_compare<std::greater_equal<>>);
+				break;
+			case e_instruction__RECORD_NEW:
+				{
+					auto n = static_cast<t_record_procedure*>(*++v_frame->v_current)->v_type->v_size;
+					auto p = t_record::f_new(*this, n);
+					p->v_type = static_cast<t_record_procedure*>(*v_frame->v_current++)->v_type;
+					v_used -= n;
+					std::copy_n(v_used, n, p->f_fields());
+					*v_used++ = p;
+				}
+				break;
+			case e_instruction__RECORD_IS:
+				{
+					auto procedure = static_cast<t_record_procedure*>(*++v_frame->v_current);
+					++v_frame->v_current;
+					v_used[-1] = procedure->f_record(v_used[-1]);
+				}
+				break;
+			case e_instruction__RECORD_GET:
+				{
+					auto procedure = static_cast<t_record_procedure*>(*++v_frame->v_current);
+					++v_frame->v_current;
+					auto p = procedure->f_record(v_used[-1]);
+					v_used[-1] = p ? p->f_fields()[procedure->v_index] : nullptr;
+					if (!p) f_fail_cast<t_record>();
+				}
+				break;
+			case e_instruction__RECORD_SET:
+				{
+					auto procedure = static_cast<t_record_procedure*>(*++v_frame->v_current);
+					++v_frame->v_current;
+					auto xs = --v_used - 1;
+					auto p = procedure->f_record(xs[0]);
+					xs[0] = p ? p->f_fields()[procedure->v_index] = xs[1] : nullptr;
+					if (!p) f_fail_cast<t_record>();
+				}
+				break;
 			case e_instruction__END:
 				--v_used;
 				++v_frame;
@@ -183,45 +399,36 @@ void t_engine::f_run(t_code* a_code, t_object* a_arguments)
 		} catch (std::exception& e) {
 			f_throw(*this, t_error{std::filesystem::path(e.what()).wstring()});
 		}
+		if (v_failure) f_throw(*this, std::exchange(v_failure, {}));
 	}
 }
 
-namespace
+std::shared_ptr<t_location> t_at_file::f_at_head(t_pair* a_pair)
 {
+	auto p = dynamic_cast<t_parsed_pair<std::filesystem::path>*>(a_pair);
+	return p ? std::make_shared<t_at_file>(*p->v_source, p->v_where_head) : shared_from_this();
+}
 
-struct t_at_file : t_location
+std::shared_ptr<t_location> t_at_file::f_at_tail(t_pair* a_pair)
 {
-	std::filesystem::path v_path;
-	t_at v_at;
+	auto p = dynamic_cast<t_parsed_pair<std::filesystem::path>*>(a_pair);
+	return p ? std::make_shared<t_at_file>(*p->v_source, p->v_where_tail) : shared_from_this();
+}
 
-	t_at_file(const std::filesystem::path& a_path, const t_at& a_at) : v_path(a_path), v_at(a_at)
-	{
-	}
-	virtual std::shared_ptr<t_location> f_at_head(t_pair* a_pair)
-	{
-		auto p = dynamic_cast<t_parsed_pair<std::filesystem::path>*>(a_pair);
-		return p ? std::make_shared<t_at_file>(p->v_source, p->v_where_head) : shared_from_this();
-	}
-	virtual std::shared_ptr<t_location> f_at_tail(t_pair* a_pair)
-	{
-		auto p = dynamic_cast<t_parsed_pair<std::filesystem::path>*>(a_pair);
-		return p ? std::make_shared<t_at_file>(p->v_source, p->v_where_tail) : shared_from_this();
-	}
-	virtual void f_dump(const t_dump& a_dump) const
+void t_at_file::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"at "sv << v_path.wstring() << L":"sv;
+	std::wfilebuf fb;
+	v_at.f_dump(a_dump, [&](long a_position)
 	{
-		a_dump << L"at "sv << v_path.wstring() << L":"sv;
-		std::wfilebuf fb;
+		// Positions count characters, which are not bytes in UTF-8.
+		fb.close();
 		fb.open(v_path, std::ios_base::in);
-		v_at.f_dump(a_dump, [&](long a_position)
-		{
-			fb.pubseekpos(a_position);
-		}, [&]
-		{
-			return fb.sbumpc();
-		});
-	}
-};
-
+		for (long i = 0; i < a_position; ++i) fb.sbumpc();
+	}, [&]
+	{
+		return fb.sbumpc();
+	});
 }
 
 t_pair* t_engine::f_parse(const std::filesystem::path& a_path)
@@ -232,23 +439,60 @@ t_pair* t_engine::f_parse(const std::filesystem::path& a_path)
 	{
 		return t_parser<decltype(a_get), decltype(a_pair), decltype(a_location)>(*this, std::move(a_get), std::move(a_pair), std::move(a_location))();
 	};
+	auto source = std::make_shared<const std::filesystem::path>(a_path);
 	return parse([&]
 	{
 		return fb.sbumpc();
 	}, [&](t_object* a_value, const t_at& a_at)
 	{
-		return f_new<t_parsed_pair<std::filesystem::path>>(f_pointer(a_value), a_path, a_at);
+		return f_new<t_parsed_pair<std::filesystem::path>>(f_pointer(a_value), source, a_at);
 	}, [&](const t_at& a_at)
 	{
 		return std::make_shared<t_at_file>(a_path, a_at);
 	});
 }
 
-void t_engine::f_run(t_holder<t_module>* a_module, const gc::t_pointer<t_pair>& a_expressions)
+t_holder<t_code>* t_engine::f_compile(t_holder<t_module>* a_module, const gc::t_pointer<t_pair>& a_expressions)
 {
 	auto code = f_pointer(f_new<t_holder<t_code>>(*this, nullptr, f_pointer(a_module)));
 	(*code)->v_imports.push_back(v_global);
 	(*code)->f_compile_body(std::make_shared<t_at_file>(std::filesystem::path(), t_at()), a_expressions);
+	return code;
+}
+
+void t_engine::f_link()
+{
+	for (auto j = v_linking.begin(); j != v_linking.end();) {
+		auto code = *j;
+		auto& unlinked = code->v_unlinked;
+		for (size_t k = 0; k < unlinked.size();) {
+			auto [i, variable] = code->v_variables[unlinked[k]];
+			if (!variable->v_constant) {
+				// Neither v_sets nor v_version ever decreases, so that reads of a variable set more than once are dropped for good.
+				if (variable->v_sets > 1 || variable->v_version > 1) {
+					unlinked[k] = unlinked.back();
+					unlinked.pop_back();
+					continue;
+				}
+				if (variable->v_sets != 1 || variable->v_version != 1) {
+					++k;
+					continue;
+				}
+				variable->v_constant = true;
+			}
+			code->v_instructions[i] = reinterpret_cast<void*>(e_instruction__PUSH);
+			code->v_instructions[i + 1] = variable->v_value;
+			unlinked[k] = unlinked.back();
+			unlinked.pop_back();
+		}
+		j = unlinked.empty() ? v_linking.erase(j) : std::next(j);
+	}
+}
+
+void t_engine::f_run(t_holder<t_module>* a_module, const gc::t_pointer<t_pair>& a_expressions)
+{
+	auto code = f_pointer(f_compile(a_module, a_expressions));
+	f_link();
 	f_run(*code, nullptr);
 }
 
@@ -258,12 +502,20 @@ t_holder<t_module>* t_engine::f_module(const std::filesystem::path& a_path, std:
 	if (i != v_modules.end() && i->first == a_name) return i->second;
 	auto path = a_path / a_name;
 	path += ".lisp";
-	auto expressions = f_pointer(f_parse(path));
+	t_cache cache(*this, path);
+	auto cached = cache.f_open();
+	auto expressions = f_pointer(cached ? nullptr : f_parse(path));
 	i = v_modules.emplace_hint(i, a_name, nullptr);
-	i->second = f_new<t_holder<t_module>>(*this, path);
-	(*i->second)->v_entry = i;
-	if (expressions) f_run(i->second, expressions);
-	return i->second;
+	auto module = f_pointer(i->second = f_new<t_holder<t_module>>(*this, path));
+	(*module)->v_entry = i;
+	auto code = f_pointer(cached ? cache.f_load(module) : nullptr);
+	if (!code) {
+		if (cached) expressions = f_parse(path);
+		code = f_compile(module, expressions);
+		cache.f_store(module, code);
+	}
+	f_run(*code, nullptr);
+	return module;
 }
 
 }
@@ -3,6 +3,14 @@
 
 #include "objects.h"
 #include <filesystem>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <system_error>
+#include <typeinfo>
+#include <utility>
+#include <sys/mman.h>
+#include <unistd.h>
 
 namespace lilis
 {
@@ -38,6 +46,33 @@ struct t_holder : t_object_of<t_holder<T>>
 	}
 };
 
+// A runtime error signaled without throwing.
+// The message is built only when the error is dumped.
+struct t_failure
+{
+	std::wstring_view v_message;
+	const std::type_info* v_type = nullptr;
+
+	explicit operator bool() const
+	{
+		return !v_message.empty();
+	}
+	std::wstring f_message() const
+	{
+		std::wstring message(v_message);
+		if (v_type) message += std::filesystem::path(v_type->name()).wstring();
+		return message;
+	}
+};
+
+// A rewrite of rendered expressions applied bottom up by t_code::f_optimize between f_render and f_emit.
+// v_rewrite returns either a_node itself or an equivalent expression.
+struct t_pass
+{
+	std::wstring_view v_name;
+	t_object* (*v_rewrite)(t_code& a_code, t_object* a_node);
+};
+
 struct t_frame
 {
 	t_holder<t_code>* v_code;
@@ -52,33 +87,246 @@ struct t_frame
 	}
 };
 
+// Reserves address space for up to v_maximum elements and commits pages on demand.
+// Elements never move so that pointers into them stay valid while growing.
+template<typename T>
+class t_reservation
+{
+	T* v_head;
+	size_t v_maximum;
+
+	static size_t f_page()
+	{
+		static size_t page = sysconf(_SC_PAGESIZE);
+		return page;
+	}
+
+public:
+	t_reservation(size_t a_maximum) : v_maximum(a_maximum)
+	{
+		auto p = mmap(nullptr, sizeof(T) * v_maximum, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (p == MAP_FAILED) throw std::system_error(errno, std::generic_category());
+		v_head = static_cast<T*>(p);
+	}
+	t_reservation(const t_reservation&) = delete;
+	~t_reservation()
+	{
+		munmap(v_head, sizeof(T) * v_maximum);
+	}
+	T* f_head() const
+	{
+		return v_head;
+	}
+	T* f_tail() const
+	{
+		return v_head + v_maximum;
+	}
+	void f_commit(T* a_head, T* a_tail)
+	{
+		auto page = f_page();
+		auto head = reinterpret_cast<uintptr_t>(a_head) / page * page;
+		auto tail = reinterpret_cast<uintptr_t>(a_tail);
+		if (mprotect(reinterpret_cast<void*>(head), tail - head, PROT_READ | PROT_WRITE) != 0) throw std::system_error(errno, std::generic_category());
+	}
+};
+
+// A value stack and a frame stack.
+// call-with-prompt/one-shot runs its thunk on a new segment so that a one-shot continuation can take the segment over instead of copying it.
+struct t_segment
+{
+	t_reservation<t_object*> v_stack;
+	t_reservation<t_frame> v_frames;
+	// The committed parts are [v_stack.f_head(), v_stack_tail) and [v_frames_head, v_frames.f_tail()).
+	t_object** v_stack_tail;
+	t_frame* v_frames_head;
+	// Saved while the segment is not running.
+	t_object** v_used = v_stack.f_head();
+	t_frame* v_frame = v_frames.f_tail();
+	t_segment* v_parent = nullptr;
+
+	t_segment(size_t a_stack, size_t a_stack_maximum, size_t a_frames, size_t a_frames_maximum) : v_stack(std::max(a_stack_maximum, a_stack)), v_frames(std::max(a_frames_maximum, a_frames))
+	{
+		v_stack_tail = v_stack.f_head() + a_stack;
+		v_stack.f_commit(v_stack.f_head(), v_stack_tail);
+		v_frames_head = v_frames.f_tail() - a_frames;
+		v_frames.f_commit(v_frames_head, v_frames.f_tail());
+	}
+	void f_scan(gc::t_collector& a_collector)
+	{
+		for (auto p = v_stack.f_head(); p != v_used; ++p) *p = a_collector.f_forward(*p);
+		for (auto p = v_frame; p != v_frames.f_tail(); ++p) p->f_scan(a_collector);
+	}
+};
+
+// Pairs of quoted constants parsed from sources, shared by all the codes.
+// Structurally equal pairs are interned into one, which lives as long as the codes or others referring to it.
+// The index does not keep pairs alive, and is rebuilt with the new addresses of the surviving pairs by each collection.
+struct t_constants : gc::t_root
+{
+	struct t_hash
+	{
+		size_t operator()(const std::pair<t_object*, t_object*>& a_key) const
+		{
+			auto x = reinterpret_cast<uintptr_t>(a_key.first) * 0x9e3779b97f4a7c15 ^ reinterpret_cast<uintptr_t>(a_key.second);
+			return x ^ x >> 32;
+		}
+	};
+
+	t_engine& v_engine;
+	std::unordered_map<std::pair<t_object*, t_object*>, t_pair*, t_hash> v_index;
+	// Values being interned, kept alive and forwarded by collections.
+	std::vector<t_object*> v_pending;
+
+	t_constants(t_engine& a_engine);
+	virtual void f_scan(gc::t_collector& a_collector);
+	void f_sweep(gc::t_collector& a_collector);
+	// Returns the interned pair of a_head and a_tail, which have been interned.
+	t_pair* f_pair(t_object* a_head, t_object* a_tail);
+	// Returns a_value with its parsed pairs interned.
+	// Other values, including pairs made at run time, are kept as they are.
+	t_object* f_intern(t_object* a_value);
+	bool f_interned(t_pair* a_pair) const
+	{
+		auto i = v_index.find({a_pair->v_head, a_pair->v_tail});
+		return i != v_index.end() && i->second == a_pair;
+	}
+};
+
 struct t_engine : gc::t_collector
 {
 	static constexpr size_t c_STACK = 1024;
+	static constexpr size_t c_STACK_MAXIMUM = 1024 * 1024;
 	static constexpr size_t c_FRAMES = 256;
+	static constexpr size_t c_FRAMES_MAXIMUM = 256 * 1024;
 
-	std::unique_ptr<t_object*[]> v_stack{new t_object*[c_STACK]};
-	std::unique_ptr<t_frame[]> v_frames{new t_frame[c_FRAMES]};
-	t_object** v_used = v_stack.get();
-	t_frame* v_frame = v_frames.get() + c_FRAMES;
+	const size_t v_stack_size;
+	const size_t v_stack_maximum;
+	const size_t v_frames_size;
+	const size_t v_frames_maximum;
+	t_segment v_root{v_stack_size, v_stack_maximum, v_frames_size, v_frames_maximum};
+	// Free segments.
+	std::vector<std::unique_ptr<t_segment>> v_segments;
+	// The running segment and its state.
+	t_segment* v_segment = &v_root;
+	t_object** v_stack_tail = v_root.v_stack_tail;
+	t_frame* v_frames_head = v_root.v_frames_head;
+	t_object** v_used = v_root.v_used;
+	t_frame* v_frame = v_root.v_frame;
 	std::map<std::wstring, t_symbol*, std::less<>> v_symbols;
 	t_holder<t_module>* v_global = nullptr;
 	std::map<std::wstring, t_holder<t_module>*, std::less<>> v_modules;
-	bool v_debug;
-	bool v_verbose;
+	// Codes which read module variables.
+	std::set<t_code*> v_readers;
+	// Codes which have reads yet to be linked, so that f_link visits only them.
+	std::set<t_code*> v_linking;
+	std::filesystem::path v_cache;
+	std::vector<t_pass> v_passes;
+	bool v_dump_passes = false;
+	// Nodes rendered by running compilations, freed at once when the outermost one ends.
+	std::unique_ptr<gc::t_region> v_region;
+	size_t v_compilations = 0;
+	t_failure v_failure;
+	t_constants v_constants{*this};
+	// The last edit given to transients.
+	size_t v_edits = 0;
+	// Counts changes to the bindings of modules, so that codes importing them can tell that their indices may be stale.
+	size_t v_exports = 0;
 
-	t_engine(bool a_debug, bool a_verbose) : gc::t_collector(a_debug, a_verbose)
+	t_engine(bool a_debug, bool a_verbose, size_t a_stack = c_STACK, size_t a_stack_maximum = c_STACK_MAXIMUM, size_t a_frames = c_FRAMES, size_t a_frames_maximum = c_FRAMES_MAXIMUM) : gc::t_collector(a_debug, a_verbose), v_stack_size(a_stack), v_stack_maximum(a_stack_maximum), v_frames_size(a_frames), v_frames_maximum(a_frames_maximum)
 	{
 		v_global = f_new<t_holder<t_module>>(*this, std::filesystem::path{});
 	}
 	virtual void f_scan(t_collector& a_collector);
+	virtual void f_sweep(t_collector& a_collector)
+	{
+		v_constants.f_sweep(a_collector);
+	}
 	t_symbol* f_symbol(std::wstring_view a_name);
+	void f_grow_stack(t_object** a_tail);
+	void f_grow_frames(t_frame* a_head);
+	// Saves the running state into v_segment and runs a_segment instead.
+	void f_switch(t_segment* a_segment)
+	{
+		v_segment->v_used = v_used;
+		v_segment->v_frame = v_frame;
+		v_segment = a_segment;
+		v_stack_tail = a_segment->v_stack_tail;
+		v_frames_head = a_segment->v_frames_head;
+		v_used = a_segment->v_used;
+		v_frame = a_segment->v_frame;
+	}
+	t_segment* f_segment();
+	void f_release(t_segment* a_segment);
+	void f_flatten();
+	// Signals an error to be raised by f_run when the current call returns.
+	bool f_fail(std::wstring_view a_message)
+	{
+		v_failure = {a_message};
+		return false;
+	}
+	template<typename T>
+	bool f_fail_cast()
+	{
+		v_failure = {L"must be "sv, &typeid(T)};
+		return false;
+	}
+	// Calls a_callee with a_arguments above it on the stack.
+	// Nil and immediates are not callable.
+	void f_call(t_object* a_callee, size_t a_arguments)
+	{
+		if (a_callee && !gc::f_is_immediate(a_callee)) return a_callee->f_call(*this, a_arguments);
+		v_used -= a_arguments + 1;
+		f_fail(a_callee ? L"not callable"sv : L"calling nil"sv);
+	}
+	// Allocates a node which is not referred to after emitted.
+	template<typename T, typename... T_an>
+	T* f_node(T_an&&... a_an)
+	{
+		return v_region ? v_region->f_new<T>(std::forward<T_an>(a_an)...) : f_new<T>(std::forward<T_an>(a_an)...);
+	}
+	void f_push_node(gc::t_pointer<t_pair>& a_p, t_object* a_value)
+	{
+		auto p = f_node<t_pair>(f_pointer(a_value), nullptr);
+		a_p->v_tail = p;
+		a_p = p;
+	}
+	// Makes a list of a_n values ending with a_tail, with the pairs allocated in one block.
+	// a_values must be reachable from the stack.
+	t_object* f_list(t_object** a_values, size_t a_n, t_object* a_tail)
+	{
+		if (a_n <= 0) return a_tail;
+		auto tail = f_pointer(a_tail);
+		auto size = std::max(sizeof(t_pair), sizeof(t_forward));
+		auto p = f_allocate(size * a_n);
+		t_object* list = tail;
+		for (auto i = a_n; i > 0; --i) list = new(p + size * (i - 1)) t_pair(a_values[i - 1], list);
+		return list;
+	}
 	void f_run(t_code* a_code, t_object* a_arguments);
 	t_pair* f_parse(const std::filesystem::path& a_path);
+	t_holder<t_code>* f_compile(t_holder<t_module>* a_module, const gc::t_pointer<t_pair>& a_expressions);
+	// Replaces reads of module variables which have been assigned once by export and are never set! with their values.
+	// A variable is unlinked when it is assigned again.
+	void f_link();
 	void f_run(t_holder<t_module>* a_module, const gc::t_pointer<t_pair>& a_expressions);
 	t_holder<t_module>* f_module(const std::filesystem::path& a_path, std::wstring_view a_name);
 };
 
+// Renders nodes into t_engine::v_region while alive.
+struct t_compilation
+{
+	t_engine& v_engine;
+
+	t_compilation(t_engine& a_engine) : v_engine(a_engine)
+	{
+		if (v_engine.v_compilations++ <= 0) v_engine.v_region = std::make_unique<gc::t_region>(v_engine);
+	}
+	~t_compilation()
+	{
+		if (--v_engine.v_compilations <= 0) v_engine.v_region.reset();
+	}
+};
+
 }
 
 #endif
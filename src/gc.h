@@ -4,13 +4,21 @@
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <vector>
 #include <cassert>
+#include <cstdint>
 
 namespace lilis::gc
 {
 
 struct t_collector;
 
+// Values with any of the low bits set are immediates stored in pointer slots as they are instead of objects.
+inline bool f_is_immediate(const void* a_p)
+{
+	return reinterpret_cast<uintptr_t>(a_p) & (alignof(void*) - 1);
+}
+
 struct t_object
 {
 	virtual size_t f_size() const = 0;
@@ -21,6 +29,10 @@ struct t_object
 	virtual void f_destruct(t_collector& a_collector)
 	{
 	}
+	// Called at the end of each compaction during which this was added to t_collector::v_weaks.
+	virtual void f_sweep(t_collector& a_collector)
+	{
+	}
 };
 
 struct t_root
@@ -93,8 +105,18 @@ struct t_collector : t_root
 	std::unique_ptr<char[]> v_heap1{new char[v_size]};
 	char* v_head = v_heap0.get();
 	char* v_tail = v_head + v_size;
+	// The heap being compacted.
+	char* v_from_head = nullptr;
+	char* v_from_tail = nullptr;
 	bool v_debug;
 	bool v_verbose;
+	// Incremented by each compaction, after which objects have different addresses.
+	size_t v_epoch = 0;
+	// Objects which refer to others without keeping them alive, added while scanned.
+	std::vector<t_object*> v_weaks;
+	// Bytes allocated outside the heap for objects since the last compaction.
+	// Once they exceed the heap size, the next allocation compacts to free those of dead objects.
+	size_t v_external = 0;
 
 	t_collector(bool a_debug, bool a_verbose) : v_debug(a_debug), v_verbose(a_verbose)
 	{
@@ -102,6 +124,9 @@ struct t_collector : t_root
 	template<typename T>
 	T* f_move(T* a_p)
 	{
+		// Objects outside the heap, such as ones in t_region, stay where they are.
+		auto q = reinterpret_cast<char*>(a_p);
+		if (q < v_from_head || q >= v_from_tail) return a_p;
 		size_t n = a_p->f_size();
 		assert(n >= sizeof(t_forward));
 		assert(n % alignof(t_object) == 0);
@@ -113,10 +138,34 @@ struct t_collector : t_root
 	template<typename T>
 	T* f_forward(T* a_value)
 	{
-		return a_value ? static_cast<T*>(a_value->f_forward(*this)) : nullptr;
+		return a_value && !f_is_immediate(a_value) ? static_cast<T*>(a_value->f_forward(*this)) : a_value;
+	}
+	// Forwards a_n values from a_p.
+	// Those outside the heap being compacted, which are not moved, are skipped without virtual calls.
+	template<typename T>
+	void f_forward(T** a_p, size_t a_n)
+	{
+		for (auto end = a_p + a_n; a_p != end; ++a_p) {
+			auto q = reinterpret_cast<char*>(*a_p);
+			if (q >= v_from_head && q < v_from_tail && !f_is_immediate(q)) *a_p = static_cast<T*>((*a_p)->f_forward(*this));
+		}
+	}
+	// Whether a_value, not forwarded by the compaction, has been forwarded by others.
+	// If it has, updates a_value to where it has moved.
+	template<typename T>
+	bool f_survive(T*& a_value)
+	{
+		auto q = reinterpret_cast<char*>(a_value);
+		if (q < v_from_head || q >= v_from_tail || f_is_immediate(q)) return true;
+		auto p = dynamic_cast<t_forward*>(static_cast<t_object*>(a_value));
+		if (!p) return false;
+		a_value = static_cast<T*>(p->v_moved);
+		return true;
 	}
 	void f_compact()
 	{
+		v_from_head = v_heap0.get();
+		v_from_tail = v_tail;
 		v_heap0.swap(v_heap1);
 		v_head = v_tail = v_heap0.get();
 		{
@@ -128,6 +177,11 @@ struct t_collector : t_root
 			v_head += p->f_size();
 			p->f_scan(*this);
 		}
+		for (auto p : v_weaks) p->f_sweep(*this);
+		v_weaks.clear();
+		f_sweep(*this);
+		v_external = 0;
+		++v_epoch;
 		v_tail = v_heap0.get() + v_size;
 	}
 	char* f_allocate(size_t a_n)
@@ -136,7 +190,7 @@ struct t_collector : t_root
 		assert(a_n % alignof(t_object) == 0);
 		auto p = v_head;
 		v_head += a_n;
-		if (v_head > v_tail || v_debug) {
+		if (v_head > v_tail || v_debug || v_external > v_size) {
 			if (v_verbose) std::cerr << "gc collecting..." <<std::endl;
 			f_compact();
 			for (auto q = v_heap1.get(); q != p;) {
@@ -165,6 +219,11 @@ struct t_collector : t_root
 		auto p = f_allocate(std::max(sizeof(T), sizeof(t_forward)));
 		return new(p) T(std::forward<T_an>(a_an)...);
 	}
+	// Charges a_n bytes allocated outside the heap for an object.
+	void f_charge(size_t a_n)
+	{
+		v_external += a_n;
+	}
 	template<typename T>
 	t_pointer<T> f_pointer(T* a_value)
 	{
@@ -173,6 +232,73 @@ struct t_collector : t_root
 	virtual void f_scan(t_collector& a_collector)
 	{
 	}
+	// Called at the end of each compaction, after the weak objects have been swept.
+	virtual void f_sweep(t_collector& a_collector)
+	{
+	}
+};
+
+// A bump allocator for objects which die together.
+// The objects never move and are scanned as roots until the region is destroyed.
+struct t_region : t_root
+{
+	static constexpr size_t c_CHUNK = 16384;
+
+	struct t_chunk
+	{
+		std::unique_ptr<char[]> v_head;
+		char* v_used;
+		char* v_tail;
+	};
+
+	t_collector& v_collector;
+	std::vector<t_chunk> v_chunks;
+
+	t_region(t_collector& a_collector) : t_root(a_collector), v_collector(a_collector)
+	{
+	}
+	~t_region()
+	{
+		f_each([&](auto a_p)
+		{
+			a_p->f_destruct(v_collector);
+		});
+	}
+	template<typename T>
+	void f_each(T a_do)
+	{
+		for (auto& x : v_chunks)
+			for (auto p = x.v_head.get(); p != x.v_used;) {
+				auto q = reinterpret_cast<t_object*>(p);
+				p += q->f_size();
+				a_do(q);
+			}
+	}
+	char* f_allocate(size_t a_n)
+	{
+		if (v_chunks.empty() || size_t(v_chunks.back().v_tail - v_chunks.back().v_used) < a_n) {
+			auto n = std::max(a_n, c_CHUNK);
+			auto p = new char[n];
+			v_chunks.push_back({std::unique_ptr<char[]>(p), p, p + n});
+		}
+		auto& chunk = v_chunks.back();
+		auto p = chunk.v_used;
+		chunk.v_used += a_n;
+		return p;
+	}
+	template<typename T, typename... T_an>
+	T* f_new(T_an&&... a_an)
+	{
+		auto p = f_allocate(std::max(sizeof(T), sizeof(t_collector::t_forward)));
+		return new(p) T(std::forward<T_an>(a_an)...);
+	}
+	virtual void f_scan(t_collector& a_collector)
+	{
+		f_each([&](auto a_p)
+		{
+			a_p->f_scan(a_collector);
+		});
+	}
 };
 
 template<typename T>
@@ -2,11 +2,32 @@
 #include "builtins.h"
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
+#include <locale>
+
+namespace
+{
+
+// Parses "INITIAL[,MAXIMUM]".
+void f_sizes(const char* a_value, size_t& a_initial, size_t& a_maximum)
+{
+	char* p;
+	a_initial = std::strtoul(a_value, &p, 10);
+	if (*p == ',') a_maximum = std::strtoul(p + 1, nullptr, 10);
+}
+
+}
 
 int main(int argc, char* argv[])
 {
 	auto debug = false;
 	auto verbose = false;
+	auto dump_passes = false;
+	const char* cache = nullptr;
+	size_t stack = lilis::t_engine::c_STACK;
+	size_t stack_maximum = lilis::t_engine::c_STACK_MAXIMUM;
+	size_t frames = lilis::t_engine::c_FRAMES;
+	size_t frames_maximum = lilis::t_engine::c_FRAMES_MAXIMUM;
 	{
 		auto end = argv + argc;
 		auto q = argv;
@@ -17,6 +38,14 @@ int main(int argc, char* argv[])
 					debug = true;
 				else if (std::strcmp(v, "verbose") == 0)
 					verbose = true;
+				else if (std::strcmp(v, "dump-passes") == 0)
+					dump_passes = true;
+				else if (std::strncmp(v, "cache=", 6) == 0)
+					cache = v + 6;
+				else if (std::strncmp(v, "stack=", 6) == 0)
+					f_sizes(v + 6, stack, stack_maximum);
+				else if (std::strncmp(v, "frames=", 7) == 0)
+					f_sizes(v + 7, frames, frames_maximum);
 			} else {
 				*q++ = *p;
 			}
@@ -27,8 +56,15 @@ int main(int argc, char* argv[])
 		std::wcerr << L"usage: " << argv[0] << " [options] <script> ..." << std::endl;
 		return -1;
 	}
+	// Sources, the standard streams, and strings are in UTF-8 regardless of the environment.
+	try {
+		std::locale::global(std::locale("C.UTF-8"));
+	} catch (std::runtime_error&) {
+	}
 	using namespace lilis;
-	t_engine engine(debug, verbose);
+	t_engine engine(debug, verbose, std::max<size_t>(stack, 16), stack_maximum, std::max<size_t>(frames, 4), frames_maximum);
+	if (cache) engine.v_cache = std::filesystem::absolute(cache);
+	engine.v_dump_passes = dump_passes;
 	try {
 		auto path = std::filesystem::absolute(argv[1]);
 		if (auto expressions = engine.f_pointer(engine.f_parse(path))) {
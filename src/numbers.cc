@@ -0,0 +1,363 @@
+#include "code.h"
+#include "numbers.h"
+#include <cwctype>
+
+namespace lilis
+{
+
+namespace
+{
+
+using t_digits = std::vector<uint32_t>;
+
+// Operands of at least this many digits are multiplied by Karatsuba's algorithm.
+constexpr size_t c_KARATSUBA = 32;
+
+void f_trim(t_digits& a_x)
+{
+	while (!a_x.empty() && a_x.back() == 0) a_x.pop_back();
+}
+
+int f_compare_digits(const t_digits& a_x, const t_digits& a_y)
+{
+	if (a_x.size() != a_y.size()) return a_x.size() < a_y.size() ? -1 : 1;
+	for (size_t i = a_x.size(); i > 0;) {
+		--i;
+		if (a_x[i] != a_y[i]) return a_x[i] < a_y[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+// Adds a_y shifted left by a_shift digits to a_x.
+void f_add(t_digits& a_x, const t_digits& a_y, size_t a_shift = 0)
+{
+	if (a_x.size() < a_y.size() + a_shift) a_x.resize(a_y.size() + a_shift);
+	uint64_t carry = 0;
+	size_t i = 0;
+	for (; i < a_y.size(); ++i) {
+		carry += uint64_t(a_x[i + a_shift]) + a_y[i];
+		a_x[i + a_shift] = carry;
+		carry >>= 32;
+	}
+	for (i += a_shift; carry > 0 && i < a_x.size(); ++i) {
+		carry += a_x[i];
+		a_x[i] = carry;
+		carry >>= 32;
+	}
+	if (carry > 0) a_x.push_back(carry);
+}
+
+// Subtracts a_y from a_x, which must not be less than a_y.
+void f_subtract(t_digits& a_x, const t_digits& a_y)
+{
+	int64_t borrow = 0;
+	size_t i = 0;
+	for (; i < a_y.size(); ++i) {
+		borrow += int64_t(a_x[i]) - a_y[i];
+		a_x[i] = borrow;
+		borrow >>= 32;
+	}
+	for (; borrow < 0 && i < a_x.size(); ++i) {
+		borrow += a_x[i];
+		a_x[i] = borrow;
+		borrow >>= 32;
+	}
+	f_trim(a_x);
+}
+
+t_digits f_multiply(const t_digits& a_x, const t_digits& a_y);
+
+t_digits f_schoolbook(const t_digits& a_x, const t_digits& a_y)
+{
+	t_digits z(a_x.size() + a_y.size());
+	for (size_t i = 0; i < a_x.size(); ++i) {
+		uint64_t carry = 0;
+		for (size_t j = 0; j < a_y.size(); ++j) {
+			carry += uint64_t(a_x[i]) * a_y[j] + z[i + j];
+			z[i + j] = carry;
+			carry >>= 32;
+		}
+		z[i + a_y.size()] = carry;
+	}
+	f_trim(z);
+	return z;
+}
+
+t_digits f_slice(const t_digits& a_x, size_t a_i, size_t a_j)
+{
+	t_digits z(a_x.begin() + std::min(a_i, a_x.size()), a_x.begin() + std::min(a_j, a_x.size()));
+	f_trim(z);
+	return z;
+}
+
+// Splits the longer operand into halves of m digits, and computes x1 * y1, x0 * y0, and (x0 + x1) * (y0 + y1) - x1 * y1 - x0 * y0 instead of the four products.
+t_digits f_karatsuba(const t_digits& a_x, const t_digits& a_y)
+{
+	auto m = a_x.size() / 2;
+	auto x0 = f_slice(a_x, 0, m);
+	auto x1 = f_slice(a_x, m, a_x.size());
+	if (a_y.size() <= m) {
+		auto z = f_multiply(x0, a_y);
+		f_add(z, f_multiply(x1, a_y), m);
+		f_trim(z);
+		return z;
+	}
+	auto y0 = f_slice(a_y, 0, m);
+	auto y1 = f_slice(a_y, m, a_y.size());
+	auto z0 = f_multiply(x0, y0);
+	auto z2 = f_multiply(x1, y1);
+	f_add(x0, x1);
+	f_add(y0, y1);
+	auto z1 = f_multiply(x0, y0);
+	f_subtract(z1, z0);
+	f_subtract(z1, z2);
+	f_add(z0, z1, m);
+	f_add(z0, z2, m * 2);
+	f_trim(z0);
+	return z0;
+}
+
+t_digits f_multiply(const t_digits& a_x, const t_digits& a_y)
+{
+	if (a_x.size() < a_y.size()) return f_multiply(a_y, a_x);
+	if (a_y.empty()) return {};
+	return a_y.size() < c_KARATSUBA ? f_schoolbook(a_x, a_y) : f_karatsuba(a_x, a_y);
+}
+
+// Divides a_x by a_y into a_q and a_r by Knuth's Algorithm D.
+void f_divide_digits(const t_digits& a_x, const t_digits& a_y, t_digits& a_q, t_digits& a_r)
+{
+	if (f_compare_digits(a_x, a_y) < 0) {
+		a_q.clear();
+		a_r = a_x;
+		return;
+	}
+	auto n = a_y.size();
+	auto m = a_x.size() - n;
+	a_q.assign(m + 1, 0);
+	if (n == 1) {
+		uint64_t r = 0;
+		for (size_t i = a_x.size(); i > 0;) {
+			--i;
+			r = r << 32 | a_x[i];
+			a_q[i] = r / a_y[0];
+			r %= a_y[0];
+		}
+		f_trim(a_q);
+		a_r.clear();
+		if (r > 0) a_r.push_back(r);
+		return;
+	}
+	// Normalizes so that the most significant digit of the divisor has its highest bit set.
+	auto s = std::countl_zero(a_y.back());
+	t_digits v(n);
+	for (size_t i = n - 1; i > 0; --i) v[i] = a_y[i] << s | (s > 0 ? uint64_t(a_y[i - 1]) >> (32 - s) : 0);
+	v[0] = a_y[0] << s;
+	t_digits u(m + n + 1);
+	u[m + n] = s > 0 ? a_x[m + n - 1] >> (32 - s) : 0;
+	for (size_t i = m + n - 1; i > 0; --i) u[i] = a_x[i] << s | (s > 0 ? uint64_t(a_x[i - 1]) >> (32 - s) : 0);
+	u[0] = a_x[0] << s;
+	constexpr uint64_t b = uint64_t(1) << 32;
+	for (size_t j = m + 1; j > 0;) {
+		--j;
+		auto x = uint64_t(u[j + n]) << 32 | u[j + n - 1];
+		auto qhat = x / v[n - 1];
+		auto rhat = x % v[n - 1];
+		while (qhat >= b || qhat * v[n - 2] > (rhat << 32 | u[j + n - 2])) {
+			--qhat;
+			rhat += v[n - 1];
+			if (rhat >= b) break;
+		}
+		int64_t borrow = 0;
+		uint64_t carry = 0;
+		for (size_t i = 0; i < n; ++i) {
+			carry += qhat * v[i];
+			borrow += int64_t(u[i + j]) - int64_t(carry & 0xffffffff);
+			u[i + j] = borrow;
+			borrow >>= 32;
+			carry >>= 32;
+		}
+		borrow += int64_t(u[j + n]) - int64_t(carry);
+		u[j + n] = borrow;
+		if (borrow < 0) {
+			// qhat was one too large.
+			--qhat;
+			uint64_t carry = 0;
+			for (size_t i = 0; i < n; ++i) {
+				carry += uint64_t(u[i + j]) + v[i];
+				u[i + j] = carry;
+				carry >>= 32;
+			}
+			u[j + n] += carry;
+		}
+		a_q[j] = qhat;
+	}
+	f_trim(a_q);
+	a_r.resize(n);
+	for (size_t i = 0; i < n; ++i) a_r[i] = u[i] >> s | (s > 0 ? uint64_t(u[i + 1]) << (32 - s) : 0);
+	f_trim(a_r);
+}
+
+// Multiplies a_x by a_y and adds a_z.
+void f_multiply_add(t_digits& a_x, uint32_t a_y, uint32_t a_z)
+{
+	uint64_t carry = a_z;
+	for (auto& x : a_x) {
+		carry += uint64_t(x) * a_y;
+		x = carry;
+		carry >>= 32;
+	}
+	if (carry > 0) a_x.push_back(carry);
+}
+
+t_integer f_integer(bool a_negative, t_digits&& a_digits)
+{
+	t_integer z;
+	z.v_digits = std::move(a_digits);
+	f_trim(z.v_digits);
+	z.v_negative = a_negative && !z.v_digits.empty();
+	return z;
+}
+
+}
+
+t_integer t_integer::f_parse(std::wstring_view a_cs, int a_base)
+{
+	auto negative = !a_cs.empty() && a_cs[0] == L'-';
+	if (!a_cs.empty() && (a_cs[0] == L'-' || a_cs[0] == L'+')) a_cs.remove_prefix(1);
+	if (a_base == 16 && a_cs.size() > 1 && a_cs[0] == L'0' && (a_cs[1] == L'x' || a_cs[1] == L'X')) a_cs.remove_prefix(2);
+	t_digits digits;
+	for (auto c : a_cs) f_multiply_add(digits, a_base, std::iswdigit(c) ? c - L'0' : std::towlower(c) - L'a' + 10);
+	return f_integer(negative, std::move(digits));
+}
+
+t_integer t_integer::f_from(double a_value)
+{
+	a_value = std::trunc(a_value);
+	if (std::abs(a_value) < 0x1p62) return t_integer(static_cast<intptr_t>(a_value));
+	// a_value is m * 2^(e - 64) where m has at most 53 significant bits.
+	int e;
+	auto m = static_cast<uint64_t>(std::ldexp(std::frexp(std::abs(a_value), &e), 64));
+	auto shift = e - 64;
+	if (shift < 0) m >>= -shift;
+	t_digits digits{static_cast<uint32_t>(m), static_cast<uint32_t>(m >> 32)};
+	auto z = f_integer(a_value < 0, std::move(digits));
+	// Shifts left by multiplying by powers of two.
+	for (; shift >= 31; shift -= 31) f_multiply_add(z.v_digits, uint32_t(1) << 31, 0);
+	if (shift > 0) f_multiply_add(z.v_digits, uint32_t(1) << shift, 0);
+	return z;
+}
+
+t_integer::t_integer(intptr_t a_value) : v_negative(a_value < 0)
+{
+	uint64_t x = v_negative ? -static_cast<uint64_t>(a_value) : a_value;
+	for (; x > 0; x >>= 32) v_digits.push_back(x);
+}
+
+t_integer::t_integer(t_object* a_value)
+{
+	if (f_is_fixnum(a_value)) {
+		*this = t_integer(f_fixnum_value(a_value));
+	} else {
+		auto p = static_cast<t_bignum*>(a_value);
+		v_negative = p->v_negative;
+		v_digits.assign(p->f_digits(), p->f_digits() + p->v_size);
+	}
+}
+
+t_object* t_integer::f_object(gc::t_collector& a_collector) const
+{
+	if (v_digits.size() <= 2) {
+		uint64_t x = 0;
+		for (size_t i = v_digits.size(); i > 0;) x = x << 32 | v_digits[--i];
+		if (v_negative ? x <= static_cast<uint64_t>(c_FIXNUM_MAX) + 1 : x <= static_cast<uint64_t>(c_FIXNUM_MAX)) return f_fixnum(v_negative ? -static_cast<intptr_t>(x - 1) - 1 : static_cast<intptr_t>(x));
+	}
+	auto p = t_bignum::f_new(a_collector, v_negative, v_digits.size());
+	std::copy(v_digits.begin(), v_digits.end(), p->f_digits());
+	return p;
+}
+
+double t_integer::f_double() const
+{
+	double z = 0.0;
+	for (size_t i = v_digits.size(); i > 0;) z = z * 0x1p32 + v_digits[--i];
+	return v_negative ? -z : z;
+}
+
+std::wstring t_integer::f_string() const
+{
+	if (v_digits.empty()) return L"0"s;
+	// Divides by 10^9 repeatedly and writes the remainders.
+	auto x = v_digits;
+	std::wstring s;
+	while (!x.empty()) {
+		uint64_t r = 0;
+		for (size_t i = x.size(); i > 0;) {
+			--i;
+			r = r << 32 | x[i];
+			x[i] = r / 1000000000;
+			r %= 1000000000;
+		}
+		f_trim(x);
+		for (size_t i = 0; i < 9 && (!x.empty() || r > 0); ++i, r /= 10) s.push_back(L'0' + r % 10);
+	}
+	if (v_negative) s.push_back(L'-');
+	return {s.rbegin(), s.rend()};
+}
+
+t_integer t_integer::operator-() const
+{
+	auto z = *this;
+	z.v_negative = !v_negative && !v_digits.empty();
+	return z;
+}
+
+t_integer operator+(const t_integer& a_x, const t_integer& a_y)
+{
+	if (a_x.v_negative == a_y.v_negative) {
+		auto z = a_x.v_digits;
+		f_add(z, a_y.v_digits);
+		return f_integer(a_x.v_negative, std::move(z));
+	}
+	if (f_compare_digits(a_x.v_digits, a_y.v_digits) < 0) {
+		auto z = a_y.v_digits;
+		f_subtract(z, a_x.v_digits);
+		return f_integer(a_y.v_negative, std::move(z));
+	}
+	auto z = a_x.v_digits;
+	f_subtract(z, a_y.v_digits);
+	return f_integer(a_x.v_negative, std::move(z));
+}
+
+t_integer operator-(const t_integer& a_x, const t_integer& a_y)
+{
+	return a_x + -a_y;
+}
+
+t_integer operator*(const t_integer& a_x, const t_integer& a_y)
+{
+	return f_integer(a_x.v_negative != a_y.v_negative, f_multiply(a_x.v_digits, a_y.v_digits));
+}
+
+void t_integer::f_divide(const t_integer& a_y, t_integer& a_q, t_integer& a_r) const
+{
+	t_digits q;
+	t_digits r;
+	f_divide_digits(v_digits, a_y.v_digits, q, r);
+	a_q = f_integer(v_negative != a_y.v_negative, std::move(q));
+	a_r = f_integer(v_negative, std::move(r));
+}
+
+int t_integer::f_compare(const t_integer& a_y) const
+{
+	if (v_negative != a_y.v_negative) return v_negative ? -1 : 1;
+	auto z = f_compare_digits(v_digits, a_y.v_digits);
+	return v_negative ? -z : z;
+}
+
+void t_bignum::f_dump(const t_dump& a_dump) const
+{
+	a_dump << t_integer(const_cast<t_bignum*>(this)).f_string();
+}
+
+}
@@ -0,0 +1,248 @@
+#ifndef LILIS__NUMBERS_H
+#define LILIS__NUMBERS_H
+
+#include "engine.h"
+#include <cmath>
+#include <vector>
+
+namespace lilis
+{
+
+// An integer computed out of the heap, in sign and magnitude as t_bignum.
+struct t_integer
+{
+	bool v_negative = false;
+	std::vector<uint32_t> v_digits;
+
+	static t_integer f_parse(std::wstring_view a_cs, int a_base);
+	// a_value must be finite.
+	static t_integer f_from(double a_value);
+
+	t_integer() = default;
+	t_integer(intptr_t a_value);
+	// a_value must be a fixnum or a t_bignum.
+	t_integer(t_object* a_value);
+	// Results in a fixnum if in the range.
+	t_object* f_object(gc::t_collector& a_collector) const;
+	double f_double() const;
+	std::wstring f_string() const;
+	bool f_zero() const
+	{
+		return v_digits.empty();
+	}
+	t_integer operator-() const;
+	// Truncates a_q toward zero, and a_r has the sign of this.
+	// a_y must not be zero.
+	void f_divide(const t_integer& a_y, t_integer& a_q, t_integer& a_r) const;
+	int f_compare(const t_integer& a_y) const;
+};
+
+t_integer operator+(const t_integer& a_x, const t_integer& a_y);
+t_integer operator-(const t_integer& a_x, const t_integer& a_y);
+t_integer operator*(const t_integer& a_x, const t_integer& a_y);
+
+// Operations on numbers shared by the arithmetic instructions and builtins.
+// Each stores the result to a_z and returns true, or returns false with t_engine::v_failure set.
+// Fixnums are computed in their tagged forms, for which the overflow checks of the compiler builtins apply as they are.
+// On overflows and for bignums, they are computed in t_integer.
+// Any float operand makes the others converted to doubles.
+
+inline bool f_is_integer(t_object* a_x)
+{
+	return f_is_fixnum(a_x) || f_as<t_bignum>(a_x);
+}
+
+inline bool f_integer(t_engine& a_engine, t_object* a_x)
+{
+	return f_is_integer(a_x) || a_engine.f_fail(L"must be integer"sv);
+}
+
+inline bool f_integers(t_engine& a_engine, t_object* a_x, t_object* a_y)
+{
+	return f_integer(a_engine, a_x) && f_integer(a_engine, a_y);
+}
+
+// Whether a_x is an integer from 0 to a_size inclusive.
+inline bool f_index(t_engine& a_engine, t_object* a_x, size_t a_size)
+{
+	if (!f_integer(a_engine, a_x)) return false;
+	if (!f_is_fixnum(a_x)) return a_engine.f_fail(L"out of range"sv);
+	auto i = f_fixnum_value(a_x);
+	return (i >= 0 && static_cast<size_t>(i) <= a_size) || a_engine.f_fail(L"out of range"sv);
+}
+
+inline bool f_is_float(t_object* a_x)
+{
+	return f_is_flonum(a_x) || f_as<t_float>(a_x);
+}
+
+inline bool f_is_number(t_object* a_x)
+{
+	return f_is_integer(a_x) || f_is_float(a_x);
+}
+
+inline bool f_number(t_engine& a_engine, t_object* a_x)
+{
+	return f_is_number(a_x) || a_engine.f_fail(L"must be number"sv);
+}
+
+inline bool f_double(t_engine& a_engine, t_object* a_x, double& a_z)
+{
+	if (f_is_fixnum(a_x))
+		a_z = f_fixnum_value(a_x);
+	else if (f_is_flonum(a_x))
+		a_z = f_flonum_value(a_x);
+	else if (auto p = f_as<t_float>(a_x))
+		a_z = p->v_value;
+	else if (f_as<t_bignum>(a_x))
+		a_z = t_integer(a_x).f_double();
+	else
+		return a_engine.f_fail(L"must be number"sv);
+	return true;
+}
+
+// Allocates only if a_value is out of the range of flonums.
+inline t_object* f_float(t_engine& a_engine, double a_value)
+{
+	auto p = f_flonum(a_value);
+	return p ? p : a_engine.f_new<t_float>(a_value);
+}
+
+// Computes in doubles if either is a float.
+template<typename T_do>
+inline bool f_floats(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z, T_do a_do)
+{
+	double x;
+	double y;
+	if (!f_double(a_engine, a_x, x) || !f_double(a_engine, a_y, y)) return false;
+	a_z = f_float(a_engine, a_do(x, y));
+	return true;
+}
+
+// Computes in t_integer if both are integers, or in doubles otherwise.
+template<typename T_do, typename T_float>
+inline bool f_bignums(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z, T_do a_do, T_float a_float)
+{
+	if (!f_is_integer(a_x) || !f_is_integer(a_y)) return f_floats(a_engine, a_x, a_y, a_z, a_float);
+	a_z = a_do(t_integer(a_x), t_integer(a_y)).f_object(a_engine);
+	return true;
+}
+
+inline bool f_add(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	intptr_t z;
+	if (!f_is_fixnum(a_x) || !f_is_fixnum(a_y) || __builtin_add_overflow(reinterpret_cast<intptr_t>(a_x), reinterpret_cast<intptr_t>(a_y) - 1, &z)) return f_bignums(a_engine, a_x, a_y, a_z, std::plus<t_integer>(), std::plus<double>());
+	a_z = reinterpret_cast<t_object*>(z);
+	return true;
+}
+
+inline bool f_subtract(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	intptr_t z;
+	if (!f_is_fixnum(a_x) || !f_is_fixnum(a_y) || __builtin_sub_overflow(reinterpret_cast<intptr_t>(a_x), reinterpret_cast<intptr_t>(a_y) - 1, &z)) return f_bignums(a_engine, a_x, a_y, a_z, std::minus<t_integer>(), std::minus<double>());
+	a_z = reinterpret_cast<t_object*>(z);
+	return true;
+}
+
+// Unlike subtracting from 0, keeps the sign of zero floats.
+inline bool f_negate(t_engine& a_engine, t_object* a_x, t_object*& a_z)
+{
+	if (!f_is_float(a_x)) return f_subtract(a_engine, f_fixnum(0), a_x, a_z);
+	double x;
+	if (!f_double(a_engine, a_x, x)) return false;
+	a_z = f_float(a_engine, -x);
+	return true;
+}
+
+inline bool f_multiply(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	intptr_t z;
+	if (!f_is_fixnum(a_x) || !f_is_fixnum(a_y) || __builtin_mul_overflow(f_fixnum_value(a_x), reinterpret_cast<intptr_t>(a_y) - 1, &z)) return f_bignums(a_engine, a_x, a_y, a_z, std::multiplies<t_integer>(), std::multiplies<double>());
+	a_z = reinterpret_cast<t_object*>(z | 1);
+	return true;
+}
+
+// Always results in a float.
+inline bool f_divide(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	return f_floats(a_engine, a_x, a_y, a_z, std::divides<double>());
+}
+
+// Divides in t_integer and stores the quotient to a_q and the remainder to a_r.
+inline bool f_divide_integers(t_engine& a_engine, t_object* a_x, t_object* a_y, t_integer& a_q, t_integer& a_r)
+{
+	if (!f_integers(a_engine, a_x, a_y)) return false;
+	if (a_y == f_fixnum(0)) return a_engine.f_fail(L"division by zero"sv);
+	t_integer(a_x).f_divide(t_integer(a_y), a_q, a_r);
+	return true;
+}
+
+// Truncates toward zero.
+inline bool f_quotient(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	if (f_is_fixnum(a_x) && f_is_fixnum(a_y) && a_y != f_fixnum(0) && !(a_x == f_fixnum(c_FIXNUM_MIN) && a_y == f_fixnum(-1))) {
+		a_z = f_fixnum(f_fixnum_value(a_x) / f_fixnum_value(a_y));
+		return true;
+	}
+	t_integer q;
+	t_integer r;
+	if (!f_divide_integers(a_engine, a_x, a_y, q, r)) return false;
+	a_z = q.f_object(a_engine);
+	return true;
+}
+
+// Has the sign of the dividend.
+inline bool f_remainder(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	if (f_is_fixnum(a_x) && f_is_fixnum(a_y) && a_y != f_fixnum(0)) {
+		a_z = f_fixnum(f_fixnum_value(a_x) % f_fixnum_value(a_y));
+		return true;
+	}
+	t_integer q;
+	t_integer r;
+	if (!f_divide_integers(a_engine, a_x, a_y, q, r)) return false;
+	a_z = r.f_object(a_engine);
+	return true;
+}
+
+// Has the sign of the divisor.
+inline bool f_modulo(t_engine& a_engine, t_object* a_x, t_object* a_y, t_object*& a_z)
+{
+	if (f_is_fixnum(a_x) && f_is_fixnum(a_y) && a_y != f_fixnum(0)) {
+		auto y = f_fixnum_value(a_y);
+		auto z = f_fixnum_value(a_x) % y;
+		if (z != 0 && (z < 0) != (y < 0)) z += y;
+		a_z = f_fixnum(z);
+		return true;
+	}
+	t_integer q;
+	t_integer r;
+	if (!f_divide_integers(a_engine, a_x, a_y, q, r)) return false;
+	t_integer y(a_y);
+	if (!r.f_zero() && r.v_negative != y.v_negative) r = r + y;
+	a_z = r.f_object(a_engine);
+	return true;
+}
+
+// Tagging preserves the order of fixnums.
+template<typename T_compare>
+inline bool f_compare(t_engine& a_engine, t_object* a_x, t_object* a_y, bool& a_z)
+{
+	if (f_is_fixnum(a_x) && f_is_fixnum(a_y)) {
+		a_z = T_compare()(reinterpret_cast<intptr_t>(a_x), reinterpret_cast<intptr_t>(a_y));
+		return true;
+	}
+	if (f_is_integer(a_x) && f_is_integer(a_y)) {
+		a_z = T_compare()(t_integer(a_x).f_compare(t_integer(a_y)), 0);
+		return true;
+	}
+	double x;
+	double y;
+	if (!f_double(a_engine, a_x, x) || !f_double(a_engine, a_y, y)) return false;
+	a_z = T_compare()(x, y);
+	return true;
+}
+
+}
+
+#endif
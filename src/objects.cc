@@ -1,5 +1,9 @@
 #include "code.h"
 #include "builtins.h"
+#include <charconv>
+#include <cmath>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 namespace lilis
 {
@@ -14,20 +18,30 @@ t_object* t_object::f_apply(t_code& a_code, const std::shared_ptr<t_location>& a
 	auto& engine = a_code.v_engine;
 	auto arguments = engine.f_pointer(a_pair->v_tail);
 	auto location = a_location->f_at_tail(a_pair);
-	auto last = engine.f_pointer(engine.f_new<t_pair>(engine.f_pointer(this), nullptr));
-	auto call = engine.f_pointer(engine.f_new<t_call>(last, a_location));
-	while (auto p = dynamic_cast<t_pair*>(arguments.v_value)) {
+	auto last = engine.f_pointer(engine.f_node<t_pair>(engine.f_pointer(this), nullptr));
+	auto call = engine.f_pointer(engine.f_node<t_call>(last, a_location));
+	while (auto p = f_as<t_pair>(arguments.v_value)) {
 		arguments = p->v_tail;
 		location = a_location->f_at_tail(p);
-		f_push(engine, last, a_code.f_render(p->v_head, a_location->f_at_head(p)));
+		engine.f_push_node(last, a_code.f_render(p->v_head, a_location->f_at_head(p)));
 	}
 	if (arguments) {
-		f_push(engine, last, a_code.f_render(arguments, location));
+		engine.f_push_node(last, a_code.f_render(arguments, location));
 		call->v_expand = true;
 	}
 	return call;
 }
 
+t_object* t_object::f_inline(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair)
+{
+	return nullptr;
+}
+
+t_object* t_object::f_optimize(t_code& a_code, const t_pass& a_pass)
+{
+	return a_pass.v_rewrite(a_code, this);
+}
+
 void t_object::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 {
 	a_emit(e_instruction__PUSH, a_stack + 1)(this);
@@ -36,7 +50,26 @@ void t_object::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 void t_object::f_call(t_engine& a_engine, size_t a_arguments)
 {
 	a_engine.v_used -= a_arguments + 1;
-	throw t_error{L"not callable"s};
+	a_engine.f_fail(L"not callable"sv);
+}
+
+void t_object::f_call_with_expansion(t_engine& a_engine, size_t a_arguments)
+{
+	--a_arguments;
+	if (auto last = *--a_engine.v_used)
+		while (true) {
+			auto pair = f_as<t_pair>(last);
+			if (!pair) {
+				a_engine.v_used -= a_arguments + 1;
+				return void(a_engine.f_fail_cast<t_pair>());
+			}
+			*a_engine.v_used++ = pair->v_head;
+			last = pair->v_tail;
+			++a_arguments;
+			if (!last) break;
+			if (a_engine.v_used >= a_engine.v_stack_tail) a_engine.f_grow_stack(a_engine.v_used + 1);
+		}
+	f_call(a_engine, a_arguments);
 }
 
 void t_object::f_dump(const t_dump& a_dump) const
@@ -56,7 +89,9 @@ void t_symbol::f_destruct(gc::t_collector& a_collector)
 
 t_object* t_symbol::f_render(t_code& a_code, const std::shared_ptr<t_location>& a_location)
 {
-	return a_code.f_resolve(this, a_location);
+	auto p = a_code.f_resolve(this, a_location);
+	if (a_code.v_outer) a_code.v_resolved.emplace(this, p);
+	return p;
 }
 
 void t_symbol::f_dump(const t_dump& a_dump) const
@@ -73,7 +108,10 @@ void t_pair::f_scan(gc::t_collector& a_collector)
 t_object* t_pair::f_render(t_code& a_code, const std::shared_ptr<t_location>& a_location)
 {
 	auto thiz = a_code.v_engine.f_pointer(this);
-	return a_code.f_render(v_head, a_location->f_at_head(this))->f_apply(a_code, a_location, thiz);
+	if (auto head = f_as<t_pair>(v_head))
+		if (auto symbol = f_as<t_symbol>(head->v_head))
+			if (auto p = a_code.f_resolve(symbol, a_location->f_at_head(this)->f_at_head(head))->f_inline(a_code, a_location, thiz)) return p;
+	return a_code.f_render(thiz->v_head, a_location->f_at_head(thiz))->f_apply(a_code, a_location, thiz);
 }
 
 void t_pair::f_dump(const t_dump& a_dump) const
@@ -86,10 +124,10 @@ void t_pair::f_dump(const t_dump& a_dump) const
 			a_dump.v_tail(p);
 			break;
 		}
-		auto tail = dynamic_cast<t_pair*>(p->v_tail);
+		auto tail = f_as<t_pair>(p->v_tail);
 		if (!tail) {
 			(a_dump << L" . "sv).v_tail(p);
-			p->v_tail->f_dump(a_dump);
+			a_dump << p->v_tail;
 			break;
 		}
 		(a_dump << L" "sv).v_tail(p);
@@ -98,9 +136,342 @@ void t_pair::f_dump(const t_dump& a_dump) const
 	a_dump << L")"sv;
 }
 
+void t_float::f_dump(const t_dump& a_dump, double a_value)
+{
+	char cs[32];
+	auto p = std::to_chars(cs, cs + sizeof(cs), a_value).ptr;
+	std::wstring s(cs, p);
+	// A fraction is inserted if missing so that it is read back as a float.
+	if (std::isfinite(a_value) && s.find(L'.') == s.npos) s.insert(std::min(s.find(L'e'), s.size()), L".0"sv);
+	a_dump << s;
+}
+
+void t_float::f_dump(const t_dump& a_dump) const
+{
+	f_dump(a_dump, v_value);
+}
+
+std::string f_utf8(std::wstring_view a_value)
+{
+	std::string s;
+	for (uint32_t c : a_value)
+		if (c < 0x80) {
+			s.push_back(c);
+		} else if (c < 0x800) {
+			s.push_back(0xc0 | c >> 6);
+			s.push_back(0x80 | (c & 0x3f));
+		} else if (c < 0x10000) {
+			s.push_back(0xe0 | c >> 12);
+			s.push_back(0x80 | (c >> 6 & 0x3f));
+			s.push_back(0x80 | (c & 0x3f));
+		} else {
+			s.push_back(0xf0 | (c >> 18 & 0x7));
+			s.push_back(0x80 | (c >> 12 & 0x3f));
+			s.push_back(0x80 | (c >> 6 & 0x3f));
+			s.push_back(0x80 | (c & 0x3f));
+		}
+	return s;
+}
+
+std::wstring f_unicode(std::string_view a_value)
+{
+	std::wstring s;
+	for (size_t i = 0; i < a_value.size();) {
+		uint8_t c = a_value[i++];
+		size_t n = c < 0x80 ? 0 : c < 0xc2 ? 4 : c < 0xe0 ? 1 : c < 0xf0 ? 2 : c < 0xf5 ? 3 : 4;
+		if (n > 3) {
+			s.push_back(0xfffd);
+			continue;
+		}
+		uint32_t x = c & 0x7f >> (n > 0 ? n + 1 : 0);
+		auto j = i;
+		for (; j < i + n && j < a_value.size() && (a_value[j] & 0xc0) == 0x80; ++j) x = x << 6 | (a_value[j] & 0x3f);
+		if (j < i + n) {
+			s.push_back(0xfffd);
+			i = j;
+			continue;
+		}
+		i = j;
+		s.push_back(x);
+	}
+	return s;
+}
+
+t_string* t_string::f_new(gc::t_collector& a_collector, size_t a_size)
+{
+	if (a_size > c_INLINE) {
+		std::unique_ptr<char[]> out(new char[a_size]);
+		auto p = a_collector.f_new<t_string>(a_size, out.get());
+		out.release();
+		a_collector.f_charge(a_size);
+		return p;
+	}
+	auto p = a_collector.f_allocate(std::max((sizeof(t_string) + a_size + alignof(t_object) - 1) & ~(alignof(t_object) - 1), sizeof(gc::t_collector::t_forward)));
+	return new(p) t_string(a_size, nullptr);
+}
+
+void t_string::f_destruct(gc::t_collector& a_collector)
+{
+	delete[] v_out;
+}
+
+void t_string::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L'"';
+	for (auto c : f_unicode(f_view()))
+		switch (c) {
+		case L'"':
+			a_dump << L"\\\""sv;
+			break;
+		case L'\0':
+			a_dump << L"\\0"sv;
+			break;
+		case L'\\':
+			a_dump << L"\\\\"sv;
+			break;
+		case L'\a':
+			a_dump << L"\\a"sv;
+			break;
+		case L'\b':
+			a_dump << L"\\b"sv;
+			break;
+		case L'\f':
+			a_dump << L"\\f"sv;
+			break;
+		case L'\n':
+			a_dump << L"\\n"sv;
+			break;
+		case L'\r':
+			a_dump << L"\\r"sv;
+			break;
+		case L'\t':
+			a_dump << L"\\t"sv;
+			break;
+		case L'\v':
+			a_dump << L"\\v"sv;
+			break;
+		default:
+			a_dump << c;
+		}
+	a_dump << L'"';
+}
+
+t_bytevector* t_bytevector::f_new(gc::t_collector& a_collector, size_t a_size)
+{
+	if (a_size > c_INLINE) {
+		std::unique_ptr<uint8_t[]> out(new uint8_t[a_size]());
+		auto p = a_collector.f_new<t_bytevector>(a_size, out.get(), false);
+		out.release();
+		a_collector.f_charge(a_size);
+		return p;
+	}
+	auto p = a_collector.f_allocate(std::max((sizeof(t_bytevector) + a_size + alignof(t_object) - 1) & ~(alignof(t_object) - 1), sizeof(gc::t_collector::t_forward)));
+	auto q = new(p) t_bytevector(a_size, nullptr, false);
+	std::fill_n(q->f_data(), a_size, 0);
+	return q;
+}
+
+t_bytevector* t_bytevector::f_map(gc::t_collector& a_collector, const std::string& a_path)
+{
+	auto fd = open(a_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return nullptr;
+	struct stat status;
+	auto failed = fstat(fd, &status) != 0 || !S_ISREG(status.st_mode);
+	size_t size = failed ? 0 : status.st_size;
+	void* out = nullptr;
+	if (size > 0) {
+		out = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (out == MAP_FAILED) failed = true;
+	}
+	close(fd);
+	if (failed) return nullptr;
+	t_bytevector* p;
+	try {
+		p = a_collector.f_new<t_bytevector>(size, static_cast<uint8_t*>(out), true);
+	} catch (...) {
+		if (out) munmap(out, size);
+		throw;
+	}
+	a_collector.f_charge(size);
+	return p;
+}
+
+void t_bytevector::f_destruct(gc::t_collector& a_collector)
+{
+	if (!v_mapped)
+		delete[] v_out;
+	else if (v_out)
+		munmap(v_out, v_size);
+}
+
+void t_bytevector::f_dump(const t_dump& a_dump) const
+{
+	// Mapped files can be too large to print.
+	if (v_mapped) return void(a_dump << L"#mapped-bytevector"sv);
+	a_dump << L"#u8("sv;
+	for (size_t i = 0; i < v_size; ++i) {
+		if (i > 0) a_dump << L' ';
+		a_dump << std::to_wstring(f_data()[i]);
+	}
+	a_dump << L')';
+}
+
+t_vector* t_vector::f_new(gc::t_collector& a_collector, size_t a_size)
+{
+	if (a_size > c_INLINE) {
+		std::unique_ptr<t_object*[]> out(new t_object*[a_size]);
+		auto p = a_collector.f_new<t_vector>(a_size, out.get());
+		out.release();
+		a_collector.f_charge(sizeof(t_object*) * a_size);
+		return p;
+	}
+	return new(a_collector.f_allocate(std::max(sizeof(t_vector) + sizeof(t_object*) * a_size, sizeof(gc::t_collector::t_forward)))) t_vector(a_size, nullptr);
+}
+
+void t_vector::f_scan(gc::t_collector& a_collector)
+{
+	a_collector.f_forward(f_elements(), v_size);
+}
+
+void t_vector::f_destruct(gc::t_collector& a_collector)
+{
+	delete[] v_out;
+}
+
+void t_vector::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#("sv;
+	for (size_t i = 0; i < v_size; ++i) {
+		if (i > 0) a_dump << L' ';
+		a_dump << f_elements()[i];
+	}
+	a_dump << L')';
+}
+
+void t_hash_table::f_scan(gc::t_collector& a_collector)
+{
+	// Free slots have immediate keys, which are not forwarded.
+	for (size_t i = 0; i < v_capacity; ++i) {
+		auto& x = v_entries[i];
+		if (!v_weak) x.v_key = a_collector.f_forward(x.v_key);
+		x.v_value = a_collector.f_forward(x.v_value);
+	}
+	if (v_weak) a_collector.v_weaks.push_back(this);
+}
+
+void t_hash_table::f_destruct(gc::t_collector& a_collector)
+{
+	delete[] v_entries;
+}
+
+void t_hash_table::f_sweep(gc::t_collector& a_collector)
+{
+	for (size_t i = 0; i < v_capacity; ++i) {
+		auto& x = v_entries[i];
+		if (x.v_key == c_EMPTY || x.v_key == c_REMOVED || a_collector.f_survive(x.v_key)) continue;
+		x = {c_REMOVED, nullptr};
+		--v_size;
+	}
+}
+
+void t_hash_table::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#hash-table"sv;
+}
+
+void t_hash_table::f_rehash(gc::t_collector& a_collector, size_t a_capacity)
+{
+	std::unique_ptr<t_entry[]> entries(v_entries);
+	auto capacity = v_capacity;
+	v_entries = new t_entry[a_capacity];
+	v_capacity = a_capacity;
+	// The old entries are freed right away, so only growth is charged.
+	if (a_capacity > capacity) a_collector.f_charge(sizeof(t_entry) * (a_capacity - capacity));
+	std::fill_n(v_entries, v_capacity, t_entry{c_EMPTY, nullptr});
+	for (size_t i = 0; i < capacity; ++i) {
+		auto& x = entries[i];
+		if (x.v_key == c_EMPTY || x.v_key == c_REMOVED) continue;
+		auto j = f_hash(x.v_key);
+		while (v_entries[j].v_key != c_EMPTY) j = (j + 1) & (v_capacity - 1);
+		v_entries[j] = x;
+	}
+	v_used = v_size;
+	v_epoch = a_collector.v_epoch;
+}
+
+t_hash_table::t_entry* t_hash_table::f_find(gc::t_collector& a_collector, t_object* a_key)
+{
+	if (v_size <= 0) return nullptr;
+	if (v_epoch != a_collector.v_epoch) f_rehash(a_collector, v_capacity);
+	for (auto i = f_hash(a_key);; i = (i + 1) & (v_capacity - 1)) {
+		auto& x = v_entries[i];
+		if (x.v_key == a_key) return &x;
+		if (x.v_key == c_EMPTY) return nullptr;
+	}
+}
+
+void t_hash_table::f_put(gc::t_collector& a_collector, t_object* a_key, t_object* a_value)
+{
+	if (auto p = f_find(a_collector, a_key)) {
+		p->v_value = a_value;
+		return;
+	}
+	// Keeps at least a quarter of the slots empty so that probing terminates quickly.
+	if ((v_used + 1) * 4 > v_capacity * 3)
+		f_rehash(a_collector, std::max<size_t>(std::bit_ceil((v_size + 1) * 2), 8));
+	else if (v_epoch != a_collector.v_epoch)
+		f_rehash(a_collector, v_capacity);
+	auto i = f_hash(a_key);
+	while (v_entries[i].v_key != c_EMPTY && v_entries[i].v_key != c_REMOVED) i = (i + 1) & (v_capacity - 1);
+	if (v_entries[i].v_key == c_EMPTY) ++v_used;
+	v_entries[i] = {a_key, a_value};
+	++v_size;
+}
+
+bool t_hash_table::f_remove(gc::t_collector& a_collector, t_object* a_key)
+{
+	auto p = f_find(a_collector, a_key);
+	if (!p) return false;
+	*p = {c_REMOVED, nullptr};
+	--v_size;
+	return true;
+}
+
+void t_record_type::f_scan(gc::t_collector& a_collector)
+{
+	v_name = a_collector.f_forward(v_name);
+}
+
+void t_record_type::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#"sv << v_name;
+}
+
+t_record* t_record::f_new(gc::t_collector& a_collector, size_t a_size)
+{
+	return new(a_collector.f_allocate(std::max(sizeof(t_record) + sizeof(t_object*) * a_size, sizeof(gc::t_collector::t_forward)))) t_record(a_size);
+}
+
+void t_record::f_scan(gc::t_collector& a_collector)
+{
+	v_type = a_collector.f_forward(v_type);
+	a_collector.f_forward(f_fields(), v_size);
+}
+
+void t_record::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#"sv << v_type->v_name << L"("sv;
+	for (size_t i = 0; i < v_size; ++i) {
+		if (i > 0) a_dump << L' ';
+		a_dump << f_fields()[i];
+	}
+	a_dump << L')';
+}
+
 void t_quote::f_emit(t_emit& a_emit, size_t a_stack, bool a_tail)
 {
-	a_emit(e_instruction__PUSH, a_stack + 1)(v_value);
+	auto value = a_emit.v_code->v_engine.v_constants.f_intern(v_value);
+	a_emit(e_instruction__PUSH, a_stack + 1)(value);
 }
 
 void t_quote::f_dump(const t_dump& a_dump) const
@@ -2,6 +2,7 @@
 #define LILIS__OBJECTS_H
 
 #include "gc.h"
+#include <bit>
 #include <functional>
 #include <map>
 #include <string>
@@ -16,6 +17,7 @@ struct t_code;
 struct t_location;
 struct t_pair;
 struct t_emit;
+struct t_pass;
 
 struct t_dump
 {
@@ -38,11 +40,71 @@ struct t_object : gc::t_object
 {
 	virtual t_object* f_render(t_code& a_code, const std::shared_ptr<t_location>& a_location);
 	virtual t_object* f_apply(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair);
+	virtual t_object* f_inline(t_code& a_code, const std::shared_ptr<t_location>& a_location, t_pair* a_pair);
+	virtual t_object* f_optimize(t_code& a_code, const t_pass& a_pass);
 	virtual void f_emit(t_emit& a_emit, size_t a_stack, bool a_tail);
 	virtual void f_call(t_engine& a_engine, size_t a_arguments);
+	// Called with the last of a_arguments being a list to be spread into arguments.
+	virtual void f_call_with_expansion(t_engine& a_engine, size_t a_arguments);
 	virtual void f_dump(const t_dump& a_dump) const;
 };
 
+// Integers are immediates shifted left by one bit with the lowest bit set.
+constexpr intptr_t c_FIXNUM_MIN = INTPTR_MIN >> 1;
+constexpr intptr_t c_FIXNUM_MAX = INTPTR_MAX >> 1;
+
+inline bool f_is_fixnum(const t_object* a_value)
+{
+	return reinterpret_cast<uintptr_t>(a_value) & 1;
+}
+
+inline t_object* f_fixnum(intptr_t a_value)
+{
+	return reinterpret_cast<t_object*>(static_cast<uintptr_t>(a_value) << 1 | 1);
+}
+
+inline intptr_t f_fixnum_value(const t_object* a_value)
+{
+	return reinterpret_cast<intptr_t>(a_value) >> 1;
+}
+
+// Floats with exponents in the middle of the range, and +0.0, are immediates with their bits rotated left by 3 and the lowest two bits set to 10.
+// The bits shifted out are recovered from the lowest bit of the exponent.
+// The others are boxed in t_float.
+constexpr uint64_t c_FLONUM_ZERO = 0x8000000000000002;
+
+inline bool f_is_flonum(const t_object* a_value)
+{
+	return (reinterpret_cast<uintptr_t>(a_value) & 3) == 2;
+}
+
+// Returns nullptr if a_value is not representable.
+inline t_object* f_flonum(double a_value)
+{
+	if constexpr (sizeof(uintptr_t) < sizeof(double)) {
+		return nullptr;
+	} else {
+		auto bits = std::bit_cast<uint64_t>(a_value);
+		auto top = bits >> 60 & 7;
+		if ((top == 3 || top == 4) && bits != 0x3000000000000000) return reinterpret_cast<t_object*>((std::rotl(bits, 3) & ~uint64_t(1)) | 2);
+		return bits == 0 ? reinterpret_cast<t_object*>(c_FLONUM_ZERO) : nullptr;
+	}
+}
+
+inline double f_flonum_value(const t_object* a_value)
+{
+	uint64_t bits = reinterpret_cast<uintptr_t>(a_value);
+	if (bits == c_FLONUM_ZERO) return 0.0;
+	return std::bit_cast<double>(std::rotr((2 - (bits >> 63)) | (bits & ~uint64_t(3)), 3));
+}
+
+// dynamic_cast which also rejects immediates.
+template<typename T>
+inline T* f_as(t_object* a_value)
+{
+	return gc::f_is_immediate(a_value) ? nullptr : dynamic_cast<T*>(a_value);
+}
+
 template<typename T, typename T_base = t_object>
 struct t_object_of : T_base
 {
@@ -125,9 +187,264 @@ struct t_quasiquote : t_with_value<t_object_of<t_quasiquote>, t_object>
 	virtual void f_dump(const t_dump& a_dump) const;
 };
 
+struct t_float : t_object_of<t_float>
+{
+	double v_value;
+
+	static void f_dump(const t_dump& a_dump, double a_value);
+
+	t_float(double a_value) : v_value(a_value)
+	{
+	}
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+std::string f_utf8(std::wstring_view a_value);
+// Invalid sequences are decoded to U+FFFD.
+std::wstring f_unicode(std::string_view a_value);
+
+// Immutable UTF-8 bytes.
+// Up to c_INLINE bytes are stored inline following the object.
+// Longer ones are stored out of line, where they never move, so that the collector does not copy them.
+struct t_string : t_object_of<t_string>
+{
+	static constexpr size_t c_INLINE = 64;
+
+	// The bytes are to be filled through f_data().
+	static t_string* f_new(gc::t_collector& a_collector, size_t a_size);
+	// a_value must not be in the heap of a_collector.
+	static t_string* f_new(gc::t_collector& a_collector, std::string_view a_value)
+	{
+		auto p = f_new(a_collector, a_value.size());
+		std::copy(a_value.begin(), a_value.end(), p->f_data());
+		return p;
+	}
+
+	size_t v_size;
+	char* v_out;
+
+	t_string(size_t a_size, char* a_out) : v_size(a_size), v_out(a_out)
+	{
+	}
+	virtual size_t f_size() const
+	{
+		if (v_out) return sizeof(t_string);
+		return std::max((sizeof(t_string) + v_size + alignof(t_object) - 1) & ~(alignof(t_object) - 1), sizeof(gc::t_collector::t_forward));
+	}
+	virtual void f_destruct(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+	char* f_data()
+	{
+		return v_out ? v_out : reinterpret_cast<char*>(this + 1);
+	}
+	const char* f_data() const
+	{
+		return v_out ? v_out : reinterpret_cast<const char*>(this + 1);
+	}
+	std::string_view f_view() const
+	{
+		return {f_data(), v_size};
+	}
+};
+
+// Bytes stored like t_string, or mapped from a file read only.
+// Either way only the object is moved by the collector.
+struct t_bytevector : t_object_of<t_bytevector>
+{
+	static constexpr size_t c_INLINE = 64;
+
+	// The bytes are initialized to zero.
+	static t_bytevector* f_new(gc::t_collector& a_collector, size_t a_size);
+	// Returns nullptr if a_path is unable to be mapped.
+	static t_bytevector* f_map(gc::t_collector& a_collector, const std::string& a_path);
+
+	size_t v_size;
+	uint8_t* v_out;
+	bool v_mapped;
+
+	t_bytevector(size_t a_size, uint8_t* a_out, bool a_mapped) : v_size(a_size), v_out(a_out), v_mapped(a_mapped)
+	{
+	}
+	virtual size_t f_size() const
+	{
+		if (v_out) return sizeof(t_bytevector);
+		return std::max((sizeof(t_bytevector) + v_size + alignof(t_object) - 1) & ~(alignof(t_object) - 1), sizeof(gc::t_collector::t_forward));
+	}
+	virtual void f_destruct(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+	uint8_t* f_data()
+	{
+		return v_out ? v_out : reinterpret_cast<uint8_t*>(this + 1);
+	}
+	const uint8_t* f_data() const
+	{
+		return v_out ? v_out : reinterpret_cast<const uint8_t*>(this + 1);
+	}
+};
+
+// An integer out of the range of fixnums in sign and magnitude.
+// The digits of the magnitude in base 2^32 follow the object from the least significant one, without leading zeros.
+struct t_bignum : t_object_of<t_bignum>
+{
+	static size_t f_size(size_t a_size)
+	{
+		return std::max((sizeof(t_bignum) + sizeof(uint32_t) * a_size + alignof(t_object) - 1) & ~(alignof(t_object) - 1), sizeof(gc::t_collector::t_forward));
+	}
+	// The digits are to be filled through f_digits().
+	static t_bignum* f_new(gc::t_collector& a_collector, bool a_negative, size_t a_size)
+	{
+		return new(a_collector.f_allocate(f_size(a_size))) t_bignum(a_negative, a_size);
+	}
+
+	bool v_negative;
+	uint32_t v_size;
+
+	t_bignum(bool a_negative, size_t a_size) : v_negative(a_negative), v_size(a_size)
+	{
+	}
+	virtual size_t f_size() const
+	{
+		return f_size(v_size);
+	}
+	virtual void f_dump(const t_dump& a_dump) const;
+	uint32_t* f_digits()
+	{
+		return reinterpret_cast<uint32_t*>(this + 1);
+	}
+	const uint32_t* f_digits() const
+	{
+		return reinterpret_cast<const uint32_t*>(this + 1);
+	}
+};
+
+// A fixed number of values.
+// Up to c_INLINE values are stored inline following the object.
+// More are stored out of line like t_string, so that the collector does not copy them and allocating too many fails before touching the heap.
+struct t_vector : t_object_of<t_vector>
+{
+	static constexpr size_t c_INLINE = 16;
+
+	// The elements are initialized to nil.
+	static t_vector* f_new(gc::t_collector& a_collector, size_t a_size);
+
+	size_t v_size;
+	t_object** v_out;
+
+	t_vector(size_t a_size, t_object** a_out) : v_size(a_size), v_out(a_out)
+	{
+		std::fill_n(f_elements(), v_size, nullptr);
+	}
+	virtual size_t f_size() const
+	{
+		if (v_out) return sizeof(t_vector);
+		return std::max(sizeof(t_vector) + sizeof(t_object*) * v_size, sizeof(gc::t_collector::t_forward));
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_destruct(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+	t_object** f_elements()
+	{
+		return v_out ? v_out : reinterpret_cast<t_object**>(this + 1);
+	}
+	t_object* const* f_elements() const
+	{
+		return v_out ? v_out : reinterpret_cast<t_object* const*>(this + 1);
+	}
+};
+
+// A hash table of eq? keys in open addressing with linear probing.
+// Keys are hashed by their addresses, so the table is rehashed when accessed after the collector has moved objects.
+// Keys of a weak table do not keep them alive, and the entries of dead keys are removed by collections.
+struct t_hash_table : t_object_of<t_hash_table>
+{
+	struct t_entry
+	{
+		t_object* v_key;
+		t_object* v_value;
+	};
+
+	// Keys of free slots, which are immediates with the low bits 100 unused by any values.
+	static inline t_object* const c_EMPTY = reinterpret_cast<t_object*>(4);
+	static inline t_object* const c_REMOVED = reinterpret_cast<t_object*>(12);
+
+	t_entry* v_entries = nullptr;
+	// Zero or a power of two.
+	size_t v_capacity = 0;
+	size_t v_size = 0;
+	// Including removed slots.
+	size_t v_used = 0;
+	size_t v_epoch = 0;
+	bool v_weak;
+
+	t_hash_table(bool a_weak) : v_weak(a_weak)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_destruct(gc::t_collector& a_collector);
+	virtual void f_sweep(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+	size_t f_hash(t_object* a_key) const
+	{
+		auto x = reinterpret_cast<uintptr_t>(a_key) * 0x9e3779b97f4a7c15;
+		return (x ^ x >> 32) & (v_capacity - 1);
+	}
+	void f_rehash(gc::t_collector& a_collector, size_t a_capacity);
+	t_entry* f_find(gc::t_collector& a_collector, t_object* a_key);
+	void f_put(gc::t_collector& a_collector, t_object* a_key, t_object* a_value);
+	bool f_remove(gc::t_collector& a_collector, t_object* a_key);
+};
+
+// A type of records made by define-record.
+struct t_record_type : t_object_of<t_record_type>
+{
+	t_symbol* v_name;
+	size_t v_size;
+
+	t_record_type(t_symbol* a_name, size_t a_size) : v_name(a_name), v_size(a_size)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+// The values of the fields following the object.
+// The number of them is kept in the record as v_type may have been moved when the collector asks for the size.
+struct t_record : t_object_of<t_record>
+{
+	// v_type is to be set, and the fields are initialized to nil.
+	static t_record* f_new(gc::t_collector& a_collector, size_t a_size);
+
+	t_record_type* v_type = nullptr;
+	size_t v_size;
+
+	t_record(size_t a_size) : v_size(a_size)
+	{
+		std::fill_n(f_fields(), v_size, nullptr);
+	}
+	virtual size_t f_size() const
+	{
+		return std::max(sizeof(t_record) + sizeof(t_object*) * v_size, sizeof(gc::t_collector::t_forward));
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+	t_object** f_fields()
+	{
+		return reinterpret_cast<t_object**>(this + 1);
+	}
+	t_object* const* f_fields() const
+	{
+		return reinterpret_cast<t_object* const*>(this + 1);
+	}
+};
+
 inline const t_dump& operator<<(const t_dump& a_dump, t_object* a_value)
 {
 	if (!a_value) return a_dump << L"()"sv;
+	if (f_is_fixnum(a_value)) return a_dump << std::to_wstring(f_fixnum_value(a_value));
+	if (f_is_flonum(a_value)) {
+		t_float::f_dump(a_dump, f_flonum_value(a_value));
+		return a_dump;
+	}
 	a_value->f_dump(a_dump);
 	return a_dump;
 }
@@ -2,6 +2,8 @@
 #define LILIS__PARSER_H
 
 #include "code.h"
+#include "numbers.h"
+#include <cerrno>
 
 namespace lilis
 {
@@ -60,6 +62,20 @@ struct t_parser
 		error.v_backtrace.push_back(v_location(v_at));
 		throw error;
 	}
+	t_object* f_integer(const wchar_t* a_cs, int a_base) const
+	{
+		errno = 0;
+		auto value = std::wcstoll(a_cs, nullptr, a_base);
+		if (errno == ERANGE || value < c_FIXNUM_MIN || value > c_FIXNUM_MAX) return t_integer::f_parse(a_cs, a_base).f_object(v_engine);
+		return f_fixnum(value);
+	}
+	t_object* f_float(const wchar_t* a_cs) const
+	{
+		errno = 0;
+		auto value = std::wcstod(a_cs, nullptr);
+		if (errno == ERANGE && std::isinf(value)) f_throw(L"float overflow"s);
+		return lilis::f_float(v_engine, value);
+	}
 	t_object* f_expression();
 	auto f_head()
 	{
@@ -145,7 +161,7 @@ t_object* t_parser<T_get, T_pair, T_location>::f_expression()
 				}
 				f_get();
 			}
-			return nullptr;
+			return t_string::f_new(v_engine, f_utf8({cs.data(), cs.size()}));
 		}
 	case L'\'':
 		f_next();
@@ -196,27 +212,31 @@ t_object* t_parser<T_get, T_pair, T_location>::f_expression()
 					break;
 				case L'X':
 				case L'x':
-					cs.push_back(v_c);
-					f_get();
-					if (!std::iswxdigit(v_c)) f_throw(L"lexical error"s);
-					do {
+					{
 						cs.push_back(v_c);
 						f_get();
-					} while (std::iswxdigit(v_c));
-					cs.push_back(L'\0');
-					//v_token = e_token__INTEGER;
-					f_skip();
-					return nullptr;
+						if (!std::iswxdigit(v_c)) f_throw(L"lexical error"s);
+						do {
+							cs.push_back(v_c);
+							f_get();
+						} while (std::iswxdigit(v_c));
+						cs.push_back(L'\0');
+						auto value = f_integer(cs.data(), 16);
+						f_skip();
+						return value;
+					}
 				default:
-					while (std::iswdigit(v_c)) {
-						if (v_c >= L'8') f_throw(L"lexical error"s);
-						cs.push_back(v_c);
-						f_get();
+					{
+						while (std::iswdigit(v_c)) {
+							if (v_c >= L'8') f_throw(L"lexical error"s);
+							cs.push_back(v_c);
+							f_get();
+						}
+						cs.push_back(L'\0');
+						auto value = f_integer(cs.data(), 8);
+						f_skip();
+						return value;
 					}
-					cs.push_back(L'\0');
-					//v_token = e_token__INTEGER;
-					f_skip();
-					return nullptr;
 				}
 			}
 			while (std::iswdigit(v_c)) {
@@ -242,14 +262,14 @@ t_object* t_parser<T_get, T_pair, T_location>::f_expression()
 					} while (std::iswdigit(v_c));
 				}
 				cs.push_back(L'\0');
-				//v_token = e_token__FLOAT;
+				auto value = f_float(cs.data());
 				f_skip();
-				return nullptr;
+				return value;
 			} else {
 				cs.push_back(L'\0');
-				//v_token = e_token__INTEGER;
+				auto value = f_integer(cs.data(), 10);
 				f_skip();
-				return nullptr;
+				return value;
 			}
 		} else {
 			std::vector<wchar_t> cs;
@@ -257,6 +277,38 @@ t_object* t_parser<T_get, T_pair, T_location>::f_expression()
 				cs.push_back(v_c);
 				f_get();
 			} while (v_c != WEOF && !std::iswspace(v_c) && v_c != L')' && v_c != L';');
+			if ((cs[0] == L'+' || cs[0] == L'-') && cs.size() > 1 && std::iswdigit(cs[1])) {
+				auto digits = [&](auto i)
+				{
+					return std::find_if_not(i, cs.end(), [](auto c)
+					{
+						return std::iswdigit(c);
+					});
+				};
+				auto i = digits(cs.begin() + 1);
+				if (i == cs.end()) {
+					cs.push_back(L'\0');
+					auto value = f_integer(cs.data(), 10);
+					f_skip();
+					return value;
+				}
+				// The same syntax as unsigned floats.
+				if (*i == L'.') {
+					i = digits(i + 1);
+					if (i != cs.end() && (*i == L'E' || *i == L'e')) {
+						auto j = i + 1;
+						if (j != cs.end() && (*j == L'+' || *j == L'-')) ++j;
+						auto k = digits(j);
+						if (k != j) i = k;
+					}
+					if (i == cs.end()) {
+						cs.push_back(L'\0');
+						auto value = f_float(cs.data());
+						f_skip();
+						return value;
+					}
+				}
+			}
 			f_skip();
 			return v_engine.f_symbol({cs.data(), cs.size()});
 		}
@@ -266,12 +318,18 @@ t_object* t_parser<T_get, T_pair, T_location>::f_expression()
 template<typename T>
 struct t_parsed_pair : t_object_of<t_parsed_pair<T>, t_pair>
 {
-	T v_source;
+	// Shared by the pairs parsed from the same source.
+	// Held through a pointer since objects are moved by copying their bytes, which does not work for strings stored inline.
+	std::shared_ptr<const T> v_source;
 	t_at v_where_head;
 	t_at v_where_tail;
 
-	t_parsed_pair(t_object* a_head, const T& a_source, const t_at& a_where_head) : t_object_of<t_parsed_pair, t_pair>(a_head, nullptr), v_source(a_source), v_where_head(a_where_head)
+	t_parsed_pair(t_object* a_head, const std::shared_ptr<const T>& a_source, const t_at& a_where_head) : t_object_of<t_parsed_pair, t_pair>(a_head, nullptr), v_source(a_source), v_where_head(a_where_head)
+	{
+	}
+	virtual void f_destruct(gc::t_collector& a_collector)
 	{
+		v_source.reset();
 	}
 };
 
@@ -0,0 +1,409 @@
+#include "persistent.h"
+
+namespace lilis
+{
+
+namespace
+{
+
+uint32_t f_mix(uint64_t a_x)
+{
+	a_x *= 0x9e3779b97f4a7c15;
+	return a_x ^ a_x >> 32;
+}
+
+uint32_t f_hash_bytes(const void* a_p, size_t a_n)
+{
+	uint32_t x = 2166136261;
+	for (auto p = static_cast<const unsigned char*>(a_p), q = p + a_n; p != q; ++p) x = (x ^ *p) * 16777619;
+	return x;
+}
+
+// A key and a value kept updated by the collector.
+struct t_entry : gc::t_root
+{
+	t_object* v_slots[2];
+
+	t_entry(gc::t_collector& a_collector, t_object* const* a_slots) : gc::t_root(a_collector), v_slots{a_slots[0], a_slots[1]}
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector)
+	{
+		a_collector.f_forward(v_slots, 2);
+	}
+};
+
+// Copies a_node unless it is owned by a_edit.
+t_map_node* f_own(gc::t_collector& a_collector, const gc::t_pointer<t_map_node>& a_node, size_t a_edit)
+{
+	if (a_edit && a_node->v_edit == a_edit) return a_node;
+	auto p = t_map_node::f_new(a_collector, a_edit, a_node->v_data, a_node->v_nodes, a_node->v_size);
+	std::copy_n(a_node->f_slots(), a_node->v_size, p->f_slots());
+	return p;
+}
+
+// Makes a node of two entries whose hashes are the same up to a_shift.
+t_map_node* f_merge(gc::t_collector& a_collector, size_t a_shift, t_object** a_x, uint32_t a_x_hash, t_object** a_y, uint32_t a_y_hash, size_t a_edit)
+{
+	if (a_shift >= t_map_node::c_DEPTH) {
+		auto p = t_map_node::f_new(a_collector, a_edit, 0, 0, 4);
+		std::copy_n(a_x, 2, p->f_slots());
+		std::copy_n(a_y, 2, p->f_slots() + 2);
+		return p;
+	}
+	auto x = t_map_node::f_bit(a_x_hash, a_shift);
+	auto y = t_map_node::f_bit(a_y_hash, a_shift);
+	if (x == y) {
+		auto child = a_collector.f_pointer(f_merge(a_collector, a_shift + t_map_node::c_BITS, a_x, a_x_hash, a_y, a_y_hash, a_edit));
+		auto p = t_map_node::f_new(a_collector, a_edit, 0, x, 1);
+		p->f_slots()[0] = child;
+		return p;
+	}
+	auto p = t_map_node::f_new(a_collector, a_edit, x | y, 0, 4);
+	if (x > y) std::swap(a_x, a_y);
+	std::copy_n(a_x, 2, p->f_slots());
+	std::copy_n(a_y, 2, p->f_slots() + 2);
+	return p;
+}
+
+// Makes a copy of a_node with a_n slots from a_i replaced by a_m values of a_values.
+t_map_node* f_splice(gc::t_collector& a_collector, const gc::t_pointer<t_map_node>& a_node, uint32_t a_data, uint32_t a_nodes, size_t a_i, size_t a_n, t_object** a_values, size_t a_m, size_t a_edit)
+{
+	auto size = a_node->v_size - a_n + a_m;
+	auto p = t_map_node::f_new(a_collector, a_edit, a_data, a_nodes, size);
+	auto slots = a_node->f_slots();
+	auto q = std::copy_n(slots, a_i, p->f_slots());
+	q = std::copy_n(a_values, a_m, q);
+	std::copy(slots + a_i + a_n, slots + a_node->v_size, q);
+	return p;
+}
+
+// Moves the entry at a_j to a_i, in either direction, shifting the slots between.
+void f_move(t_object** a_slots, size_t a_j, size_t a_i)
+{
+	if (a_j < a_i)
+		std::rotate(a_slots + a_j, a_slots + a_j + 1, a_slots + a_i + 1);
+	else
+		std::rotate(a_slots + a_i, a_slots + a_j, a_slots + a_j + 1);
+}
+
+}
+
+bool f_hash(t_object* a_key, uint32_t& a_hash)
+{
+	if (!a_key || gc::f_is_immediate(a_key)) {
+		a_hash = f_mix(reinterpret_cast<uintptr_t>(a_key));
+		return true;
+	}
+	auto& type = typeid(*a_key);
+	if (type == typeid(t_symbol)) {
+		auto& name = static_cast<t_symbol*>(a_key)->v_entry->first;
+		a_hash = f_hash_bytes(name.data(), name.size() * sizeof(wchar_t));
+	} else if (type == typeid(t_string)) {
+		auto value = static_cast<t_string*>(a_key)->f_view();
+		a_hash = f_hash_bytes(value.data(), value.size());
+	} else if (type == typeid(t_float)) {
+		a_hash = f_mix(std::bit_cast<uint64_t>(static_cast<t_float*>(a_key)->v_value));
+	} else if (type == typeid(t_bignum)) {
+		auto p = static_cast<t_bignum*>(a_key);
+		a_hash = f_hash_bytes(p->f_digits(), sizeof(uint32_t) * p->v_size) ^ p->v_negative;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool f_key_equals(t_object* a_x, t_object* a_y)
+{
+	if (a_x == a_y) return true;
+	if (!a_x || !a_y || gc::f_is_immediate(a_x) || gc::f_is_immediate(a_y)) return false;
+	auto& type = typeid(*a_x);
+	if (type != typeid(*a_y)) return false;
+	if (type == typeid(t_string)) return static_cast<t_string*>(a_x)->f_view() == static_cast<t_string*>(a_y)->f_view();
+	if (type == typeid(t_float)) return std::bit_cast<uint64_t>(static_cast<t_float*>(a_x)->v_value) == std::bit_cast<uint64_t>(static_cast<t_float*>(a_y)->v_value);
+	if (type == typeid(t_bignum)) {
+		auto x = static_cast<t_bignum*>(a_x);
+		auto y = static_cast<t_bignum*>(a_y);
+		return x->v_negative == y->v_negative && x->v_size == y->v_size && std::equal(x->f_digits(), x->f_digits() + x->v_size, y->f_digits());
+	}
+	return false;
+}
+
+t_map_node* t_map_node::f_new(gc::t_collector& a_collector, size_t a_edit, uint32_t a_data, uint32_t a_nodes, size_t a_size)
+{
+	return new(a_collector.f_allocate(std::max(sizeof(t_map_node) + sizeof(t_object*) * a_size, sizeof(gc::t_collector::t_forward)))) t_map_node(a_edit, a_data, a_nodes, a_size);
+}
+
+void t_map_node::f_scan(gc::t_collector& a_collector)
+{
+	a_collector.f_forward(f_slots(), v_size);
+}
+
+t_object** f_map_find(t_map_node* a_node, uint32_t a_hash, t_object* a_key)
+{
+	for (size_t shift = 0; a_node; shift += t_map_node::c_BITS) {
+		auto slots = a_node->f_slots();
+		if (shift >= t_map_node::c_DEPTH) {
+			for (size_t i = 0; i < a_node->v_size; i += 2) if (f_key_equals(slots[i], a_key)) return slots + i + 1;
+			return nullptr;
+		}
+		auto bit = t_map_node::f_bit(a_hash, shift);
+		if (a_node->v_data & bit) {
+			auto i = a_node->f_entry(bit);
+			return f_key_equals(slots[i], a_key) ? slots + i + 1 : nullptr;
+		}
+		a_node = a_node->v_nodes & bit ? static_cast<t_map_node*>(slots[a_node->f_child(bit)]) : nullptr;
+	}
+	return nullptr;
+}
+
+t_map_node* f_map_put(gc::t_collector& a_collector, t_map_node* a_node, size_t a_shift, uint32_t a_hash, t_object** a_entry, size_t a_edit, bool& a_added)
+{
+	if (!a_node) {
+		a_added = true;
+		auto p = t_map_node::f_new(a_collector, a_edit, t_map_node::f_bit(a_hash, a_shift), 0, 2);
+		std::copy_n(a_entry, 2, p->f_slots());
+		return p;
+	}
+	auto node = a_collector.f_pointer(a_node);
+	auto replace = [&](size_t a_i) -> t_map_node*
+	{
+		if (node->f_slots()[a_i + 1] == a_entry[1]) return node;
+		auto p = f_own(a_collector, node, a_edit);
+		p->f_slots()[a_i + 1] = a_entry[1];
+		return p;
+	};
+	if (a_shift >= t_map_node::c_DEPTH) {
+		for (size_t i = 0; i < node->v_size; i += 2) if (f_key_equals(node->f_slots()[i], a_entry[0])) return replace(i);
+		a_added = true;
+		return f_splice(a_collector, node, 0, 0, node->v_size, 0, a_entry, 2, a_edit);
+	}
+	auto bit = t_map_node::f_bit(a_hash, a_shift);
+	if (node->v_data & bit) {
+		auto i = node->f_entry(bit);
+		if (f_key_equals(node->f_slots()[i], a_entry[0])) return replace(i);
+		uint32_t hash;
+		f_hash(node->f_slots()[i], hash);
+		t_entry entry(a_collector, node->f_slots() + i);
+		auto child = a_collector.f_pointer<t_object>(f_merge(a_collector, a_shift + t_map_node::c_BITS, entry.v_slots, hash, a_entry, a_hash, a_edit));
+		a_added = true;
+		// The entry is replaced with the child.
+		auto p = f_splice(a_collector, node, node->v_data ^ bit, node->v_nodes | bit, i, 2, &child.v_value, 1, a_edit);
+		f_move(p->f_slots(), i, p->f_child(bit));
+		return p;
+	}
+	if (node->v_nodes & bit) {
+		auto i = node->f_child(bit);
+		auto child = f_map_put(a_collector, static_cast<t_map_node*>(node->f_slots()[i]), a_shift + t_map_node::c_BITS, a_hash, a_entry, a_edit, a_added);
+		if (child == node->f_slots()[i]) return node;
+		auto pointer = a_collector.f_pointer(child);
+		auto p = f_own(a_collector, node, a_edit);
+		p->f_slots()[i] = pointer;
+		return p;
+	}
+	a_added = true;
+	return f_splice(a_collector, node, node->v_data | bit, node->v_nodes, node->f_entry(bit), 0, a_entry, 2, a_edit);
+}
+
+t_map_node* f_map_remove(gc::t_collector& a_collector, t_map_node* a_node, size_t a_shift, uint32_t a_hash, t_object** a_key, size_t a_edit, bool& a_removed)
+{
+	if (!a_node) return nullptr;
+	auto node = a_collector.f_pointer(a_node);
+	if (a_shift >= t_map_node::c_DEPTH) {
+		for (size_t i = 0; i < node->v_size; i += 2)
+			if (f_key_equals(node->f_slots()[i], *a_key)) {
+				a_removed = true;
+				return f_splice(a_collector, node, 0, 0, i, 2, nullptr, 0, a_edit);
+			}
+		return node;
+	}
+	auto bit = t_map_node::f_bit(a_hash, a_shift);
+	if (node->v_data & bit) {
+		auto i = node->f_entry(bit);
+		if (!f_key_equals(node->f_slots()[i], *a_key)) return node;
+		a_removed = true;
+		if (node->v_size <= 2) return nullptr;
+		return f_splice(a_collector, node, node->v_data ^ bit, node->v_nodes, i, 2, nullptr, 0, a_edit);
+	}
+	if (!(node->v_nodes & bit)) return node;
+	auto i = node->f_child(bit);
+	auto child = f_map_remove(a_collector, static_cast<t_map_node*>(node->f_slots()[i]), a_shift + t_map_node::c_BITS, a_hash, a_key, a_edit, a_removed);
+	if (child == node->f_slots()[i]) return node;
+	if (!child) {
+		if (node->v_size <= 1) return nullptr;
+		return f_splice(a_collector, node, node->v_data, node->v_nodes ^ bit, i, 1, nullptr, 0, a_edit);
+	}
+	if (child->v_size == 2 && !child->v_nodes) {
+		// The last entry of the child is pulled up into this.
+		t_entry entry(a_collector, child->f_slots());
+		auto p = f_splice(a_collector, node, node->v_data | bit, node->v_nodes ^ bit, i, 1, entry.v_slots, 2, a_edit);
+		auto j = p->f_entry(bit);
+		auto slots = p->f_slots();
+		f_move(slots, i, j);
+		f_move(slots, i + 1, j + 1);
+		return p;
+	}
+	auto pointer = a_collector.f_pointer(child);
+	auto p = f_own(a_collector, node, a_edit);
+	p->f_slots()[i] = pointer;
+	return p;
+}
+
+void t_persistent_map::f_scan(gc::t_collector& a_collector)
+{
+	v_root = a_collector.f_forward(v_root);
+}
+
+void t_persistent_map::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#persistent-map("sv;
+	auto first = true;
+	if (v_root) v_root->f_each(0, [&](auto a_key, auto a_value)
+	{
+		if (!first) a_dump << L' ';
+		first = false;
+		a_dump << L"("sv << a_key << L" . "sv << a_value << L")"sv;
+	});
+	a_dump << L')';
+}
+
+void t_transient_map::f_scan(gc::t_collector& a_collector)
+{
+	v_root = a_collector.f_forward(v_root);
+}
+
+void t_transient_map::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#transient-map"sv;
+}
+
+t_vector_node* t_vector_node::f_new(gc::t_collector& a_collector, size_t a_edit, uint32_t a_size, uint32_t a_capacity)
+{
+	return new(a_collector.f_allocate(std::max(sizeof(t_vector_node) + sizeof(t_object*) * a_capacity, sizeof(gc::t_collector::t_forward)))) t_vector_node(a_edit, a_size, a_capacity);
+}
+
+void t_vector_node::f_scan(gc::t_collector& a_collector)
+{
+	a_collector.f_forward(f_slots(), v_size);
+}
+
+namespace
+{
+
+// Copies a_node unless it is owned by a_edit and has room for a_size slots.
+// Copies for transients have room for the full width.
+t_vector_node* f_own(gc::t_collector& a_collector, const gc::t_pointer<t_vector_node>& a_node, size_t a_size, size_t a_edit)
+{
+	if (a_edit && a_node->v_edit == a_edit && a_node->v_capacity >= a_size) return a_node;
+	auto p = t_vector_node::f_new(a_collector, a_edit, a_node->v_size, a_edit ? t_vector_node::c_WIDTH : std::max<uint32_t>(a_node->v_size, a_size));
+	std::copy_n(a_node->f_slots(), a_node->v_size, p->f_slots());
+	return p;
+}
+
+// a_value is to be kept updated by the collector.
+t_vector_node* f_single(gc::t_collector& a_collector, t_object** a_value, size_t a_edit)
+{
+	auto p = t_vector_node::f_new(a_collector, a_edit, 1, a_edit ? t_vector_node::c_WIDTH : 1);
+	p->f_slots()[0] = *a_value;
+	return p;
+}
+
+t_vector_node* f_set(gc::t_collector& a_collector, t_vector_node* a_node, size_t a_level, size_t a_i, t_object** a_value, size_t a_edit)
+{
+	auto node = a_collector.f_pointer(a_node);
+	auto i = a_i >> a_level & (t_vector_node::c_WIDTH - 1);
+	gc::t_pointer<t_object> value(a_collector, *a_value);
+	if (a_level > 0) value = f_set(a_collector, static_cast<t_vector_node*>(node->f_slots()[i]), a_level - t_vector_node::c_BITS, a_i, a_value, a_edit);
+	auto p = f_own(a_collector, node, 0, a_edit);
+	p->f_slots()[i] = value;
+	return p;
+}
+
+// Makes a path of a_level / 5 nodes down to a_node.
+t_vector_node* f_path(gc::t_collector& a_collector, size_t a_level, t_vector_node* a_node, size_t a_edit)
+{
+	auto node = a_collector.f_pointer<t_object>(a_node);
+	for (; a_level > 0; a_level -= t_vector_node::c_BITS) node = f_single(a_collector, &node.v_value, a_edit);
+	return static_cast<t_vector_node*>(node.v_value);
+}
+
+// Appends a_tail as the leaf for the a_size - 1 th value.
+t_vector_node* f_push_tail(gc::t_collector& a_collector, size_t a_size, size_t a_level, t_vector_node* a_node, t_vector_node* a_tail, size_t a_edit)
+{
+	auto node = a_collector.f_pointer(a_node);
+	auto i = (a_size - 1) >> a_level & (t_vector_node::c_WIDTH - 1);
+	auto child = a_collector.f_pointer(a_tail);
+	if (a_level > t_vector_node::c_BITS) child = i < node->v_size
+		? f_push_tail(a_collector, a_size, a_level - t_vector_node::c_BITS, static_cast<t_vector_node*>(node->f_slots()[i]), child, a_edit)
+		: f_path(a_collector, a_level - t_vector_node::c_BITS, child, a_edit);
+	auto p = f_own(a_collector, node, i + 1, a_edit);
+	p->f_slots()[i] = child;
+	if (i >= p->v_size) p->v_size = i + 1;
+	return p;
+}
+
+}
+
+void t_vector_root::f_set(gc::t_collector& a_collector, size_t a_i, t_object** a_value, size_t a_edit)
+{
+	if (a_i >= f_tail_offset()) {
+		v_tail = f_own(a_collector, a_collector.f_pointer(v_tail), 0, a_edit);
+		v_tail->f_slots()[a_i & (t_vector_node::c_WIDTH - 1)] = *a_value;
+	} else {
+		v_root = lilis::f_set(a_collector, v_root, v_shift, a_i, a_value, a_edit);
+	}
+}
+
+void t_vector_root::f_push(gc::t_collector& a_collector, t_object** a_value, size_t a_edit)
+{
+	if (!v_tail) {
+		v_tail = f_single(a_collector, a_value, a_edit);
+	} else if (v_size - f_tail_offset() < t_vector_node::c_WIDTH) {
+		auto p = f_own(a_collector, a_collector.f_pointer(v_tail), v_tail->v_size + 1, a_edit);
+		p->f_slots()[p->v_size++] = *a_value;
+		v_tail = p;
+	} else {
+		// The full tail is moved into the tree.
+		if (!v_root) {
+			v_root = f_path(a_collector, v_shift, v_tail, a_edit);
+		} else if ((v_size >> t_vector_node::c_BITS) > (size_t(1) << v_shift)) {
+			auto path = a_collector.f_pointer(f_path(a_collector, v_shift, v_tail, a_edit));
+			auto p = t_vector_node::f_new(a_collector, a_edit, 2, a_edit ? t_vector_node::c_WIDTH : 2);
+			p->f_slots()[0] = v_root;
+			p->f_slots()[1] = path;
+			v_root = p;
+			v_shift += t_vector_node::c_BITS;
+		} else {
+			v_root = f_push_tail(a_collector, v_size, v_shift, v_root, v_tail, a_edit);
+		}
+		v_tail = f_single(a_collector, a_value, a_edit);
+	}
+	++v_size;
+}
+
+void t_persistent_vector::f_scan(gc::t_collector& a_collector)
+{
+	v_trie.f_scan(a_collector);
+}
+
+void t_persistent_vector::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#persistent-vector("sv;
+	for (size_t i = 0; i < v_trie.v_size; ++i) {
+		if (i > 0) a_dump << L' ';
+		a_dump << v_trie.f_get(i);
+	}
+	a_dump << L')';
+}
+
+void t_transient_vector::f_scan(gc::t_collector& a_collector)
+{
+	v_trie.f_scan(a_collector);
+}
+
+void t_transient_vector::f_dump(const t_dump& a_dump) const
+{
+	a_dump << L"#transient-vector"sv;
+}
+
+}
@@ -0,0 +1,210 @@
+#ifndef LILIS__PERSISTENT_H
+#define LILIS__PERSISTENT_H
+
+#include "objects.h"
+#include <bit>
+
+namespace lilis
+{
+
+// Persistent collections which share the nodes unchanged by updates between versions.
+// Each node carries the edit of the transient which made it, and is updated in place only by that transient.
+// The edit of a transient is unique and is dropped when it is made persistent, so that the nodes are never updated afterwards.
+
+// Keys of persistent maps are nil, symbols other than gensyms, and numbers and strings compared by value.
+// Returns false if a_key is not one of them.
+bool f_hash(t_object* a_key, uint32_t& a_hash);
+bool f_key_equals(t_object* a_x, t_object* a_y);
+
+// A node of hash array mapped tries in the compressed layout.
+// v_data entries of keys and values are followed by v_nodes children, both in the order of 5 bits of the key hashes at the depth of the node.
+// Keys whose hashes are the same in all the bits are listed in a node deeper than the bits, where v_data and v_nodes are 0.
+struct t_map_node : t_object_of<t_map_node>
+{
+	static constexpr size_t c_BITS = 5;
+	static constexpr size_t c_DEPTH = 32;
+
+	// The slots are to be filled through f_slots().
+	static t_map_node* f_new(gc::t_collector& a_collector, size_t a_edit, uint32_t a_data, uint32_t a_nodes, size_t a_size);
+	static uint32_t f_bit(uint32_t a_hash, size_t a_shift)
+	{
+		return uint32_t(1) << (a_hash >> a_shift & 31);
+	}
+
+	size_t v_edit;
+	uint32_t v_data;
+	uint32_t v_nodes;
+	size_t v_size;
+
+	t_map_node(size_t a_edit, uint32_t a_data, uint32_t a_nodes, size_t a_size) : v_edit(a_edit), v_data(a_data), v_nodes(a_nodes), v_size(a_size)
+	{
+	}
+	virtual size_t f_size() const
+	{
+		return std::max(sizeof(t_map_node) + sizeof(t_object*) * v_size, sizeof(gc::t_collector::t_forward));
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	t_object** f_slots()
+	{
+		return reinterpret_cast<t_object**>(this + 1);
+	}
+	// The index of the key of the entry for a_bit.
+	size_t f_entry(uint32_t a_bit) const
+	{
+		return std::popcount(v_data & (a_bit - 1)) * 2;
+	}
+	// The index of the child for a_bit.
+	size_t f_child(uint32_t a_bit) const
+	{
+		return std::popcount(v_data) * 2 + std::popcount(v_nodes & (a_bit - 1));
+	}
+	// Calls a_do with each key and value.
+	template<typename T>
+	void f_each(size_t a_shift, T a_do)
+	{
+		auto slots = f_slots();
+		auto n = a_shift < c_DEPTH ? std::popcount(v_data) * 2 : v_size;
+		for (size_t i = 0; i < n; i += 2) a_do(slots[i], slots[i + 1]);
+		for (auto i = n; i < v_size; ++i) static_cast<t_map_node*>(slots[i])->f_each(a_shift + c_BITS, a_do);
+	}
+};
+
+// Returns the slot of the value for a_key, or nullptr if not found.
+t_object** f_map_find(t_map_node* a_node, uint32_t a_hash, t_object* a_key);
+// Puts the key and the value at a_entry, which are to be kept updated by the collector.
+// Returns the updated node, which is a_node itself if updated in place or unchanged.
+t_map_node* f_map_put(gc::t_collector& a_collector, t_map_node* a_node, size_t a_shift, uint32_t a_hash, t_object** a_entry, size_t a_edit, bool& a_added);
+// Returns the updated node, or nullptr if it has become empty.
+t_map_node* f_map_remove(gc::t_collector& a_collector, t_map_node* a_node, size_t a_shift, uint32_t a_hash, t_object** a_key, size_t a_edit, bool& a_removed);
+
+struct t_persistent_map : t_object_of<t_persistent_map>
+{
+	size_t v_count;
+	t_map_node* v_root;
+
+	t_persistent_map(size_t a_count, t_map_node* a_root) : v_count(a_count), v_root(a_root)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+// A map updated in place by transient-map-set! and transient-map-delete! until made persistent by persistent!.
+struct t_transient_map : t_object_of<t_transient_map>
+{
+	size_t v_count;
+	t_map_node* v_root;
+	// 0 once made persistent.
+	size_t v_edit;
+
+	t_transient_map(size_t a_count, t_map_node* a_root, size_t a_edit) : v_count(a_count), v_root(a_root), v_edit(a_edit)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+// A node of radix balanced trees, which holds up to 32 values or children packed from the first.
+// v_capacity is more than v_size only in nodes of transients, which append to them in place.
+struct t_vector_node : t_object_of<t_vector_node>
+{
+	static constexpr size_t c_BITS = 5;
+	static constexpr size_t c_WIDTH = 32;
+
+	// The slots from v_size are initialized to nil.
+	static t_vector_node* f_new(gc::t_collector& a_collector, size_t a_edit, uint32_t a_size, uint32_t a_capacity);
+
+	size_t v_edit;
+	uint32_t v_size;
+	uint32_t v_capacity;
+
+	t_vector_node(size_t a_edit, uint32_t a_size, uint32_t a_capacity) : v_edit(a_edit), v_size(a_size), v_capacity(a_capacity)
+	{
+		std::fill(f_slots() + v_size, f_slots() + v_capacity, nullptr);
+	}
+	virtual size_t f_size() const
+	{
+		return std::max(sizeof(t_vector_node) + sizeof(t_object*) * v_capacity, sizeof(gc::t_collector::t_forward));
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	t_object** f_slots()
+	{
+		return reinterpret_cast<t_object**>(this + 1);
+	}
+};
+
+// The values of a vector but the last up to 32 are in the tree of v_root, which is v_shift / 5 levels deep above the leaves.
+// The last ones are in v_tail so that appending to it takes no walk down the tree.
+struct t_vector_trie
+{
+	size_t v_size = 0;
+	size_t v_shift = t_vector_node::c_BITS;
+	t_vector_node* v_root = nullptr;
+	t_vector_node* v_tail = nullptr;
+
+	size_t f_tail_offset() const
+	{
+		return v_size < t_vector_node::c_WIDTH ? 0 : (v_size - 1) & ~(t_vector_node::c_WIDTH - 1);
+	}
+	t_object* f_get(size_t a_i) const
+	{
+		if (a_i >= f_tail_offset()) return v_tail->f_slots()[a_i & (t_vector_node::c_WIDTH - 1)];
+		auto node = v_root;
+		for (auto level = v_shift; level > 0; level -= t_vector_node::c_BITS) node = static_cast<t_vector_node*>(node->f_slots()[a_i >> level & (t_vector_node::c_WIDTH - 1)]);
+		return node->f_slots()[a_i & (t_vector_node::c_WIDTH - 1)];
+	}
+	template<typename T>
+	void f_each(T a_do) const
+	{
+		for (size_t i = 0; i < v_size; ++i) a_do(f_get(i));
+	}
+	void f_scan(gc::t_collector& a_collector)
+	{
+		v_root = a_collector.f_forward(v_root);
+		v_tail = a_collector.f_forward(v_tail);
+	}
+};
+
+// A trie being updated, which is kept updated by the collector.
+struct t_vector_root : t_vector_trie, gc::t_root
+{
+	t_vector_root(gc::t_collector& a_collector, const t_vector_trie& a_trie) : t_vector_trie(a_trie), gc::t_root(a_collector)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector)
+	{
+		t_vector_trie::f_scan(a_collector);
+	}
+	// a_value is to be kept updated by the collector.
+	void f_set(gc::t_collector& a_collector, size_t a_i, t_object** a_value, size_t a_edit);
+	void f_push(gc::t_collector& a_collector, t_object** a_value, size_t a_edit);
+};
+
+struct t_persistent_vector : t_object_of<t_persistent_vector>
+{
+	t_vector_trie v_trie;
+
+	t_persistent_vector(const t_vector_trie& a_trie) : v_trie(a_trie)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+// A vector updated in place by transient-vector-set! and transient-vector-push! until made persistent by persistent!.
+struct t_transient_vector : t_object_of<t_transient_vector>
+{
+	t_vector_trie v_trie;
+	// 0 once made persistent.
+	size_t v_edit;
+
+	t_transient_vector(const t_vector_trie& a_trie, size_t a_edit) : v_trie(a_trie), v_edit(a_edit)
+	{
+	}
+	virtual void f_scan(gc::t_collector& a_collector);
+	virtual void f_dump(const t_dump& a_dump) const;
+};
+
+}
+
+#endif
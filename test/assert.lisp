@@ -4,5 +4,9 @@
   (print x)
   (assert (equal? x y))
 ))
+(define failed? (lambda (thunk)
+  (call-with-prompt catch (lambda (k e) 't) (lambda () (thunk) ()))
+))
 (export assert)
 (export print-assert-equal)
+(export failed?)
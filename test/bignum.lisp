@@ -0,0 +1,37 @@
+(import boolean)
+(import assert)
+(define factorial (lambda (n)
+  (if (> n 1) (* n (factorial (- n 1))) 1)
+))
+(define power (lambda (x n)
+  (if (> n 0) (* x (power x (- n 1))) 1)
+))
+(assert (integer? (factorial 30)))
+(assert (not (float? (factorial 30))))
+(assert (= (factorial 30) 265252859812191058636308480000000))
+(assert (= (- (factorial 30)) -265252859812191058636308480000000))
+(assert (= (* (factorial 300) (factorial 250)) 989439944567185836016167320638125804563755740713188807293020559680241188813849231677092297776138228574205913861652957839000113948040946867214139848663663782726382774893345319711221184546246057215960322465916534162120322335682136320616749958598868615645157428916380112112302708148047966283635504551165940619747461233365405621805704052348820671838563386611964065725854801643325138456232014909827193435177024656064715343903921446360627010661263493060892748673789557575418887774404285452622965151427696294043601588249605954713879828764551172035080824923596090534271955648270834411866312369763265939513254347073456780473248499994559578559904959418523991960099428789072337055185212580573482685389190770823259266991132637778450102619039131833286134788702879235327448545468831245755578720915267026468390405461005863826805622839727391575719939817374401659173210943877599801108862396959994429259876880311436574847170047697710060310607611995780216840555979972154363893282719116820480000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000000))
+(assert (= (* (power 3 400) (power 7 300)) 2387337896900718874580573251883117213081962412657820663943824227444606216375204144109626555626675624590280330744318163037995076368545910729622344355887044237752797668307878621559503027804200353778050985384187124190905384830921436160996171688793916624526508612390772973858312025431933112953620159232843213413731319318245382161361482535892947455322028095598582783315412508607295489785774024889097286517290214169092550917732591546110479812758268001))
+(assert (= (quotient (factorial 300) (+ (factorial 150) 7)) 5356851815834042754281860328124213202444254808984038491714498316053238213073645568652210201325901577725508340538615147852234739179287406584949038405661424740015468799971756673145857679589546314759460557804712742167524648412637021549746023238721021994556466046952259170806295359851952392312170806310664528739064570967556693531009173809847122858268970032))
+(assert (= (remainder (factorial 300) (+ (factorial 150) 7)) 4594225435868545186866493967514140159082400129303986587103145282935783331070139992117209776))
+(assert (= (quotient (- (power 3 400)) 1000000007) -70550790592697791563579730630876681800371177010189076691547686368428280972584967348484527090055444527766840640457471428664629792419416019758232946146904633999627847326365381907885609))
+(assert (= (remainder (- (power 3 400)) 1000000007) -978888738))
+(assert (= (modulo (- (power 3 400)) 1000000007) 21111269))
+(assert (= (modulo (power 3 400) -1000000007) -21111269))
+(assert (= (quotient (power 2 200) (power 2 100)) 1267650600228229401496703205376))
+(assert (= (- (power 2 100) (power 2 100)) 0))
+(assert (eq? (- (+ (power 2 100) 5) (power 2 100)) 5))
+(assert (eq? (quotient (factorial 30) (factorial 29)) 30))
+(assert (< (- (power 2 100)) -4611686018427387905 (power 2 100)))
+(assert (> (power 2 100) 1.0e20))
+(assert (< (power 2 100) 1.0e31))
+(assert (= (inexact (power 2 100)) 1.2676506002282294e+30))
+(assert (= (exact 1.0e30) 1000000000000000019884624838656))
+(assert (= (exact -1.5e20) -150000000000000000000))
+(assert (= (exact 6.0e18) 6000000000000000000))
+(assert (= 0x123456789abcdef0123 5373003642731685151011))
+(assert (= 012345670123456701234567 96374504495306324343))
+(assert (= (+ 1.5 (power 2 70)) 1.1805916207174113e+21))
+(assert (failed? (lambda () (quotient (factorial 30) 0))))
+(assert (failed? (lambda () (exact (* 1.0e300 1.0e300)))))
+(assert (failed? (lambda () (vector-ref (vector 1) (power 2 100)))))
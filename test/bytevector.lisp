@@ -0,0 +1,41 @@
+(import boolean)
+(import assert)
+(define v (make-bytevector 3 7))
+(assert (bytevector? v))
+(assert (not (bytevector? "abc")))
+(assert (= (bytevector-length v) 3))
+(assert (= (bytevector-u8-ref v 2) 7))
+(assert (= (bytevector-u8-set! v 1 255) 255))
+(assert (= (bytevector-u8-ref v 1) 255))
+(assert (= (bytevector-u8-ref (make-bytevector 1) 0) 0))
+(assert (failed? (lambda () (bytevector-u8-ref v 3))))
+(assert (failed? (lambda () (bytevector-u8-ref v -1))))
+(assert (failed? (lambda () (bytevector-u8-set! v 0 256))))
+(assert (failed? (lambda () (make-bytevector 1 -1))))
+(define large (make-bytevector 1000))
+(bytevector-u8-set! large 999 1)
+(assert (= (bytevector-u16-ref large 998) 256))
+(assert (= (bytevector-u16-ref large 998 't) 1))
+(assert (failed? (lambda () (bytevector-u16-ref large 999))))
+(define f (map-file "bytevector.bin"))
+(assert (bytevector? f))
+(assert (= (bytevector-length f) 16))
+(assert (= (bytevector-u8-ref f 4) 255))
+(assert (= (bytevector-u16-ref f 0) 513))
+(assert (= (bytevector-u16-ref f 0 't) 258))
+(assert (= (bytevector-s16-ref f 4) -257))
+(assert (= (bytevector-u32-ref f 0) 67305985))
+(assert (= (bytevector-u32-ref f 4 't) 4294901244))
+(assert (= (bytevector-s32-ref f 4) -50462977))
+(assert (= (bytevector-u64-ref f 0) 18230007237903057409))
+(assert (= (bytevector-s64-ref f 0) -216736835806494207))
+(assert (= (bytevector-s64-ref f 0 't) 72623864001003004))
+(assert (= (bytevector-f64-ref f 8) 1.0))
+(assert (= (bytevector-f32-ref f 12) 1.875))
+(assert (failed? (lambda () (bytevector-f64-ref f 9))))
+(assert (failed? (lambda () (bytevector-u8-set! f 0 0))))
+(assert (failed? (lambda () (map-file "no-such-file"))))
+(assert (failed? (lambda () (map-file "."))))
+(define sum (lambda (v i s) (if (< i (bytevector-length v)) (sum v (+ i 1) (+ s (bytevector-u8-ref v i))) s)))
+(assert (= (sum f 0 0) 1327))
+(print v f)
@@ -0,0 +1,13 @@
+(define try (lambda (thunk)
+  (call-with-prompt catch catch thunk)
+))
+(print 'caught
+  (try (lambda () (cons (car 'x) ())))
+  (try (lambda () (cons (try) ())))
+  (try (lambda () (cons (() 'x) ())))
+  (try (lambda () (cons ('x) ())))
+  (try (lambda () (cons (vector 1 . 'x) ())))
+  (try (lambda () (cons ((lambda (x . xs) xs) 1 . '(2 . 3)) ())))
+  (try (lambda () (cons `(,@'x 1) ())))
+  (try (lambda () (cons `(a ,@'x) ())))
+)
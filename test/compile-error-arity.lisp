@@ -0,0 +1 @@
+(print ((lambda (x y) (cons x y)) 'a))
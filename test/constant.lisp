@@ -0,0 +1,25 @@
+(import boolean)
+(import assert)
+(import table)
+; Structurally equal quoted constants are shared.
+(assert (eq? '(a b) '(a b)))
+(assert (eq? '((y . z)) (cdr '(x (y . z)))))
+; Pairs consed from constants are fresh.
+(assert (not (eq? '(x (y . z)) (cons 'x '((y . z))))))
+(define fresh (lambda () (cons 'a 'b)))
+(assert (not (eq? (fresh) (fresh))))
+(assert (eq? (car (cdr table)) (get)))
+(assert (eq? (car (cdr table)) '(b 2)))
+(assert (not (eq? '(a b) '(a c))))
+(define f (lambda (x) (cons x '(z))))
+(assert (eq? (cdr (f 'y)) '(z)))
+; Constants survive collections.
+(define make (lambda (n xs) (if (> n 0) (make (- n 1) (cons n xs)) xs)))
+(make 1000 ())
+(print-assert-equal table '((a 1) (b 2) (c (d . e))))
+(assert (eq? (car (cdr table)) '(b 2)))
+; Values quoted at run time are kept as they are.
+(define m (module))
+(define x (cons 'a (cons 'b ())))
+(assert (eq? x (eval `',x m)))
+(assert (not (eq? (eval `',(cons 'a (cons 'b ())) m) '(a b))))
@@ -0,0 +1,6 @@
+(import peano)
+(import assert)
+(define ten '(x x x x x x x x x x))
+(define thousand (* ten (* ten ten)))
+(define length (lambda (x) (if x (+ '(x) (length (cdr x))) ())))
+(print-assert-equal (length (+ thousand thousand)) (+ thousand thousand))
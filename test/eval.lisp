@@ -1,3 +1,9 @@
 (import assert)
 (define m (module))
 (print-assert-equal (eval '(cons 'hello '(world)) m) '(hello world))
+; Bindings exported while a code is compiled are visible to the rest of it.
+(eval `(begin
+  (define-macro late () (eval '(begin (define w 5) (export w)) ',m) ())
+  (export late)
+) m)
+(print-assert-equal (eval '(begin (late) w) m) 5)
@@ -0,0 +1,47 @@
+(import boolean)
+(import assert)
+(assert (= 1.5 1.5))
+(assert (= -1.5 (- 1.5)))
+(assert (= +1.5 1.5))
+(assert (< (/ 1.0 (- 0.0)) 0))
+(assert (< (/ 1.0 (+ -0.0)) 0))
+(assert (> (/ 1.0 (- -0.0)) 0))
+(assert (failed? (lambda () (+ 'a))))
+(assert (failed? (lambda () (- 'a))))
+(assert (= 1.5e2 150))
+(assert (= -2.5e-1 -0.25))
+(assert (float? 0.0))
+(assert (float? 1.0e300))
+(assert (float? 1.0e-300))
+(assert (not (float? 1)))
+(assert (not (integer? 1.0)))
+(assert (not (float? '-1.e)))
+(assert (= (+ 0.5 0.25) 0.75))
+(assert (= (+ 1 0.5) 1.5))
+(assert (= (- 1 0.5) 0.5))
+(assert (= (* 2 0.25) 0.5))
+(assert (= (/ 1 4) 0.25))
+(assert (= (/ 4) 0.25))
+(assert (= (/ 1 2 4) 0.125))
+(assert (float? (/ 4 2)))
+(assert (= (* 1.0e300 1.0e-300 3) 3))
+(assert (= (+ 1.0e300 1.0e300) 2.0e300))
+(assert (< 1 1.5 2))
+(assert (not (< 1.5 1)))
+(assert (>= 2.0 2))
+(assert (float? (inexact 3)))
+(assert (= (inexact 3) 3.0))
+(assert (eq? (exact 3.75) 3))
+(assert (eq? (exact -3.75) -3))
+(assert (eq? (exact 1.0e18) 1000000000000000000))
+(assert (= (exact 1.0e300) 1.0e300))
+(assert (failed? (lambda () (exact (* 1.0e300 1.0e300)))))
+(assert (failed? (lambda () (+ 1.0 'x))))
+(assert (failed? (lambda () (quotient 1.0 2))))
+(define half (lambda (x) (/ x 2)))
+(assert (= (half 3) 1.5))
+(define sum (lambda (n s) (if (> n 0) (sum (- n 1) (+ s 0.5)) s)))
+(assert (= (sum 100 0) 50))
+(define big (lambda (n s) (if (> n 0) (big (- n 1) (* s 1.0e10)) s)))
+(assert (= (big 40 1.0) (* 1.0e300 1.0e300)))
+(assert (= (car (cdr '(0.5 1.0e300))) 1.0e300))
@@ -0,0 +1,46 @@
+(import boolean)
+(import assert)
+(define t (make-hash-table))
+(assert (hash-table? t))
+(assert (not (hash-table? '(1))))
+(assert (eq? (hash-table-count t) 0))
+(assert (not (hash-table-ref t 'x)))
+(assert (eq? (hash-table-ref t 'x 'none) 'none))
+(hash-table-set! t 'x 1)
+(hash-table-set! t () 2)
+(hash-table-set! t 42 3)
+(assert (eq? (hash-table-ref t 'x) 1))
+(assert (eq? (hash-table-ref t ()) 2))
+(assert (eq? (hash-table-ref t 42) 3))
+(hash-table-set! t 'x 4)
+(assert (eq? (hash-table-ref t 'x) 4))
+(assert (eq? (hash-table-count t) 3))
+(assert (hash-table-delete! t 'x))
+(assert (not (hash-table-delete! t 'x)))
+(assert (eq? (hash-table-ref t 'x 'none) 'none))
+(assert (eq? (hash-table-count t) 2))
+(assert (failed? (lambda () (hash-table-ref 'x 'x))))
+; Keys are objects moved by collections.
+(define keys (lambda (n ks) (if (> n 0) (keys (- n 1) (cons (cons n ()) ks)) ks)))
+(define ks (keys 200 ()))
+(define put (lambda (ks) (if (pair? ks) (begin (hash-table-set! t (car ks) (car (car ks))) (put (cdr ks))))))
+(put ks)
+(assert (eq? (hash-table-count t) 202))
+(define check (lambda (ks) (if (pair? ks) (if (eq? (hash-table-ref t (car ks)) (car (car ks))) (check (cdr ks))) 't)))
+(assert (check ks))
+(assert (not (hash-table-ref t (cons 1 ()))))
+(define remove (lambda (ks) (if (pair? ks) (begin (hash-table-delete! t (car ks)) (remove (cdr (cdr ks)))))))
+(remove ks)
+(assert (eq? (hash-table-count t) 102))
+(define w (make-hash-table 't))
+(define kept (cons 'kept ()))
+(hash-table-set! w kept 1)
+(hash-table-set! w (keys 1 ()) 2)
+(hash-table-set! w 'symbol 3)
+(hash-table-set! w 7 4)
+(assert (eq? (hash-table-count w) 4))
+; Collects the dropped key, as --debug collects at every allocation.
+(keys 10 ())
+(assert (eq? (hash-table-count w) 3))
+(assert (eq? (hash-table-ref w kept) 1))
+(assert (eq? (hash-table-ref w 7) 4))
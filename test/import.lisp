@@ -1,2 +1,16 @@
 (import assert)
 (assert 't)
+(define not (lambda (x) 'defined))
+(import boolean)
+(assert (eq? (not 't) 'defined))
+(assert (equal? '(1 2) '(1 2)))
+((lambda (equal?) (assert (eq? equal? 'shadowed))) 'shadowed)
+(assert (equal? '(1 2) '(1 2)))
+(define-macro equal? (x y) ''macro)
+(assert (eq? (equal? 1 2) 'macro))
+(define nested (lambda ()
+  (import peano)
+  (assert (eq? (not 't) 'defined))
+  (equal? 1 2)
+))
+(assert (eq? (nested) 'macro))
@@ -0,0 +1,11 @@
+(import inline)
+(import boolean)
+(import assert)
+(define swap-all (lambda (xs) (if xs (cons (swap (car xs)) (swap-all (cdr xs))))))
+(define last-of (lambda (xs) (last xs)))
+(print-assert-equal (swap-all '((a . b) (c . d))) '((b . a) (d . c)))
+(print-assert-equal (last-of '(a b c)) 'c)
+(set! swap (lambda (x) x))
+(print-assert-equal (swap-all '((a . b) (c . d))) '((a . b) (c . d)))
+(set! last car)
+(print-assert-equal (last-of '(a b c)) 'a)
@@ -0,0 +1,4 @@
+(define swap (lambda (x) (cons (cdr x) (car x))))
+(define last (lambda (x) (if (cdr x) (last (cdr x)) (car x))))
+(export swap)
+(export last)
@@ -0,0 +1,7 @@
+(define factorial (lambda (n)
+  (if (> n 1) (* n (factorial (- n 1))) 1)
+))
+(print (factorial 20))
+(print (factorial 21))
+(print (- (factorial 25)))
+(print (quotient (factorial 21) 0))
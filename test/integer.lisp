@@ -0,0 +1,51 @@
+(import boolean)
+(import assert)
+(assert (eq? 42 42))
+(assert (eq? 0x2a 42))
+(assert (eq? 052 42))
+(assert (eq? -42 (- 42)))
+(assert (eq? (+ 42) 42))
+(assert (eq? +42 42))
+(assert (integer? 0))
+(assert (not (integer? 'x)))
+(assert (eq? (+ 1 2) 3))
+(assert (eq? (- 1 2) -1))
+(assert (eq? (* -6 7) -42))
+(assert (eq? (quotient 7 2) 3))
+(assert (eq? (quotient -7 2) -3))
+(assert (eq? (remainder -7 2) -1))
+(assert (eq? (modulo -7 2) 1))
+(assert (eq? (modulo 7 -2) -1))
+(assert (= 1 1))
+(assert (< 1 2))
+(assert (not (< 2 1)))
+(assert (<= 2 2))
+(assert (> 2 1))
+(assert (>= 2 2))
+(assert (not (>= 1 2)))
+(assert (eq? (+) 0))
+(assert (eq? (*) 1))
+(assert (eq? (+ 1 2 3 4) 10))
+(assert (eq? (- 10 1 2 3) 4))
+(assert (eq? (* 1 2 3 4) 24))
+(assert (< 1 2 3))
+(assert (not (< 1 3 2)))
+(define add +)
+(assert (eq? (add 1 2) 3))
+(define xs '(1 2))
+(assert (eq? (+ . xs) 3))
+(assert (equal? `(,(+ 1 2) . 4) '(3 . 4)))
+(define sum (lambda (n s) (if (> n 0) (sum (- n 1) (+ s n)) s)))
+(assert (eq? (sum 10000 0) 50005000))
+(assert (eq? (+ 4611686018427387902 1) 4611686018427387903))
+(assert (eq? (- -4611686018427387903 1) -4611686018427387904))
+(assert (integer? (+ 4611686018427387903 1)))
+(assert (= (+ 4611686018427387903 1) 4611686018427387904))
+(assert (= (- -4611686018427387904 1) -4611686018427387905))
+(assert (= (* 4611686018427387903 2) 9223372036854775806))
+(assert (= (quotient -4611686018427387904 -1) 4611686018427387904))
+(assert (eq? (- (+ 4611686018427387903 1) 1) 4611686018427387903))
+(assert (failed? (lambda () (quotient 1 0))))
+(assert (failed? (lambda () (+ 1 'x))))
+(assert (failed? (lambda () (< 'x 1))))
+(assert (failed? (lambda () (1 2))))
@@ -0,0 +1,30 @@
+(import assert)
+(import boolean)
+(define x 'outer)
+(assert (equal? ((lambda (x y) (cons y x)) 'a 'b) '(b . a)))
+(assert (eq? x 'outer))
+(assert (eq? ((lambda (y) (define x y) x) 'inner) 'inner))
+(assert (eq? x 'outer))
+(assert (eq? ((lambda ())) ()))
+(assert (equal? ((lambda (x) ((lambda (x) (cons x x)) (cons x ()))) 'a) '((a) a)))
+
+; Arguments see the outer bindings.
+(assert (equal? ((lambda (x y) (cons x y)) 'a x) '(a . outer)))
+
+; Closures keep their own bindings.
+(define make (lambda (x) ((lambda (y) (lambda () (cons x y))) 'b)))
+(assert (equal? ((make 'a)) '(a . b)))
+(assert (equal? ((make 'c)) '(c . b)))
+
+; The body stays in tail position.
+(define count (lambda (xs n)
+	((lambda (ys) (if ys (count (cdr ys) (cons () n)) n)) xs)))
+(assert (equal? (count '(a b c) ()) '(() () ())))
+
+; Closures made by the body see each re-entry of a continuation.
+(define fs ())
+(call-with-prompt 'p
+	(lambda (k) (k 'one) (k 'two))
+	(lambda () ((lambda (x) (set! fs (cons (lambda () x) fs))) (abort-to-prompt 'p))))
+(assert (eq? ((car fs)) 'two))
+(assert (eq? ((car (cdr fs))) 'one))
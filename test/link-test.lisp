@@ -0,0 +1,11 @@
+(import link)
+(import boolean)
+(import assert)
+(define get-x (lambda () x))
+(define get-y (lambda () (car y)))
+(print-assert-equal (get-x) 'a)
+(print-assert-equal (get-y) 'b)
+(set-x 'c)
+(print-assert-equal (get-x) 'c)
+(print-assert-equal x 'c)
+(print-assert-equal (get-y) 'b)
@@ -0,0 +1,7 @@
+(define x 'a)
+(define export-x (lambda () (export x)))
+(export-x)
+(define set-x (lambda (v) (set! x v) (export-x)))
+(define y '(b))
+(export y)
+(export set-x)
@@ -0,0 +1,42 @@
+(import boolean)
+(import assert)
+(define iota (lambda (n xs) (if (> n 0) (iota (- n 1) (cons n xs)) xs)))
+(assert (eq? (length ()) 0))
+(assert (eq? (length '(a b c)) 3))
+(assert (failed? (lambda () (length '(a . b)))))
+(print-assert-equal (reverse '(a b c)) '(c b a))
+(assert (not (reverse ())))
+(print-assert-equal (list-ref '(a b c) 2) 'c)
+(assert (failed? (lambda () (list-ref '(a b c) 3))))
+(print-assert-equal (last-pair '(a b . c)) '(b . c))
+(print-assert-equal (memq 'b '(a b c)) '(b c))
+(assert (not (memq 'd '(a b c))))
+(print-assert-equal (assq 'b '((a 1) (b 2))) '(b 2))
+(assert (not (assq 'c '((a 1) (b 2)))))
+(assert (failed? (lambda () (assq 'c '(a)))))
+; Closures are called back.
+(define n 10)
+(print-assert-equal (map (lambda (x) (+ x n)) '(1 2 3)) '(11 12 13))
+(print-assert-equal (filter (lambda (x) (> x 1)) '(1 2 3)) '(2 3))
+(print-assert-equal (fold cons () '(1 2 3)) '(3 2 1))
+(print-assert-equal (map car '((a) (b))) '(a b))
+(assert (not (map car ())))
+(assert (failed? (lambda () (map car '(a)))))
+(assert (failed? (lambda () (map car '((a) . b)))))
+(assert (failed? (lambda () (map 'x '(a)))))
+; Long lists use neither native nor frame recursion.
+(define xs (iota 1000 ()))
+(assert (eq? (length xs) 1000))
+(assert (eq? (length (map (lambda (x) (cons x x)) xs)) 1000))
+(assert (eq? (fold + 0 xs) 500500))
+(assert (eq? (car (reverse xs)) 1000))
+(assert (eq? (length (filter (lambda (x) (< x 101)) xs)) 100))
+; Callbacks nest.
+(print-assert-equal (map (lambda (ys) (map (lambda (x) (* x x)) ys)) '((1 2) (3))) '((1 4) (9)))
+; A continuation captured in a callback resumes the iteration.
+(define k ())
+(print-assert-equal (call-with-prompt 'list
+  (lambda (c x) (set! k c) (c x))
+  (lambda () (map (lambda (x) (if (eq? x 2) (abort-to-prompt 'list 20) x)) '(1 2 3)))
+) '(1 20 3))
+(print-assert-equal (k 200) '(1 200 3))
@@ -0,0 +1 @@
+(print (begin 'a print (begin 'b (if () (car 'c) `(d . e)))))
@@ -0,0 +1,11 @@
+(define f (lambda (x y)
+  (if x
+    (if y (cons x y) 'no-y)
+    (if y 'no-x (begin 'a x y)))
+))
+(define g (lambda (x)
+  (if x (cons (f x x) (car x)))
+  (if x 'then)
+))
+(print (f 'a 'b) (f 'a ()) (f () 'b) (f () ()) (g ()) (g '(a)))
+(print (g 'a))
@@ -0,0 +1,82 @@
+(import boolean)
+(import assert)
+(define for (lambda (i n f) (if (< i n) (begin (f i) (for (+ i 1) n f)))))
+(define all? (lambda (i n f) (if (< i n) (if (f i) (all? (+ i 1) n f)) 't)))
+; Maps
+(define m (persistent-map 'a 1 "b" 2 3.5 3 100000000000000000000 4 () 5))
+(assert (persistent-map? m))
+(assert (not (persistent-map? '(a))))
+(assert (eq? (persistent-map-count m) 5))
+(assert (eq? (persistent-map-ref m 'a) 1))
+(assert (eq? (persistent-map-ref m (string-append "b")) 2))
+(assert (eq? (persistent-map-ref m 3.5) 3))
+(assert (eq? (persistent-map-ref m (* 10000000000 10000000000)) 4))
+(assert (eq? (persistent-map-ref m ()) 5))
+(assert (not (persistent-map-ref m 'x)))
+(assert (eq? (persistent-map-ref m 'x 'none) 'none))
+(assert (failed? (lambda () (persistent-map-ref m '(a)))))
+(assert (failed? (lambda () (persistent-map-set m (gensym) 1))))
+(define m2 (persistent-map-set m 'a 10))
+(assert (eq? (persistent-map-ref m2 'a) 10))
+(assert (eq? (persistent-map-ref m 'a) 1))
+(assert (eq? (persistent-map-count m2) 5))
+(assert (eq? (persistent-map-set m 'a 1) m))
+(define m3 (persistent-map-delete m "b"))
+(assert (eq? (persistent-map-count m3) 4))
+(assert (not (persistent-map-ref m3 "b")))
+(assert (eq? (persistent-map-ref m "b") 2))
+(assert (eq? (persistent-map-delete m 'x) m))
+; Many keys deep in the trie, and versions sharing them.
+(define n 300)
+(define big (persistent-map))
+(for 0 n (lambda (i) (set! big (persistent-map-set big i (* i i)))))
+(assert (eq? (persistent-map-count big) n))
+(assert (all? 0 n (lambda (i) (eq? (persistent-map-ref big i) (* i i)))))
+(define half big)
+(for 0 n (lambda (i) (if (eq? (remainder i 2) 0) (set! half (persistent-map-delete half i)))))
+(assert (eq? (persistent-map-count half) (quotient n 2)))
+(assert (all? 0 n (lambda (i) (eq? (persistent-map-ref half i 'none) (if (eq? (remainder i 2) 0) 'none (* i i))))))
+(assert (all? 0 n (lambda (i) (eq? (persistent-map-ref big i) (* i i)))))
+(for 0 n (lambda (i) (set! half (persistent-map-delete half i))))
+(assert (eq? (persistent-map-count half) 0))
+(print half)
+; Transients
+(define t (transient big))
+(for 0 n (lambda (i) (transient-map-set! t i (- i))))
+(transient-map-delete! t 0)
+(transient-map-set! t 'x 'y)
+(assert (eq? (persistent-map-ref t 1) -1))
+(define big2 (persistent! t))
+(assert (eq? (persistent-map-count big2) n))
+(assert (all? 1 n (lambda (i) (eq? (persistent-map-ref big2 i) (- i)))))
+(assert (eq? (persistent-map-ref big2 'x) 'y))
+(assert (all? 0 n (lambda (i) (eq? (persistent-map-ref big i) (* i i)))))
+(assert (failed? (lambda () (transient-map-set! t 'x 'z))))
+(assert (eq? (persistent-map-ref big2 'x) 'y))
+; Vectors
+(define v (persistent-vector 'a 'b 'c))
+(assert (persistent-vector? v))
+(assert (not (persistent-vector? m)))
+(assert (eq? (persistent-vector-length v) 3))
+(assert (eq? (persistent-vector-ref v 1) 'b))
+(assert (failed? (lambda () (persistent-vector-ref v 3))))
+(print (persistent-vector-set v 1 'x))
+(assert (eq? (persistent-vector-ref v 1) 'b))
+(print (persistent-vector-push v 'd))
+(define vn 1100)
+(define w (persistent-vector))
+(for 0 vn (lambda (i) (set! w (persistent-vector-push w i))))
+(assert (eq? (persistent-vector-length w) vn))
+(assert (all? 0 vn (lambda (i) (eq? (persistent-vector-ref w i) i))))
+(define w2 w)
+(for 0 vn (lambda (i) (if (eq? (remainder i 7) 0) (set! w2 (persistent-vector-set w2 i 'x)))))
+(assert (all? 0 vn (lambda (i) (eq? (persistent-vector-ref w2 i) (if (eq? (remainder i 7) 0) 'x i)))))
+(assert (all? 0 vn (lambda (i) (eq? (persistent-vector-ref w i) i))))
+(define tv (transient (persistent-vector)))
+(for 0 vn (lambda (i) (transient-vector-push! tv (- i))))
+(transient-vector-set! tv 1000 'y)
+(assert (eq? (persistent-vector-ref tv 1000) 'y))
+(define w3 (persistent! tv))
+(assert (all? 0 vn (lambda (i) (eq? (persistent-vector-ref w3 i) (if (eq? i 1000) 'y (- i))))))
+(assert (failed? (lambda () (transient-vector-push! tv 0))))
+(assert (failed? (lambda () (persistent! tv))))
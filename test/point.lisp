@@ -0,0 +1,6 @@
+(define-record point x y)
+(export make-point)
+(export point?)
+(export point-x)
+(export point-y)
+(export set-point-x!)
@@ -0,0 +1,2 @@
+(define x '(hello))
+(print `(foo (bar . baz) ,x ,@x))
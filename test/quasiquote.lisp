@@ -31,3 +31,8 @@
   )
   (print-assert-equal (xx) '(hello world))
 ))
+(print-assert-equal `(foo . bar) '(foo . bar))
+(print-assert-equal `(foo ,x . bar) '(foo hello . bar))
+(print-assert-equal `(foo . ,x) '(foo . hello))
+(print-assert-equal `(,@y ,x . bar) '(hello world hello . bar))
+(assert (eq? (cdr `(foo ,@y)) y))
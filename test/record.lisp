@@ -0,0 +1,49 @@
+(import boolean)
+(import assert)
+(import point)
+(define-record node value next)
+(define p (make-node 1 ()))
+(assert (node? p))
+(assert (eq? (node-value p) 1))
+(assert (eq? (node-next p) ()))
+(assert (eq? (set-node-next! p 'x) 'x))
+(assert (eq? (node-next p) 'x))
+(assert (not (node? '(1))))
+(assert (not (node? 1)))
+(assert (not (node? ())))
+(define q (make-point 1 2))
+(assert (point? q))
+(assert (not (node? q)))
+(assert (not (point? p)))
+(assert (eq? (point-y q) 2))
+(set-point-x! q 3)
+(assert (eq? (point-x q) 3))
+(assert (failed? (lambda () (node-value q))))
+(assert (failed? (lambda () (point-x p))))
+(assert (failed? (lambda () (set-node-next! q 1))))
+(assert (failed? (lambda () (node-value 1))))
+(assert (failed? (lambda () (node-value ()))))
+(assert (failed? (lambda () (make-node 1))))
+(assert (failed? (lambda () (node-value p 1))))
+(define-record empty)
+(assert (empty? (make-empty)))
+(assert (not (eq? (make-empty) (make-empty))))
+(define apply2 (lambda (f x y) (f x y)))
+(define apply1 (lambda (f x) (f x)))
+(define r (apply2 make-node 'a 'b))
+(assert (eq? (apply1 node-value r) 'a))
+(assert (eq? (apply1 node? r) r))
+(assert (not (apply1 node? q)))
+(assert (eq? (apply2 set-node-value! r 'c) 'c))
+(assert (eq? (node-value r) 'c))
+(assert (failed? (lambda () (apply1 node-value q))))
+(assert (failed? (lambda () (apply2 make-node 1 2 3))))
+(define build (lambda (n xs) (if (> n 0) (build (- n 1) (make-node n xs)) xs)))
+(define sum (lambda (xs s) (if xs (sum (node-next xs) (+ s (node-value xs))) s)))
+(assert (= (sum (build 100 ()) 0) 5050))
+(define local (lambda ()
+  (define-record pair left right)
+  (pair-right (make-pair 1 2))
+))
+(assert (eq? (local) 2))
+(print (make-node 1 (make-point 2 '(3))))
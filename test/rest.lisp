@@ -13,3 +13,14 @@
 (print-assert-equal (f 'foo 'bar . '(zot)) '(foo bar zot))
 (print-assert-equal (f 'foo . '(bar zot)) '(foo bar zot))
 (print-assert-equal (f . '(foo bar zot)) '(foo bar zot))
+(define list* (lambda (x . xs) (cons x xs)))
+(define forward (lambda xs (list* . xs)))
+(print-assert-equal (forward 'foo 'bar 'zot) '(foo bar zot))
+(define forward-rest (lambda (x . xs) (list* x . xs)))
+(print-assert-equal (forward-rest 'foo 'bar 'zot) '(foo bar zot))
+(define forward-more (lambda (x . xs) (list* x 'bar . xs)))
+(print-assert-equal (forward-more 'foo 'zot) '(foo bar zot))
+(define list (lambda xs xs))
+(define xs '(foo bar))
+(assert (eq? (list . xs) xs))
+(print-assert-equal (list 'zot . xs) '(zot foo bar))
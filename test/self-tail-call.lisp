@@ -0,0 +1,28 @@
+(import assert)
+(import boolean)
+(define count (lambda (n m)
+	(if n (count (cdr n) (cons () m)) m)))
+(define make (lambda (n)
+	(define loop (lambda (i xs)
+		(if i (loop (cdr i) (cons i xs)) xs)))
+	(loop n ())))
+(define length (lambda (xs)
+	(define loop (lambda (xs n)
+		(if xs (loop (cdr xs) (cons () n)) n)))
+	(loop xs ())))
+(define long (make '(() () () () () () () () () () () () () () () () ())))
+(assert (equal? (length (count long ())) (length long)))
+
+; A closure captured in the body keeps seeing its own bindings.
+(define closures (lambda (n fs)
+	(if n (closures (cdr n) (cons (lambda () n) fs)) fs)))
+(define fs (closures '(a b c) ()))
+(assert (eq? (car ((car fs))) 'c))
+(assert (eq? (car ((car (cdr (cdr fs))))) 'a))
+
+; A set! binding is called as usual.
+(define changed (lambda (n)
+	(if n (changed (cdr n)) 'done)))
+(define original changed)
+(set! changed (lambda (n) 'replaced))
+(assert (eq? (original '(a)) 'replaced))
@@ -0,0 +1,50 @@
+(import peano)
+(import boolean)
+(import assert)
+(define reset (lambda (thunk)
+  (call-with-prompt/one-shot 'for-reset/shift (lambda (k thunk) (thunk k)) thunk)
+))
+(define shift (lambda (thunk)
+  (abort-to-prompt 'for-reset/shift thunk)
+))
+(define for-each (lambda (xs f) (if xs ((lambda ()
+  (f (car xs))
+  (for-each (cdr xs) f)
+)))))
+(define yield (lambda (x)
+  (shift (lambda (k) (cons x (lambda () (k ())))))
+))
+(define list->lazy (lambda (xs)
+  (reset (lambda () (for-each xs yield) ()))
+))
+(define lazy->list (lambda (xs)
+  (if xs (cons (car xs) (lazy->list ((cdr xs)))))
+))
+(print-assert-equal (reset (lambda () 'x)) 'x)
+(print-assert-equal (reset (lambda ()
+  (shift (lambda (k) (cons '(x) (k ()))))
+  (shift (lambda (k) (cons '(x x) (k ()))))
+  ()
+)) '((x) (x x)))
+(print-assert-equal (lazy->list (list->lazy '((x) (x x) (x x x)))) '((x) (x x) (x x x)))
+(define ten '(x x x x x x x x x x))
+(define hundred (* ten ten))
+(print-assert-equal (lazy->list (list->lazy hundred)) hundred)
+(print-assert-equal (lazy->list (reset (lambda ()
+  (yield 'a)
+  (for-each (lazy->list (list->lazy '(b c))) yield)
+  (yield 'd)
+  ()
+))) '(a b c d))
+(define try (lambda (thunk)
+  (call-with-prompt catch (lambda (k e) 'caught) thunk)
+))
+(print-assert-equal (try (lambda ()
+  ((cdr (reset (lambda () (yield 'a) (car 'a)))))
+)) 'caught)
+(print-assert-equal (try (lambda ()
+  (define k (cdr (reset (lambda () (yield 'a) ()))))
+  (k)
+  (k)
+)) 'caught)
+(print-assert-equal (lazy->list (list->lazy '(a b))) '(a b))
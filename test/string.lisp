@@ -0,0 +1,30 @@
+(import boolean)
+(import assert)
+(assert (string? "hello"))
+(assert (not (string? 'hello)))
+(assert (eq? (string-length "") 0))
+(assert (eq? (string-length "hello") 5))
+(assert (eq? (string-length "héllo") 6))
+(assert (eq? (string-length "\"\\\n") 3))
+(assert (eq? (string-byte "hello" 1) 101))
+(assert (failed? (lambda () (string-byte "hello" 5))))
+(assert (string=? "hello" "hello"))
+(assert (not (string=? "hello" "hell")))
+(assert (string=? (string-append "hel" "lo" "") "hello"))
+(assert (string=? (string-append) ""))
+(assert (string=? (substring "hello" 1 3) "el"))
+(assert (string=? (substring "hello" 2) "llo"))
+(assert (failed? (lambda () (substring "hello" 3 2))))
+(assert (failed? (lambda () (substring "hello" 0 6))))
+(assert (eq? (string-search "hello" "l") 2))
+(assert (eq? (string-search "hello" "l" 3) 3))
+(assert (eq? (string-search "hello" "") 0))
+(assert (not (string-search "hello" "x")))
+(define repeat (lambda (s n) (if (> n 0) (string-append s (repeat s (- n 1))) "")))
+(define long (repeat "0123456789" 100))
+(assert (eq? (string-length long) 1000))
+(assert (eq? (string-search (string-append long "needle" long) "needle") 1000))
+(assert (string=? (substring long 995 1000) "56789"))
+(assert (string=? (substring (string-append long "needle") 1000) "needle"))
+(assert (failed? (lambda () (string-append "x" 'x))))
+(print "tab\there" "café")
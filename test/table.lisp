@@ -0,0 +1,4 @@
+(define table '((a 1) (b 2) (c (d . e))))
+(define get (lambda () '(b 2)))
+(export table)
+(export get)
@@ -0,0 +1,35 @@
+(import boolean)
+(import assert)
+(define v (make-vector 3))
+(assert (vector? v))
+(assert (not (vector? '(1 2 3))))
+(assert (eq? (vector-length v) 3))
+(assert (not (vector-ref v 0)))
+(vector-set! v 1 'x)
+(assert (eq? (vector-ref v 1) 'x))
+(assert (failed? (lambda () (vector-ref v 3))))
+(assert (failed? (lambda () (vector-set! v -1 'x))))
+(assert (vector-eq? (make-vector 2 'a) (vector 'a 'a)))
+(assert (not (vector-eq? (vector 1 2) (vector 1 2 3))))
+(assert (not (vector-eq? (vector 1 2) (vector 1 3))))
+(assert (vector-eq? (vector) (make-vector 0)))
+(assert (failed? (lambda () (make-vector 100000000000000))))
+(assert (vector-eq? (make-vector 20 'a) (make-vector 20 'a)))
+(define w (vector 0 1 2 3 4 5 6 7))
+(vector-fill! w 'z 2 4)
+(assert (vector-eq? w (vector 0 1 'z 'z 4 5 6 7)))
+(vector-copy! w 1 w 4)
+(assert (vector-eq? w (vector 0 4 5 6 7 5 6 7)))
+(vector-copy! w 3 w 0 4)
+(assert (vector-eq? w (vector 0 4 5 0 4 5 6 7)))
+(vector-copy! w 0 (vector 'a 'b))
+(assert (vector-eq? w (vector 'a 'b 5 0 4 5 6 7)))
+(assert (failed? (lambda () (vector-copy! w 7 (vector 'a 'b)))))
+(assert (failed? (lambda () (vector-fill! w 'z 4 2))))
+(vector-fill! w ())
+(assert (vector-eq? w (make-vector 8)))
+(define fill (lambda (v i) (if (< i (vector-length v)) (begin (vector-set! v i (cons i ())) (fill v (+ i 1))) v)))
+(define u (fill (make-vector 1000) 0))
+(define sum (lambda (v i s) (if (< i (vector-length v)) (sum v (+ i 1) (+ s (car (vector-ref v i)))) s)))
+(assert (eq? (sum u 0 0) 499500))
+(print (vector 1 'a "b" (vector)))